@@ -30,23 +30,33 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 
 #include "dbus_helpers.h"
 #include "dbus_json.h"
 #include "keys.h"
 #include "string_utils.h"
+#include "credentials.h"
 
 #include "agent.h"
 
 /*
  * This is a strip down of the agent.c implementation in connmanctl.
- * GLib dependancies have been removed as well as vpn_agent. Finally, the
- * overall is more simple and only allow a single agent request at any given
- * time.
+ * GLib dependancies have been removed as well as vpn_agent. Up to
+ * AGENT_MAX_REQUESTS requests can wait for an answer at the same time, they
+ * are identified by the key_agent_request_id of the messages.
+ * Input requests are answered at once if the credentials are known, see
+ * credentials.c.
  */
 
+// A request of connman waiting for an answer.
+struct agent_data {
+	unsigned int id;	// 0 if the slot is free
+	DBusMessage *message;
+};
+
 // This is the generic callback for agent requests / errors.
-void (*agent_callback)(struct json_object *data, struct agent_data *request) = NULL;
+void (*agent_callback)(struct json_object *data) = NULL;
 
 // agent_error_callback is dedicated to agent register/unregister errors.
 void (*agent_error_callback)(struct json_object *data) = NULL;
@@ -55,21 +65,27 @@ void (*agent_error_callback)(struct json_object *data) = NULL;
 static DBusConnection *agent_connection;
 
 // The callback to call to respond to an agent browser requets.
-void request_browser_return(struct json_object *connected,
-		struct agent_data *request);
+int request_browser_return(unsigned int id, struct json_object *connected);
+
+// Whether the agent is registered to connman.
+static bool agent_registered;
 
-// The callback to call to respond to an agent error.
-void report_error_return(struct json_object *retry, struct agent_data *request);
+// The requests waiting for an answer.
+static struct agent_data agent_requests[AGENT_MAX_REQUESTS];
+
+// The id of the last request received.
+static unsigned int last_request_id;
 
 /*
  * Format the agent error:
  {
 	key_agent_error: error,
-	key_service: service
+	key_service: service,
+	key_agent_request_id: id (if id != 0)
  }
 */
 static struct json_object* format_agent_error(const char *error,
-		const char *service)
+		const char *service, unsigned int id)
 {
 	struct json_object *res;
 
@@ -79,6 +95,10 @@ static struct json_object* format_agent_error(const char *error,
 	json_object_object_add(res, key_service,
 			json_object_new_string(service));
 
+	if (id)
+		json_object_object_add(res, key_agent_request_id,
+				json_object_new_int(id));
+
 	return res;
 }
 
@@ -107,11 +127,12 @@ static void format_agent_with_callback(struct json_object *jerror,
  {
 	key_agent_msg: msg,
 	key_service: service,
+	key_agent_request_id: id,
 	key_agent_msg_data: { data }
  }
 */
 static struct json_object* format_agent_msg(const char *msg,
-		const char *service, struct json_object *data)
+		const char *service, unsigned int id, struct json_object *data)
 {
 	struct json_object *res;
 
@@ -121,6 +142,8 @@ static struct json_object* format_agent_msg(const char *msg,
 			json_object_new_string(msg));
 	json_object_object_add(res, key_service,
 			json_object_new_string(service));
+	json_object_object_add(res, key_agent_request_id,
+			json_object_new_int(id));
 
 	if (data)
 		json_object_object_add(res, key_agent_msg_data, data);
@@ -128,14 +151,6 @@ static struct json_object* format_agent_msg(const char *msg,
 	return res;
 }
 
-/*
- * The agent_request is used to keep in a place multiple informations on the
- * agent and the current request. See agent.h for definition.
- */
-static struct agent_data agent_request = {
-	key_agent_interface,
-};
-
 /*
  * Return the custom agent dbus path.
  */
@@ -152,101 +167,211 @@ static void append_path(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(iter, DBUS_TYPE_OBJECT_PATH, &path);
 }
 
-static void pending_message_remove(struct agent_data *request)
+/*
+ * Keep a request until it's answered, see request_reply().
+ * Return the request, NULL if AGENT_MAX_REQUESTS requests are already waiting
+ * for an answer.
+ * @param message the request, its reference count is incremented
+ */
+static struct agent_data* request_new(DBusMessage *message)
 {
-	if (request->message) {
-		dbus_message_unref(request->message);
-		request->message = NULL;
+	int i;
+
+	for (i = 0; i < AGENT_MAX_REQUESTS; i++) {
+		if (agent_requests[i].id != 0)
+			continue;
+
+		// 0 means free
+		if (++last_request_id == 0)
+			last_request_id++;
+
+		agent_requests[i].id = last_request_id;
+		agent_requests[i].message = dbus_message_ref(message);
+
+		return &agent_requests[i];
 	}
 
-	if (request->reply) {
-		dbus_message_unref(request->reply);
-		request->reply = NULL;
+	return NULL;
+}
+
+/*
+ * Return the request waiting for an answer with the id, NULL if there is
+ * none (it has been answered or canceled).
+ */
+static struct agent_data* request_find(unsigned int id)
+{
+	int i;
+
+	for (i = 0; id != 0 && i < AGENT_MAX_REQUESTS; i++) {
+		if (agent_requests[i].id == id)
+			return &agent_requests[i];
 	}
+
+	return NULL;
 }
 
-static void pending_command_complete()
+/*
+ * Return the last request received still waiting for an answer, NULL if none.
+ */
+static struct agent_data* request_last(void)
 {
-	struct agent_data *next_request = NULL;
-	DBusMessage *pending_message;
-	DBusMethodFunction pending_function;
+	struct agent_data *last = NULL;
+	int i;
+
+	for (i = 0; i < AGENT_MAX_REQUESTS; i++) {
+		if (agent_requests[i].id != 0 && (!last ||
+					agent_requests[i].id - last->id <
+					UINT_MAX / 2))
+			last = &agent_requests[i];
+	}
 
-	if (agent_request.message)
-		next_request = &agent_request;
+	return last;
+}
 
-	if (!next_request)
-		return;
+static void request_free(struct agent_data *request)
+{
+	dbus_message_unref(request->message);
+	request->message = NULL;
+	request->id = 0;
+}
 
-	pending_message = next_request->message;
-	pending_function = next_request->pending_function;
-	next_request->pending_function = NULL;
+/*
+ * Send the answer to a request and forget the request.
+ * Return 0 on success, -ENOMEM if the reply couldn't be sent.
+ * @param reply the ownership is transferred, can be NULL
+ */
+static int request_reply(struct agent_data *request, DBusMessage *reply)
+{
+	int res = -ENOMEM;
 
-	pending_function(agent_connection, next_request->message,
-			next_request);
+	if (reply && dbus_send_message(agent_connection, reply))
+		res = 0;
 
-	dbus_message_unref(pending_message);
+	request_free(request);
+
+	return res;
 }
 
-static bool handle_message(DBusMessage *message, struct agent_data *request,
-		DBusMethodFunction function)
+/*
+ * Answer a request at once with an error (it couldn't be queued or has been
+ * canceled).
+ */
+static void reject_message(DBusMessage *message)
 {
-	if (!agent_request.pending_function)
-		return true;
+	DBusMessage *reply;
 
-	request->message = dbus_message_ref(message);
-	request->pending_function = function;
+	reply = dbus_message_new_error(message,
+			"net.connman.Agent.Error.Canceled", NULL);
 
-	return false;
+	if (reply)
+		dbus_send_message(agent_connection, reply);
 }
 
-static DBusMessage *agent_release(DBusConnection *connection,
-		DBusMessage *message, void *user_data)
+/*
+ * Keep a request and send the client the message formatted by the caller,
+ * with the id of the request. If there is no room left for the request, it's
+ * canceled and the client isn't notified.
+ * Return the id of the request, 0 if it was canceled.
+ */
+static unsigned int request_queue(DBusMessage *message)
 {
-	if (handle_message(message, &agent_request, agent_release) == false)
-		return NULL;
+	struct agent_data *request;
 
-	agent_unregister(connection, NULL);
+	request = request_new(message);
 
-	pending_message_remove(&agent_request);
+	if (!request) {
+		reject_message(message);
+		return 0;
+	}
+
+	return request->id;
+}
+
+/*
+ * Answer the requests waiting for an answer with an error and forget them.
+ */
+static void requests_cancel(void)
+{
+	int i;
 
-	pending_command_complete();
+	for (i = 0; i < AGENT_MAX_REQUESTS; i++) {
+		if (agent_requests[i].id != 0) {
+			reject_message(agent_requests[i].message);
+			request_free(&agent_requests[i]);
+		}
+	}
+}
+
+/*
+ * Return the number of requests waiting for an answer of the client.
+ */
+int agent_pending_requests(void)
+{
+	int i, count = 0;
+
+	for (i = 0; i < AGENT_MAX_REQUESTS; i++) {
+		if (agent_requests[i].id != 0)
+			count++;
+	}
+
+	return count;
+}
+
+static DBusMessage *agent_release(DBusConnection *connection,
+		DBusMessage *message, void *user_data)
+{
+	agent_unregister(connection, NULL);
 
 	return dbus_message_new_method_return(message);
 }
 
+/*
+ * Connman canceled its last request, the client is sent:
+ {
+	key_agent_msg: key_agent_request_canceled,
+	key_service: "",
+	key_agent_request_id: id of the request
+ }
+ */
 static DBusMessage *agent_cancel(DBusConnection *connection,
 		DBusMessage *message, void *user_data)
 {
+	struct agent_data *request;
 	struct json_object *res;
 
-	if (handle_message(message, &agent_request, agent_cancel) == false)
-		return NULL;
-
-	pending_message_remove(&agent_request);
+	request = request_last();
 
-	pending_command_complete();
+	if (!request)
+		return dbus_message_new_method_return(message);
 
-	res = format_agent_msg("Agent canceled", "", NULL);
-	agent_callback(res, &agent_request);
+	res = format_agent_msg(key_agent_request_canceled, "", request->id,
+			NULL);
+	request_free(request);
+	agent_callback(res);
 
 	return dbus_message_new_method_return(message);
 }
 
-void request_browser_return(struct json_object *connected,
-		struct agent_data *request)
+/*
+ * Answer an agent browser request.
+ * Return 0 on success, -ENOENT if the request isn't waiting for an answer,
+ * -ENOMEM if the answer couldn't be sent.
+ * @param id the id of the request
+ * @param connected json boolean
+ */
+int request_browser_return(unsigned int id, struct json_object *connected)
 {
-	if (json_object_get_boolean(connected) == TRUE)
-		request->reply = dbus_message_new_method_return(request->message);
+	struct agent_data *request = request_find(id);
 
-	else
-		request->reply = dbus_message_new_error(request->message,
-				"net.connman.Agent.Error.Canceled", NULL);
+	if (!request)
+		return -ENOENT;
 
-	if (request->reply)
-		dbus_connection_send(agent_connection, request->reply, NULL);
+	if (json_object_get_boolean(connected) == TRUE)
+		return request_reply(request,
+				dbus_message_new_method_return(request->message));
 
-	pending_message_remove(request);
-	pending_command_complete();
+	return request_reply(request, dbus_message_new_error(request->message,
+				"net.connman.Agent.Error.Canceled", NULL));
 }
 
 static DBusMessage *agent_request_browser(DBusConnection *connection,
@@ -255,8 +380,9 @@ static DBusMessage *agent_request_browser(DBusConnection *connection,
 	DBusMessageIter iter;
 	char *service, *url;
 	struct json_object *tmp;
+	unsigned int id;
 
-	if (handle_message(message, &agent_request, agent_request_browser) == false)
+	if ((id = request_queue(message)) == 0)
 		return NULL;
 
 	dbus_message_iter_init(message, &iter);
@@ -265,33 +391,61 @@ static DBusMessage *agent_request_browser(DBusConnection *connection,
 	dbus_message_iter_next(&iter);
 	dbus_message_iter_get_basic(&iter, &url);
 
-	tmp = format_agent_msg(key_agent_request_browser, service,
+	tmp = format_agent_msg(key_agent_request_browser, service, id,
 		json_object_new_string(url));
 	format_agent_with_callback(tmp, "Connected ?",
 		"request_browser_return");
 
-	agent_request.message = message;
-	agent_callback(tmp, &agent_request);
+	agent_callback(tmp);
 
 	return NULL;
 }
 
-void report_error_return(struct json_object *retry, struct agent_data *request)
+/*
+ * Answer an agent error report.
+ * Return 0 on success, -ENOENT if the request isn't waiting for an answer,
+ * -ENOMEM if the answer couldn't be sent.
+ * @param id the id of the request
+ * @param retry json boolean, true to ask connman to retry
+ */
+int report_error_return(unsigned int id, struct json_object *retry)
 {
-	if (!request || !retry)
-		return;
+	struct agent_data *request = request_find(id);
+
+	if (!request)
+		return -ENOENT;
 
 	if (json_object_get_boolean(retry) == TRUE)
-		request->reply = dbus_message_new_error(request->message,
-				"net.connman.Agent.Error.Retry", NULL);
-	else
-		request->reply = dbus_message_new_method_return(request->message);
+		return request_reply(request, dbus_message_new_error(
+					request->message,
+					"net.connman.Agent.Error.Retry", NULL));
+
+	return request_reply(request,
+			dbus_message_new_method_return(request->message));
+}
 
-	if (request->reply)
-		dbus_connection_send(agent_connection, request->reply, NULL);
+// Errors of connman caused by wrong credentials, see connman/doc/agent-api.txt.
+static const char *credentials_errors[] = {
+	"invalid-key",
+	"auth-failed",
+	"login-failed",
+	NULL,
+};
+
+/*
+ * Return true if the error reported by connman means the credentials given
+ * are wrong.
+ */
+static bool error_is_about_credentials(const char *error)
+{
+	int i;
 
-	pending_message_remove(request);
-	pending_command_complete();
+	for (i = 0; credentials_errors[i]; i++) {
+		if (strcmp(error, credentials_errors[i]) == 0)
+			return true;
+	}
+
+	return false;
 }
 
 static DBusMessage *agent_report_error(DBusConnection *connection,
@@ -300,8 +454,9 @@ static DBusMessage *agent_report_error(DBusConnection *connection,
 	DBusMessageIter iter;
 	char *path, *service, *error;
 	struct json_object *tmp;
+	unsigned int id;
 
-	if (handle_message(message, &agent_request, agent_report_error) == false)
+	if ((id = request_queue(message)) == 0)
 		return NULL;
 
 	dbus_message_iter_init(message, &iter);
@@ -312,39 +467,113 @@ static DBusMessage *agent_report_error(DBusConnection *connection,
 	dbus_message_iter_next(&iter);
 	dbus_message_iter_get_basic(&iter, &error);
 
-	tmp = format_agent_error(error, service);
+	// The user will be asked the next time, other errors (e.g.
+	// connect-failed) don't tell anything about the credentials
+	if (error_is_about_credentials(error))
+		credentials_forget(path);
+
+	tmp = format_agent_error(error, service, id);
 	format_agent_with_callback(tmp, "Retry ?", "report_error_return");
 	free(service);
 
-	agent_request.message = dbus_message_ref(message);
-	agent_callback(tmp, &agent_request);
+	agent_callback(tmp);
 
 	return NULL;
 }
 
+/*
+ * Build the answer to an input request.
+ * Return NULL if the fields can't be translated.
+ * @param jobj the fields requested, see jregex_agent_response
+ */
+static DBusMessage* input_reply(DBusMessage *message, struct json_object *jobj)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	int res;
+
+	reply = dbus_message_new_method_return(message);
+
+	if (!reply)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+                        DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                        DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
+                        DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+			&dict);
+
+	res = json_to_dbus_dict(jobj, &dict);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	if (res != 0) {
+		dbus_message_unref(reply);
+		return NULL;
+	}
+
+	return reply;
+}
+
+/*
+ * Answer an input request with the known credentials of the service.
+ * Return false if they aren't known, the user has to be asked.
+ */
+static bool answer_from_credentials(DBusMessage *message,
+		const char *serv_dbus_name, struct json_object *requested)
+{
+	struct json_object *answer;
+	DBusMessage *reply;
+
+	answer = credentials_answer(serv_dbus_name, requested);
+
+	if (!answer)
+		return false;
+
+	reply = input_reply(message, answer);
+	json_object_put(answer);
+
+	if (!reply)
+		return false;
+
+	dbus_send_message(agent_connection, reply);
+
+	return true;
+}
+
 static DBusMessage *agent_request_input(DBusConnection *connection,
 		DBusMessage *message, void *user_data)
 {
 	DBusMessageIter iter;
 	char *service, *str;
-	struct json_object *res;
-
-	if (handle_message(message, &agent_request, agent_request_input) == false)
-		return NULL;
+	struct json_object *res, *requested;
+	unsigned int id;
 
 	dbus_message_iter_init(message, &iter);
 
 	dbus_message_iter_get_basic(&iter, &str);
-	service = extract_dbus_short_name(str);
-
 	dbus_message_iter_next(&iter);
+	requested = dbus_to_json(&iter);
 
-	res = format_agent_msg(key_agent_request_input, service,
-			dbus_to_json(&iter));
+	if (answer_from_credentials(message, str, requested)) {
+		json_object_put(requested);
+		return NULL;
+	}
+
+	if ((id = request_queue(message)) == 0) {
+		json_object_put(requested);
+		return NULL;
+	}
+
+	service = extract_dbus_short_name(str);
+	res = format_agent_msg(key_agent_request_input, service, id,
+			requested);
 	free(service);
 
-	agent_request.message = message;
-        agent_callback(res, &agent_request);
+	agent_callback(res);
 
 	return NULL;
 }
@@ -354,9 +583,9 @@ static void agent_unregister_return(DBusMessageIter *iter,
 {
 	if (error)
 		agent_error_callback(format_agent_error(error, "Got error while"
-					" uneregistering agent."));
+					" uneregistering agent.", 0));
 	else
-		agent_request.registered = false;
+		agent_registered = false;
 }
 
 void agent_unregister(DBusConnection *connection, void *user_data)
@@ -365,9 +594,12 @@ void agent_unregister(DBusConnection *connection, void *user_data)
 	DBusMessage *msg;
 	DBusMessageIter iter;
 
-	if (agent_request.registered == false) {
+	// Nobody would answer them anymore
+	requests_cancel();
+
+	if (agent_registered == false) {
 		agent_error_callback(format_agent_error("Agent not"
-			" registered", ""));
+			" registered", "", 0));
 		return;
 	}
 
@@ -385,31 +617,84 @@ void agent_unregister(DBusConnection *connection, void *user_data)
 
 	if (res != -EINPROGRESS)
 		agent_error_callback(format_agent_error("Failed to unregister"
-			" Agent", ""));
+			" Agent", "", 0));
 
 
 	return;
 }
 
+// The methods of the agent, see connman/doc/agent-api.txt. A handler returns
+// the reply to send, or NULL if the request waits for an answer of the client
+// (it takes its own reference on the message then).
+static const struct {
+	const char *member;
+	const char *signature;
+	DBusMessage* (*handler)(DBusConnection *connection,
+			DBusMessage *message, void *user_data);
+} agent_methods[] = {
+	{ "Release", "", agent_release },
+	{ "ReportError", DBUS_TYPE_OBJECT_PATH_AS_STRING
+		DBUS_TYPE_STRING_AS_STRING, agent_report_error },
+	{ "RequestBrowser", DBUS_TYPE_OBJECT_PATH_AS_STRING
+		DBUS_TYPE_STRING_AS_STRING, agent_request_browser },
+	{ "RequestInput", DBUS_TYPE_OBJECT_PATH_AS_STRING
+		DBUS_TYPE_ARRAY_AS_STRING DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+		DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
+		DBUS_DICT_ENTRY_END_CHAR_AS_STRING, agent_request_input },
+	{ "Cancel", "", agent_cancel },
+	{ NULL, NULL, NULL },
+};
+
+/*
+ * Check the method table once: valid signatures and no member twice.
+ */
+static bool agent_methods_are_valid(void)
+{
+	int i, j;
+
+	for (i = 0; agent_methods[i].member; i++) {
+		if (!dbus_signature_validate(agent_methods[i].signature, NULL))
+			return false;
+
+		for (j = 0; j < i; j++) {
+			if (strcmp(agent_methods[i].member,
+						agent_methods[j].member) == 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Dispatch a method call to its handler, after checking the signature of its
+ * arguments. The message isn't referenced here, handlers keeping it take their
+ * own reference.
+ */
 static DBusHandlerResult message_handler(DBusConnection *conn, DBusMessage *msg,
 		void *user_data)
 {
-	const char *method = dbus_message_get_member(msg);
-	msg = dbus_message_ref(msg);
-
-	if (strcmp("Release", method) == 0)
-		agent_release(conn, msg, user_data);
-	else if (strcmp("ReportError", method) == 0)
-		agent_report_error(conn, msg, user_data);
-	else if (strcmp("RequestBrowser", method) == 0)
-		agent_request_browser(conn, msg, user_data);
-	else if (strcmp("RequestInput", method) == 0)
-		agent_request_input(conn, msg, user_data);
-	else if (strcmp("Cancel", method) == 0)
-		agent_cancel(conn, msg, user_data);
-	else
+	DBusMessage *reply;
+	int i;
+
+	for (i = 0; agent_methods[i].member; i++) {
+		if (dbus_message_is_method_call(msg, key_agent_interface,
+					agent_methods[i].member))
+			break;
+	}
+
+	if (!agent_methods[i].member)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
+	if (!dbus_message_has_signature(msg, agent_methods[i].signature))
+		reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
+				agent_methods[i].member);
+	else
+		reply = agent_methods[i].handler(conn, msg, user_data);
+
+	if (reply)
+		dbus_send_message(conn, reply);
+
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
@@ -425,10 +710,10 @@ static void agent_register_return(DBusMessageIter *iter,
 
 	if (error) {
 		agent_unregister(connection, NULL);
-		agent_error_callback(format_agent_error(error, ""));
+		agent_error_callback(format_agent_error(error, "", 0));
 
 	} else
-		agent_request.registered = true;
+		agent_registered = true;
 }
 
 int agent_register(DBusConnection *connection)
@@ -437,14 +722,18 @@ int agent_register(DBusConnection *connection)
 	DBusMessageIter iter;
 	int res;
 
-	if (agent_request.registered == true) {
+	if (agent_registered == true) {
 		agent_error_callback(format_agent_error("Agent already"
-			" registered", ""));
+			" registered", "", 0));
 		return -EALREADY;
 	}
 
-	if (!dbus_connection_register_object_path(connection, agent_path(),
-				&agent_table, NULL))
+	if (!agent_methods_are_valid())
+		return -EINVAL;
+
+	// Without a bus the method calls come from agent_dispatch()
+	if (connection && !dbus_connection_register_object_path(connection,
+				agent_path(), &agent_table, NULL))
 		return -ENOMEM;
 
 	msg = dbus_message_new_method_call(key_connman_service, key_connman_path,
@@ -462,46 +751,57 @@ int agent_register(DBusConnection *connection)
 	if (res != -EINPROGRESS) {
 		agent_unregister(connection, NULL);
 		agent_error_callback(format_agent_error("Failed to register"
-			" Agent", ""));
+			" Agent", "", 0));
 	} else
-		agent_request.registered = true;
+		agent_registered = true;
 
 	agent_connection = connection;
 
 	return res;
 }
 
+/*
+ * Dispatch a method call to the agent without a bus, e.g. from a trace
+ * replayed (see __cmd_replay()). Its reply is dropped, see dbus_set_offline().
+ */
+void agent_dispatch(DBusMessage *message)
+{
+	if (agent_registered)
+		message_handler(agent_connection, message, NULL);
+}
+
 /*
  * Called with the result of an agent input request. This reply to the request
  * after json object to dbus message translation.
+ * Return 0 on success, -ENOENT if the request isn't waiting for an answer,
+ * -EINVAL if the fields can't be translated, -ENOMEM if the answer couldn't be
+ * sent.
+ * @param id the id of the request
+ * @param jobj the fields requested, see jregex_agent_response
  */
-int json_to_agent_response(struct json_object *jobj,
-		struct agent_data *request)
+int json_to_agent_response(unsigned int id, struct json_object *jobj)
 {
+	struct agent_data *request = request_find(id);
+	DBusMessage *reply;
 	DBusMessageIter iter;
-	DBusMessageIter dict;
-	int res = 0;
+	const char *serv_dbus_name;
 
-	request->reply = dbus_message_new_method_return(request->message);
-	dbus_message_iter_init_append(request->reply, &iter);
+	if (!request)
+		return -ENOENT;
 
-	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
-                        DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
-                        DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
-                        DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
-			&dict);
+	reply = input_reply(request->message, jobj);
 
-	res = json_to_dbus_dict(jobj, &dict);
-
-	dbus_message_iter_close_container(&iter, &dict);
-
-	if (res == 0) {
-		res = dbus_send_message(agent_connection, request->reply);
-		request->reply = NULL;
+	if (!reply) {
+		request_reply(request, dbus_message_new_error(request->message,
+					"net.connman.Agent.Error.Canceled",
+					NULL));
+		return -EINVAL;
 	}
 
-	pending_message_remove(request);
-	pending_command_complete();
+	// Remember the answer of the user for the next connections, if allowed
+	dbus_message_iter_init(request->message, &iter);
+	dbus_message_iter_get_basic(&iter, &serv_dbus_name);
+	credentials_learn(serv_dbus_name, jobj);
 
-	return res;
+	return request_reply(request, reply);
 }
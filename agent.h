@@ -26,31 +26,28 @@
 
 #include "dbus_helpers.h"
 
+// Maximum number of agent requests waiting for an answer, the next ones are
+// canceled.
+#define AGENT_MAX_REQUESTS 8
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-struct agent_data {
-	char *interface;
-	bool registered;
-	DBusMessage *message;
-	DBusMessage *reply;
-	DBusMethodFunction pending_function;
-};
-
-struct agent_data;
-
-extern void (*agent_callback)(struct json_object *data, struct agent_data *request);
+extern void (*agent_callback)(struct json_object *data);
 extern void (*agent_error_callback)(struct json_object *data);
 
 int agent_register(DBusConnection *connection);
 
 void agent_unregister(DBusConnection *connection, void *user_data);
 
-void report_error_return(struct json_object *retry, struct agent_data *request);
+void agent_dispatch(DBusMessage *message);
+
+int agent_pending_requests(void);
+
+int report_error_return(unsigned int id, struct json_object *retry);
 
-int json_to_agent_response(struct json_object *jobj,
-		struct agent_data *request);
+int json_to_agent_response(unsigned int id, struct json_object *jobj);
 
 #ifdef __cplusplus
 }
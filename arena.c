@@ -0,0 +1,149 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "arena.h"
+
+/*
+ * This file implements the per-view arenas of the renderers: the strings and
+ * records of a view are carved out of large chunks and released together.
+ * A reset keeps the first chunk, so a view refreshed with the same amount of
+ * data doesn't call malloc for them anymore.
+ */
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;	// of data
+	size_t used;
+	char data[];
+};
+
+// Alignment of the allocations.
+#define ARENA_ALIGN (sizeof(void *) > sizeof(double) ? sizeof(void *) : \
+		sizeof(double))
+
+static struct arena_chunk* new_chunk(struct arena *arena, size_t min_size)
+{
+	struct arena_chunk *chunk;
+	size_t size = arena->chunk_size;
+
+	if (size < min_size)
+		size = min_size;
+
+	chunk = malloc(sizeof(struct arena_chunk) + size);
+	assert(chunk != NULL);
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->nb_chunks++;
+
+	return chunk;
+}
+
+/*
+ * Allocate size bytes in the arena, the memory is valid until the next
+ * arena_reset() or arena_release().
+ */
+void* arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_chunk *chunk = arena->chunks;
+	void *res;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (!chunk || chunk->size - chunk->used < size)
+		chunk = new_chunk(arena, size);
+
+	res = chunk->data + chunk->used;
+	chunk->used += size;
+	arena->nb_allocs++;
+
+	return res;
+}
+
+/*
+ * Copy a string in the arena, NULL gives NULL.
+ */
+char* arena_strdup(struct arena *arena, const char *str)
+{
+	size_t len;
+	char *res;
+
+	if (!str)
+		return NULL;
+
+	len = strlen(str) + 1;
+	res = arena_alloc(arena, len);
+	memcpy(res, str, len);
+
+	return res;
+}
+
+/*
+ * Drop every allocation and give the memory back.
+ */
+void arena_release(struct arena *arena)
+{
+	struct arena_chunk *chunk, *next;
+
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	arena->chunks = NULL;
+	arena->nb_allocs = 0;
+	arena->nb_chunks = 0;
+}
+
+/*
+ * Drop every allocation. A single chunk is kept for the next use; if the
+ * allocations needed several chunks, they are all freed and the next chunk
+ * will be big enough for all of them.
+ */
+void arena_reset(struct arena *arena)
+{
+	struct arena_chunk *chunk = arena->chunks;
+	size_t total = 0;
+
+	if (chunk && chunk->next) {
+		for (; chunk; chunk = chunk->next)
+			total += chunk->size;
+
+		arena_release(arena);
+		arena->chunk_size = total;
+		return;
+	}
+
+	if (chunk)
+		chunk->used = 0;
+
+	arena->nb_allocs = 0;
+	arena->nb_chunks = 0;
+}
@@ -0,0 +1,59 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_ARENA_H
+#define __CONNMAN_ARENA_H
+
+#include <stddef.h>
+
+// Default size of an arena chunk, enough for a view of a few dozen items.
+#define ARENA_DEFAULT_CHUNK_SIZE 8192
+
+struct arena_chunk;
+
+// A bump allocator: every allocation lives until arena_reset().
+struct arena {
+	struct arena_chunk *chunks;	// the current chunk first
+	size_t chunk_size;
+	unsigned int nb_allocs;		// served since the last reset
+	unsigned int nb_chunks;		// chunks malloc'ed since the last reset
+};
+
+// Static initializer, the first chunk is allocated on the first use.
+#define ARENA_INIT(size) { NULL, (size), 0, 0 }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void* arena_alloc(struct arena *arena, size_t size);
+
+char* arena_strdup(struct arena *arena, const char *str);
+
+void arena_reset(struct arena *arena);
+
+void arena_release(struct arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <json.h>
+
+#include "engine.h"
+#include "commands.h"
+#include "loop.h"
+#include "coalesce.h"
+#include "keys.h"
+#include "stats.h"
+#include "player.h"
+
+/*
+ * Benchmark of the engine: a trace of connman messages (see trace.c, e.g.
+ * written by connman_mock -a offline -w) is replayed into the engine without
+ * a bus, as fast as possible, through the paths the bus would take (see
+ * __cmd_replay()). The client played (see player.c) serializes what the
+ * engine sends as the headless daemon does (a json string), queries the wifi
+ * services on every change notification, watches the first ones (the rows of
+ * a screen) and answers the agent requests.
+ * The time and the allocations of each stage (see enum stats_stage) are
+ * reported, with the peak RSS.
+ */
+
+// Calls to malloc(), calloc() and realloc().
+static uint64_t nb_allocations;
+
+// Is the trace over ? Is the engine initialized ?
+static bool replay_over, initialized;
+
+// Status of the replay, see commands_replay_end.
+static int replay_status;
+
+// What the engine sent.
+static uint64_t nb_replies, nb_changes, nb_agent_requests, nb_errors;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+/*
+ * The allocator of the C library, counted (glibc lets a program replace it).
+ */
+void* malloc(size_t size)
+{
+	nb_allocations++;
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+	nb_allocations++;
+	return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void *ptr, size_t size)
+{
+	nb_allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+static uint64_t allocations(void)
+{
+	return nb_allocations;
+}
+
+/*
+ * Serialize what the engine sent, then act as a client would.
+ */
+static void bench_callback(int status, struct json_object *jobj)
+{
+	struct json_object *cmd;
+
+	stats_stage_begin(STATS_STAGE_SERIALIZE);
+	json_object_to_json_string(jobj);
+	stats_stage_end(STATS_STAGE_SERIALIZE);
+
+	if (status < 0)
+		nb_errors++;
+
+	if (json_object_object_get_ex(jobj, key_changes, NULL)) {
+		nb_changes++;
+		player_query_services();
+
+	} else if (json_object_object_get_ex(jobj, key_agent_msg, NULL)) {
+		nb_agent_requests++;
+		player_answer_agent(jobj, "benchmark");
+
+	} else {
+		nb_replies++;
+
+		if (json_object_object_get_ex(jobj, key_command, &cmd) &&
+				strcmp(json_object_get_string(cmd),
+					key_engine_get_services_from_tech) == 0)
+			player_watch_rows(jobj);
+	}
+
+	json_object_put(jobj);
+}
+
+static void replay_end(int status)
+{
+	replay_status = status;
+	replay_over = true;
+	coalesce_flush();
+}
+
+/*
+ * Loop idle function: stop the loop once the trace is over, the engine sends
+ * its last changes on this iteration. The trace has to answer the calls of
+ * engine_init().
+ */
+static int bench_idle(void)
+{
+	if (replay_over && !initialized) {
+		fprintf(stderr, "[-] The trace doesn't have the replies "
+				"engine_init() waits for\n");
+		exit(1);
+	}
+
+	if (replay_over)
+		loop_quit();
+
+	return replay_over ? 0 : -1;
+}
+
+static void print_stage(struct json_object *stages, const char *name)
+{
+	struct json_object *stage, *tmp;
+	int64_t count, total_ns, max_ns, allocs;
+
+	json_object_object_get_ex(stages, name, &stage);
+	json_object_object_get_ex(stage, "count", &tmp);
+	count = json_object_get_int64(tmp);
+	json_object_object_get_ex(stage, "total_ns", &tmp);
+	total_ns = json_object_get_int64(tmp);
+	json_object_object_get_ex(stage, "max_ns", &tmp);
+	max_ns = json_object_get_int64(tmp);
+	json_object_object_get_ex(stage, "allocations", &tmp);
+	allocs = json_object_get_int64(tmp);
+
+	printf("\t%-9s %8lld calls, %9.3f ms, %8.3f us/call (max %.3f us), "
+			"%.1f allocations/call\n", name, (long long) count,
+			total_ns / 1e6, count ? total_ns / 1e3 / count : 0,
+			max_ns / 1e3, count ? (double) allocs / count : 0);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-c milliseconds] [-j] trace\n"
+			"  -c  window coalescing PropertyChanged signals "
+			"(default %d, 0: per loop iteration)\n"
+			"  -j  print the results in json\n",
+			prog, COALESCE_DEFAULT_WINDOW_MS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct json_object *jstats, *stages, *res;
+	struct rusage usage_self;
+	uint64_t start, elapsed_us;
+	bool print_json = false;
+	char *end;
+	long window;
+	int opt, err;
+
+	while ((opt = getopt(argc, argv, "c:jh")) != -1) {
+		switch (opt) {
+			case 'c':
+				window = strtol(optarg, &end, 10);
+
+				if (*end != '\0' || end == optarg || window < 0) {
+					usage(argv[0]);
+					exit(1);
+				}
+
+				coalesce_set_window(window);
+				break;
+
+			case 'j':
+				print_json = true;
+				break;
+
+			default:
+				usage(argv[0]);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	engine_callback = bench_callback;
+	commands_replay_end = replay_end;
+	stats_allocations = allocations;
+	engine_set_bus("offline");
+
+	if ((err = __cmd_replay(argv[optind], 0)) < 0) {
+		fprintf(stderr, "[-] %s: %s\n", argv[optind], strerror(-err));
+		exit(1);
+	}
+
+	stats_enable(true);
+	start = stats_now_us();
+	loop_add_idle(bench_idle);
+
+	// The startup replies of the trace are consumed here
+	if (engine_init() < 0)
+		exit(1);
+
+	initialized = true;
+	player_query_services();
+	loop_run(false);
+	elapsed_us = stats_now_us() - start;
+	jstats = stats_to_json();
+	engine_terminate();
+	loop_terminate();
+
+	if (replay_status < 0)
+		fprintf(stderr, "[-] %s: %s\n", argv[optind],
+				strerror(-replay_status));
+
+	getrusage(RUSAGE_SELF, &usage_self);
+	json_object_object_get_ex(jstats, "stages", &stages);
+
+	if (print_json) {
+		res = json_object_new_object();
+		json_object_object_add(res, "trace",
+				json_object_new_string(argv[optind]));
+		json_object_object_add(res, "elapsed_us",
+				json_object_new_int64(elapsed_us));
+		json_object_object_add(res, "allocations",
+				json_object_new_int64(nb_allocations));
+		json_object_object_add(res, "peak_rss_kb",
+				json_object_new_int64(usage_self.ru_maxrss));
+		json_object_object_add(res, "stages", json_object_get(stages));
+		printf("%s\n", json_object_to_json_string(res));
+		json_object_put(res);
+
+	} else {
+		printf("[*] %s: %.3f ms, %llu replies, %llu change "
+				"notifications, %llu agent requests, %llu "
+				"errors\n", argv[optind], elapsed_us / 1e3,
+				(unsigned long long) nb_replies,
+				(unsigned long long) nb_changes,
+				(unsigned long long) nb_agent_requests,
+				(unsigned long long) nb_errors);
+		print_stage(stages, "decode");
+		print_stage(stages, "apply");
+		print_stage(stages, "validate");
+		print_stage(stages, "serialize");
+		printf("\t%llu allocations, peak RSS %ld kB\n",
+				(unsigned long long) nb_allocations,
+				usage_self.ru_maxrss);
+	}
+
+	json_object_put(jstats);
+
+	return replay_status < 0 ? 1 : 0;
+}
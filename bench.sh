@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Benchmark the engine on the standard traces:
+#	./bench.sh [connman_bench options]
+# The traces are written by connman_mock without a bus (-a offline) in
+# $BENCH_DIR (/tmp/connman_bench by default), then replayed by connman_bench,
+# e.g. "./bench.sh -j" prints one json object per trace.
+
+DIR=$(dirname "$0")
+BENCH_DIR=${BENCH_DIR:-/tmp/connman_bench}
+
+# name: connman_mock options
+TRACES=(
+	"strength: -n 200 -r 1000 -N 5000 -k strength"
+	"services: -n 200 -r 1000 -N 2000 -k services"
+	"state: -n 200 -r 1000 -N 5000 -k state"
+	"mixed: -n 200 -r 1000 -N 5000 -k mixed"
+)
+
+mkdir -p "$BENCH_DIR" || exit 1
+
+for trace in "${TRACES[@]}"; do
+	name=${trace%%:*}
+	file="$BENCH_DIR/$name.trace"
+
+	if [ ! -f "$file" ]; then
+		"$DIR/connman_mock" -a offline -s 1 -w "$file" ${trace#*:} \
+			>/dev/null || exit 1
+	fi
+
+	"$DIR/connman_bench" "$@" "$file" || exit 1
+done
@@ -0,0 +1,203 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <json.h>
+
+#include "keys.h"
+#include "stats.h"
+
+#include "coalesce.h"
+
+/*
+ * This file sits between the dbus signals (commands_signal) and the engine.
+ * PropertyChanged signals are kept in a pending set keyed by
+ * "interface/path/property": a newer signal replaces the older one, so
+ * consumers see at most one update per property per window. Other signals,
+ * and State changes, are delivered at once, after the pending set, to keep the
+ * ordering.
+ */
+
+// Where the signals are delivered.
+void (*coalesce_deliver)(struct json_object *sig) = NULL;
+
+// Coalescing window in microseconds, 0 flushes on every loop iteration.
+static uint64_t window_us = COALESCE_DEFAULT_WINDOW_MS * 1000;
+
+// Pending signals, in order of first arrival.
+static struct json_object *pending = NULL;
+
+// Number of pending signals.
+static int nb_pending;
+
+// When the pending set has to be flushed, 0 if it's empty.
+static uint64_t deadline_us;
+
+/*
+ * @param window_ms the coalescing window in milliseconds, 0 to only coalesce
+ *	signals dispatched in the same loop iteration
+ */
+void coalesce_set_window(unsigned int window_ms)
+{
+	window_us = (uint64_t) window_ms * 1000;
+}
+
+static void deliver(struct json_object *sig)
+{
+	stats_signal_delivered();
+	coalesce_deliver(sig);
+}
+
+/*
+ * Deliver every pending signal and empty the pending set.
+ */
+void coalesce_flush(void)
+{
+	struct json_object *to_deliver;
+
+	if (nb_pending == 0)
+		return;
+
+	// Delivering may push new signals (nested loop), start a new set
+	to_deliver = pending;
+	pending = NULL;
+	nb_pending = 0;
+	deadline_us = 0;
+
+	json_object_object_foreach(to_deliver, key, val) {
+		(void) key;
+		deliver(json_object_get(val));
+	}
+
+	json_object_put(to_deliver);
+}
+
+/*
+ * Build the coalescing key of a signal: "interface/path/property".
+ * Return the key, to be freed, NULL if the signal can't be coalesced. State
+ * changes are never coalesced: they must be seen at once.
+ */
+static char* signal_key(struct json_object *sig)
+{
+	struct json_object *interface, *path, *name, *data;
+	const char *property, *interface_str, *path_str;
+	size_t size;
+	char *key;
+
+	json_object_object_get_ex(sig, key_signal, &name);
+
+	if (!name || strcmp(json_object_get_string(name),
+				key_sig_prop_changed) != 0)
+		return NULL;
+
+	json_object_object_get_ex(sig, key_command_interface, &interface);
+	json_object_object_get_ex(sig, key_command_path, &path);
+	json_object_object_get_ex(sig, key_command_data, &data);
+
+	if (!data || json_object_get_type(data) != json_type_array)
+		return NULL;
+
+	property = json_object_get_string(json_object_array_get_idx(data, 0));
+
+	if (!property || strcmp(property, key_serv_state) == 0)
+		return NULL;
+
+	interface_str = interface ? json_object_get_string(interface) : "";
+	path_str = path ? json_object_get_string(path) : "";
+
+	// Sized from the strings: a truncated key could merge two signals
+	size = strlen(interface_str) + strlen(path_str) + strlen(property) + 3;
+	key = malloc(size);
+	assert(key != NULL);
+	snprintf(key, size, "%s/%s/%s", interface_str, path_str, property);
+
+	return key;
+}
+
+/*
+ * Entry point of the signals, replaces commands_signal.
+ * @param sig the signal, see monitor_changed in commands.c. The ownership is
+ *	transferred.
+ */
+void coalesce_push(struct json_object *sig)
+{
+	char *key = signal_key(sig);
+
+	if (!key) {
+		coalesce_flush();
+		deliver(sig);
+		return;
+	}
+
+	if (!pending)
+		pending = json_object_new_object();
+
+	if (!json_object_object_get_ex(pending, key, NULL)) {
+		nb_pending++;
+
+		if (deadline_us == 0)
+			deadline_us = stats_now_us() + window_us;
+	}
+
+	// Replaces the older value in place, and drops it
+	json_object_object_add(pending, key, sig);
+	free(key);
+}
+
+/*
+ * Drop the pending signals.
+ */
+void coalesce_terminate(void)
+{
+	json_object_put(pending);
+	pending = NULL;
+	nb_pending = 0;
+	deadline_us = 0;
+}
+
+/*
+ * Loop idle function: flush the pending set when the window is over.
+ * Return the delay in milliseconds before the next flush, -1 if none.
+ */
+int coalesce_idle(void)
+{
+	uint64_t now;
+
+	if (nb_pending == 0)
+		return -1;
+
+	now = stats_now_us();
+
+	if (now >= deadline_us) {
+		coalesce_flush();
+		return -1;
+	}
+
+	// Round up, we don't want to wake up before the deadline
+	return (int) ((deadline_us - now + 999) / 1000);
+}
@@ -0,0 +1,50 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_COALESCE_H
+#define __CONNMAN_COALESCE_H
+
+#include <json.h>
+
+// Default coalescing window in milliseconds, see coalesce_set_window().
+#define COALESCE_DEFAULT_WINDOW_MS 200
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void (*coalesce_deliver)(struct json_object *sig);
+
+void coalesce_set_window(unsigned int window_ms);
+
+void coalesce_push(struct json_object *sig);
+
+void coalesce_flush(void);
+
+int coalesce_idle(void);
+
+void coalesce_terminate(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
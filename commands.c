@@ -38,6 +38,9 @@
 #include "engine.h"
 #include "keys.h"
 #include "string_utils.h"
+#include "stats.h"
+#include "loop.h"
+#include "trace.h"
 
 #include "commands.h"
 
@@ -55,24 +58,50 @@ void (*commands_callback)(struct json_object *data, json_bool is_error) = NULL;
 extern void (*commands_signal)(struct json_object *data);
 void (*commands_signal)(struct json_object *data) = NULL;
 
+// Callback called when the replay of a trace is over, see __cmd_replay().
+extern void (*commands_replay_end)(int status);
+void (*commands_replay_end)(int status) = NULL;
+
+// Request id of the method calls sent, see __cmd_set_request_id().
+static unsigned int request_id;
+
+// What a method call carries until its reply.
+struct call_data {
+	unsigned int request_id;
+	char *user_data;	// see return_list(), can be NULL
+};
+
+/*
+ * Set the request id of the method calls sent from now on, their callback
+ * carries it (key_request_id).
+ * @param id the request id, 0 for none
+ */
+void __cmd_set_request_id(unsigned int id)
+{
+	request_id = id;
+}
+
 /*
- * Get called when a connman dbus method return. This function format parameters
- * and "forward" the callback to commands_callback.
+ * Format the return of a connman dbus method and "forward" it to
+ * commands_callback.
  *
  * Format of the callback:
  *	- error: { key_error: [ "error string" ] }
  *	- success: { key_command: "command string", ... }
  *	- with user data: { ... , key_return_force_refresh: "user data string" }
+ *	- with a request id: { ... , key_request_id: id }
  *
- * Note: setting user data will force refresh in context CONTEXT_SERVICES.
+ * Note: clients recognize the return of their command by its request id, see
+ * engine_query().
  *
  * @param iter answer to the command
  * @param error if an error occured, this will be filled with the appropriate
  *		error message
  * @param user_data data passed by the user while calling the method
+ * @param id the request id of the method call, 0 if none
  */
-static void call_return_list(DBusMessageIter *iter, const char *error,
-		void *user_data)
+static void return_list(DBusMessageIter *iter, const char *error,
+		const char *user_data, unsigned int id)
 {
 	struct json_object *res, *array;
 	json_bool jerror;
@@ -95,26 +124,71 @@ static void call_return_list(DBusMessageIter *iter, const char *error,
 
 	if (user_data)
 		json_object_object_add(res, key_return_force_refresh,
-			json_object_new_string((const char*)user_data));
+			json_object_new_string(user_data));
+
+	if (id)
+		json_object_object_add(res, key_request_id,
+				json_object_new_int(id));
 
 	commands_callback(res, jerror);
 }
 
 /*
- * Invoke call_return_list then free user_data.
+ * Report an error found before sending a method call, the callback carries the
+ * current request id.
  */
-static void call_return_list_free(DBusMessageIter *iter,
-		const char *error, void *user_data)
+static void call_return_list(DBusMessageIter *iter, const char *error,
+		const char *user_data)
 {
-	char *dbus_short_name = extract_dbus_short_name(user_data);
+	return_list(iter, error, user_data, request_id);
+}
 
-	call_return_list(iter, error, dbus_short_name);
+/*
+ * Capture the current request id for a method call.
+ * @param user_data see return_list(), freed with the call data. Can be NULL.
+ */
+static struct call_data* call_data_new(char *user_data)
+{
+	struct call_data *data = malloc(sizeof(struct call_data));
 
-	if (user_data)
-		free(user_data);
+	assert(data != NULL);
+	data->request_id = request_id;
+	data->user_data = user_data;
+
+	return data;
+}
+
+static void call_data_free(struct call_data *data)
+{
+	free(data->user_data);
+	free(data);
+}
+
+/*
+ * Called when a connman dbus method returns: forward the return then free the
+ * call data.
+ * @param user_data the call data, see call_data_new()
+ */
+static void call_return_pending(DBusMessageIter *iter, const char *error,
+		void *user_data)
+{
+	struct call_data *data = user_data;
+
+	return_list(iter, error, data->user_data, data->request_id);
+	call_data_free(data);
+}
 
-	if (dbus_short_name)
-		free(dbus_short_name);
+/*
+ * Free the call data of a method call which wasn't sent: its callback will
+ * never be called.
+ * @param res the return of the dbus_*() function sending the method call
+ */
+static int call_sent(int res, struct call_data *data)
+{
+	if (res != -EINPROGRESS)
+		call_data_free(data);
+
+	return res;
 }
 
 /*
@@ -122,9 +196,11 @@ static void call_return_list_free(DBusMessageIter *iter,
  */
 int __cmd_state(void)
 {
-	return dbus_method_call(connection, key_connman_service,
+	struct call_data *data = call_data_new(NULL);
+
+	return call_sent(dbus_method_call(connection, key_connman_service,
 			key_connman_path, key_manager_interface, "GetProperties",
-			call_return_list, NULL, NULL, NULL);
+			call_return_pending, data, NULL, NULL), data);
 }
 
 /*
@@ -132,9 +208,11 @@ int __cmd_state(void)
  */
 int __cmd_services(void)
 {
-	return dbus_method_call(connection, key_connman_service,
+	struct call_data *data = call_data_new(NULL);
+
+	return call_sent(dbus_method_call(connection, key_connman_service,
 			key_connman_path, key_manager_interface, "GetServices",
-			call_return_list, NULL, NULL, NULL);
+			call_return_pending, data, NULL, NULL), data);
 }
 
 /*
@@ -142,9 +220,12 @@ int __cmd_services(void)
  */
 int __cmd_technologies(void)
 {
-	return dbus_method_call(connection, key_connman_service,
-			key_connman_path, key_manager_interface, "GetTechnologies",
-			call_return_list, NULL,	NULL, NULL);
+	struct call_data *data = call_data_new(NULL);
+
+	return call_sent(dbus_method_call(connection, key_connman_service,
+			key_connman_path, key_manager_interface,
+			"GetTechnologies", call_return_pending, data, NULL,
+			NULL), data);
 }
 
 /*
@@ -155,10 +236,11 @@ int __cmd_technologies(void)
  */
 int __cmd_connect(const char *serv_dbus_name)
 {
-	return dbus_method_call(connection, key_connman_service,
+	struct call_data *data = call_data_new(strdup(key_connect_return));
+
+	return call_sent(dbus_method_call(connection, key_connman_service,
 			serv_dbus_name, key_service_interface, "Connect",
-			call_return_list_free, strdup(key_connect_return), NULL,
-			NULL);
+			call_return_pending, data, NULL, NULL), data);
 }
 
 /*
@@ -167,9 +249,11 @@ int __cmd_connect(const char *serv_dbus_name)
  */
 int __cmd_disconnect(const char *serv_dbus_name)
 {
-	return dbus_method_call(connection, key_connman_service,
+	struct call_data *data = call_data_new(NULL);
+
+	return call_sent(dbus_method_call(connection, key_connman_service,
 			serv_dbus_name, key_service_interface, "Disconnect",
-			call_return_list, NULL, NULL, NULL);
+			call_return_pending, data, NULL, NULL), data);
 }
 
 /*
@@ -179,9 +263,11 @@ int __cmd_disconnect(const char *serv_dbus_name)
  */
 int __cmd_scan(const char *tech_dbus_name)
 {
-	return dbus_method_call(connection, key_connman_service,
+	struct call_data *data = call_data_new(strdup(key_scan_return));
+
+	return call_sent(dbus_method_call(connection, key_connman_service,
 			tech_dbus_name, key_technology_interface, "Scan",
-			call_return_list_free, strdup(key_scan_return), NULL, NULL);
+			call_return_pending, data, NULL, NULL), data);
 }
 
 /*
@@ -191,14 +277,15 @@ int __cmd_scan(const char *tech_dbus_name)
  */
 int __cmd_toggle_tech_power(const char *tech_dbus_name, bool set_power_to)
 {
+	struct call_data *data;
 	dbus_bool_t dbus_bool;
 
 	dbus_bool = set_power_to ? TRUE : FALSE;
+	data = call_data_new(extract_dbus_short_name(tech_dbus_name));
 
-	return dbus_set_property(connection, tech_dbus_name,
-			"net.connman.Technology", call_return_list_free,
-			strdup(tech_dbus_name), "Powered",
-			DBUS_TYPE_BOOLEAN, &dbus_bool);
+	return call_sent(dbus_set_property(connection, tech_dbus_name,
+			"net.connman.Technology", call_return_pending, data,
+			"Powered", DBUS_TYPE_BOOLEAN, &dbus_bool), data);
 }
 
 /*
@@ -207,13 +294,15 @@ int __cmd_toggle_tech_power(const char *tech_dbus_name, bool set_power_to)
  */
 int __cmd_toggle_offline_mode(bool set_offline_to)
 {
+	struct call_data *data;
 	dbus_bool_t dbus_bool;
 
 	dbus_bool = set_offline_to ? TRUE : FALSE;
+	data = call_data_new(NULL);
 
-	return dbus_set_property(connection, "/",
-			"net.connman.Manager", call_return_list, NULL,
-			"OfflineMode", DBUS_TYPE_BOOLEAN, &dbus_bool);
+	return call_sent(dbus_set_property(connection, "/",
+			"net.connman.Manager", call_return_pending, data,
+			"OfflineMode", DBUS_TYPE_BOOLEAN, &dbus_bool), data);
 }
 
 /*
@@ -222,9 +311,11 @@ int __cmd_toggle_offline_mode(bool set_offline_to)
  */
 int __cmd_remove(const char *serv_dbus_name)
 {
-	return dbus_method_call(connection, key_connman_service,
+	struct call_data *data = call_data_new(NULL);
+
+	return call_sent(dbus_method_call(connection, key_connman_service,
 			serv_dbus_name, key_service_interface, "Remove",
-			call_return_list, NULL, NULL, NULL);
+			call_return_pending, data, NULL, NULL), data);
 }
 
 /*
@@ -437,9 +528,10 @@ int __cmd_config_service(struct json_object *service,
 		struct json_object *options)
 {
 	int res = 0;
-	char *simple_service_conf, *dyn_service_name;
+	char *simple_service_conf, *serv_short_name, error[256];
 	dbus_bool_t dbus_bool;
 	struct json_object *tmp, *serv_dict;
+	struct call_data *data;
 	const char *service_dbus_name;
 
 	tmp = json_object_array_get_idx(service, 0);
@@ -460,9 +552,14 @@ int __cmd_config_service(struct json_object *service,
 		return -EINVAL;
 	}
 
+	serv_short_name = extract_dbus_short_name(service_dbus_name);
+
 	json_object_object_foreach(options, key, val) {
 		simple_service_conf = NULL;
-		dyn_service_name = extract_dbus_short_name(service_dbus_name);
+
+		// Every method call gets its own copy, freed on return
+		data = call_data_new(serv_short_name ? strdup(serv_short_name) :
+				NULL);
 
 		if (strcmp(key_serv_ipv4_config, key) == 0) {
 			json_object_object_get_ex(serv_dict, key_serv_ipv4, &tmp);
@@ -471,7 +568,7 @@ int __cmd_config_service(struct json_object *service,
 
 			res = dbus_set_property_dict(connection,
 					service_dbus_name, key_service_interface,
-					call_return_list_free, dyn_service_name,
+					call_return_pending, data,
 					key_serv_ipv4_config, DBUS_TYPE_STRING,
 					config_append_ipv4, val);
 
@@ -482,7 +579,7 @@ int __cmd_config_service(struct json_object *service,
 
 			res = dbus_set_property_dict(connection,
 					service_dbus_name, key_service_interface,
-					call_return_list_free, dyn_service_name,
+					call_return_pending, data,
 					key_serv_ipv6_config, DBUS_TYPE_STRING,
 					config_append_ipv6, val);
 
@@ -493,7 +590,7 @@ int __cmd_config_service(struct json_object *service,
 
 			res = dbus_set_property_dict(connection,
 					service_dbus_name, key_service_interface,
-					call_return_list_free, dyn_service_name,
+					call_return_pending, data,
 					key_serv_proxy_config, DBUS_TYPE_STRING,
 					config_append_proxy, val);
 
@@ -505,8 +602,8 @@ int __cmd_config_service(struct json_object *service,
 				dbus_bool = FALSE;
 
 			res = dbus_set_property(connection, service_dbus_name,
-					key_service_interface, call_return_list_free,
-					dyn_service_name, key_serv_autoconnect,
+					key_service_interface, call_return_pending,
+					data, key_serv_autoconnect,
 					DBUS_TYPE_BOOLEAN, &dbus_bool);
 
 		} else if (strcmp(key_serv_domains_config, key) == 0)
@@ -518,29 +615,86 @@ int __cmd_config_service(struct json_object *service,
 		else if (strcmp(key_serv_timeservers_config, key) == 0)
 			simple_service_conf = key;
 		else {
-			char *str = strndup(key, JSON_COMMANDS_STRING_SIZE_SMALL);
-			call_return_list_free(NULL, "Unknown configuration key", str);
+			snprintf(error, sizeof(error),
+					"Unknown configuration key: %s", key);
+			call_return_list(NULL, error, NULL);
 			res = -EINVAL;
 		}
 
 		if (simple_service_conf != NULL) {
 			res = dbus_set_property_array(connection,
 					service_dbus_name, key_service_interface,
-					call_return_list_free,
-					dyn_service_name,
+					call_return_pending, data,
 					simple_service_conf, DBUS_TYPE_STRING,
 					config_append_json_array_of_strings, val);
 		}
 
+		call_sent(res, data);
 		simple_service_conf = NULL;
 
 		if (res < 0 && res != -EINPROGRESS)
-			return res;
+			break;
 	}
 
+	free(serv_short_name);
+
 	return res;
 }
 
+// The trace recorded, NULL if none, see __cmd_record().
+static struct trace *record_trace = NULL;
+
+// When the recording started, the times of the trace are relative to it.
+static uint64_t record_start_us;
+
+// The first error of the recording.
+static int record_status;
+
+// Is record_filter installed as a dbus filter ?
+static bool record_filter_installed = false;
+
+/*
+ * Write a message in the trace recorded. A write error stops the recording,
+ * see __cmd_record_stop().
+ * @param call the method call a reply answers, NULL for other messages
+ */
+static void record(DBusMessage *message, DBusMessage *call)
+{
+	int res;
+
+	if (!record_trace || record_status < 0)
+		return;
+
+	res = trace_write(record_trace, stats_now_us() - record_start_us,
+			message, call);
+
+	if (res < 0)
+		record_status = res;
+}
+
+/*
+ * Record the replies of the bus, see dbus_reply_hook.
+ */
+static void record_reply(DBusMessage *call, DBusMessage *reply)
+{
+	record(reply, call);
+}
+
+/*
+ * Record the method calls of connman to the agent. The signals are recorded
+ * by monitor_changed.
+ */
+static DBusHandlerResult record_filter(DBusConnection *connection,
+		DBusMessage *message, void *user_data)
+{
+	if (dbus_message_get_type(message) == DBUS_MESSAGE_TYPE_METHOD_CALL &&
+			dbus_message_has_interface(message,
+				key_agent_interface))
+		record(message, NULL);
+
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
 /*
  * This is called when some signal have been emitted by the connman dbus
  * service. It will "forward" the signal in the signal callback with the
@@ -571,6 +725,9 @@ static DBusHandlerResult monitor_changed(DBusConnection *connection,
 			!strcmp(interface, "net.connman.Notification"))
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
+	stats_signal_received();
+	record(message, NULL);
+
 	interface = strrchr(interface, '.');
 	if (interface && *interface != '\0')
 		interface++;
@@ -624,6 +781,22 @@ static DBusHandlerResult monitor_changed(DBusConnection *connection,
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
+// Is monitor_changed installed as a dbus filter ?
+static bool filter_installed = false;
+
+// Match rules installed by __cmd_watch_services(), as keys.
+static struct json_object *watched_rules = NULL;
+
+// Services watched by __cmd_watch_services(), as keys.
+static struct json_object *watched_services = NULL;
+
+// Service properties watched for every service, see __cmd_watch_services().
+static const char *watch_global_properties[] = {
+	key_serv_state,
+	key_serv_favorite,
+	NULL,
+};
+
 static struct {
 	char *interface;
 	bool enabled;
@@ -634,13 +807,69 @@ static struct {
 	{ NULL, },
 };
 
+/*
+ * Add a match rule, there is nothing to match without a bus (see
+ * dbus_set_offline()).
+ * @param err NULL to add the rule asynchronously
+ */
+static void bus_add_match(const char *rule, DBusError *err)
+{
+	if (connection)
+		dbus_bus_add_match(connection, rule, err);
+}
+
+/*
+ * Remove a match rule added by bus_add_match().
+ */
+static void bus_remove_match(const char *rule, DBusError *err)
+{
+	if (connection)
+		dbus_bus_remove_match(connection, rule, err);
+}
+
+/*
+ * Install or remove monitor_changed as a dbus filter, depending on whether a
+ * signal is monitored or watched.
+ */
+static void update_filter(void)
+{
+	bool needed = false;
+	int i;
+
+	for (i = 0; monitor[i].interface; i++) {
+		if (monitor[i].enabled == true)
+			needed = true;
+	}
+
+	if (watched_rules && json_object_object_length(watched_rules) > 0)
+		needed = true;
+
+	// Without a bus, the filter only tells whether signals are replayed
+	if (connection && needed && !filter_installed)
+		dbus_connection_add_filter(connection, monitor_changed,
+				NULL, NULL);
+
+	else if (connection && !needed && filter_installed)
+		dbus_connection_remove_filter(connection, monitor_changed,
+				NULL);
+
+	filter_installed = needed;
+
+	// The recording can start before the connection exists
+	if (connection && record_trace && !record_filter_installed) {
+		dbus_connection_add_filter(connection, record_filter, NULL,
+				NULL);
+		record_filter_installed = true;
+	}
+}
+
 /*
  * Add a filter on connamn dbus signals.
  * @param interface one of "Service", "Technology", "Manager"
  */
 static void monitor_add(const char *interface)
 {
-	bool add_filter = true, found = false;
+	bool found = false;
 	int i;
 	char *rule;
 	DBusError err;
@@ -649,9 +878,6 @@ static void monitor_add(const char *interface)
 		return;
 
 	for (i = 0; monitor[i].interface; i++) {
-		if (monitor[i].enabled == true)
-			add_filter = false;
-
 		if (strncmp(interface, monitor[i].interface,
 					JSON_COMMANDS_STRING_SIZE_SMALL) == 0) {
 			if (monitor[i].enabled == true)
@@ -665,9 +891,7 @@ static void monitor_add(const char *interface)
 	if (found == false)
 		return;
 
-	if (add_filter == true)
-		dbus_connection_add_filter(connection, monitor_changed,
-				NULL, NULL);
+	update_filter();
 
 	dbus_error_init(&err);
 
@@ -675,7 +899,7 @@ static void monitor_add(const char *interface)
 	snprintf(rule, JSON_COMMANDS_STRING_SIZE_MEDIUM,
 			"type='signal',interface='net.connman.%s'", interface);
 	rule[JSON_COMMANDS_STRING_SIZE_MEDIUM] = '\0';
-	dbus_bus_add_match(connection, rule, &err);
+	bus_add_match(rule, &err);
 	free(rule);
 
 	if (dbus_error_is_set(&err))
@@ -688,7 +912,7 @@ static void monitor_add(const char *interface)
  */
 static void monitor_del(const char *interface)
 {
-	bool del_filter = true, found = false;
+	bool found = false;
 	int i;
 	char *rule;
 	DBusError err;
@@ -705,9 +929,6 @@ static void monitor_del(const char *interface)
 			monitor[i].enabled = false;
 			found = true;
 		}
-
-		if (monitor[i].enabled == true)
-			del_filter = false;
 	}
 
 	if (found == false)
@@ -718,15 +939,13 @@ static void monitor_del(const char *interface)
 	snprintf(rule, JSON_COMMANDS_STRING_SIZE_MEDIUM,
 			"type='signal',interface='net.connman.%s'", interface);
 	rule[JSON_COMMANDS_STRING_SIZE_MEDIUM] = '\0';
-	dbus_bus_remove_match(connection, rule, &err);
+	bus_remove_match(rule, &err);
 	free(rule);
 
 	if (dbus_error_is_set(&err))
 		call_return_list(NULL, err.message, "");
 
-	if (del_filter == true)
-		dbus_connection_remove_filter(connection, monitor_changed,
-				NULL);
+	update_filter();
 }
 
 /*
@@ -761,3 +980,381 @@ int __cmd_monitor(struct json_object *jobj)
 
 	return -EINPROGRESS;
 }
+
+/*
+ * Forward the properties of a service newly watched as a ServicesChanged
+ * signal, so the engine catches up with the changes it didn't receive.
+ * @param user_data the dbus name of the service, freed here
+ */
+static void watch_refresh_return(DBusMessageIter *iter, const char *error,
+		void *user_data)
+{
+	struct json_object *res, *changed, *serv;
+
+	// The service may have disappeared meanwhile, nothing to do then
+	if (error || !iter) {
+		free(user_data);
+		return;
+	}
+
+	serv = json_object_new_array();
+	json_object_array_add(serv, json_object_new_string(user_data));
+	json_object_array_add(serv, dbus_to_json(iter));
+	changed = json_object_new_array();
+	json_object_array_add(changed, serv);
+	serv = json_object_new_array();
+	json_object_array_add(serv, changed);
+	json_object_array_add(serv, json_object_new_array());
+
+	res = json_object_new_object();
+	json_object_object_add(res, key_command_interface,
+			json_object_new_string("Manager"));
+	json_object_object_add(res, key_command_path,
+			json_object_new_string(""));
+	json_object_object_add(res, key_command_data, serv);
+	json_object_object_add(res, key_signal,
+			json_object_new_string(key_sig_serv_changed));
+
+	free(user_data);
+	commands_signal(res);
+}
+
+/*
+ * Add a match rule to the set of rules wanted.
+ */
+static void watch_rule(struct json_object *rules, const char *path,
+		const char *property)
+{
+	char rule[256];
+
+	snprintf(rule, sizeof(rule), "type='signal',interface='%s',"
+			"member='%s'%s%s%s%s%s%s", key_service_interface,
+			key_sig_prop_changed,
+			path ? ",path='" : "", path ? path : "", path ? "'" : "",
+			property ? ",arg0='" : "", property ? property : "",
+			property ? "'" : "");
+	rule[sizeof(rule) - 1] = '\0';
+
+	json_object_object_add(rules, rule, NULL);
+}
+
+/*
+ * Narrow the Service signals received to the services on screen.
+ * Service PropertyChanged signals are received for every service only for the
+ * properties in watch_global_properties, and for every property listed in
+ * properties (or all of them) for the services listed. Match rules are added
+ * and removed asynchronously, only the difference with the previous call is
+ * sent to the bus. Services newly watched are refreshed with GetProperties.
+ * @param services array of service dbus names, NULL for none
+ * @param properties array of property names, NULL for every property
+ */
+int __cmd_watch_services(struct json_object *services,
+		struct json_object *properties)
+{
+	struct json_object *rules, *serv_set;
+	const char *path;
+	char *path_copy;
+	int i, j, nb_props;
+
+	rules = json_object_new_object();
+	serv_set = json_object_new_object();
+	nb_props = properties ? json_object_array_length(properties) : 0;
+
+	for (i = 0; watch_global_properties[i]; i++)
+		watch_rule(rules, NULL, watch_global_properties[i]);
+
+	for (i = 0; services && i < json_object_array_length(services); i++) {
+		path = json_object_get_string(json_object_array_get_idx(
+					services, i));
+		json_object_object_add(serv_set, path, NULL);
+
+		if (nb_props == 0)
+			watch_rule(rules, path, NULL);
+
+		for (j = 0; j < nb_props; j++)
+			watch_rule(rules, path, json_object_get_string(
+					json_object_array_get_idx(properties,
+						j)));
+	}
+
+	// Passing no DBusError makes the calls asynchronous
+	if (watched_rules) {
+		json_object_object_foreach(watched_rules, old_rule, val) {
+			(void) val;
+
+			if (!json_object_object_get_ex(rules, old_rule, NULL))
+				bus_remove_match(old_rule, NULL);
+		}
+	}
+
+	json_object_object_foreach(rules, rule, val) {
+		(void) val;
+
+		if (!watched_rules || !json_object_object_get_ex(watched_rules,
+					rule, NULL))
+			bus_add_match(rule, NULL);
+	}
+
+	json_object_object_foreach(serv_set, serv, serv_val) {
+		(void) serv_val;
+
+		if (watched_services && json_object_object_get_ex(
+					watched_services, serv, NULL))
+			continue;
+
+		path_copy = strdup(serv);
+
+		if (dbus_method_call(connection, key_connman_service, serv,
+					key_service_interface, "GetProperties",
+					watch_refresh_return, path_copy, NULL,
+					NULL) != -EINPROGRESS)
+			free(path_copy);
+	}
+
+	json_object_put(watched_rules);
+	json_object_put(watched_services);
+	watched_rules = rules;
+	watched_services = serv_set;
+	update_filter();
+
+	return -EINPROGRESS;
+}
+
+// The trace replayed, NULL if none, see __cmd_replay().
+static struct trace *replay_trace = NULL;
+
+// The speed of the replay, 0 for as fast as possible.
+static unsigned int replay_speed;
+
+// The next message to replay once it's due, and its time in the trace.
+static DBusMessage *replay_next = NULL;
+static uint64_t replay_next_us;
+
+// When the first message was replayed, and its time in the trace.
+static bool replay_started;
+static uint64_t replay_begin_us, replay_first_us;
+
+static int replay_idle(void);
+
+/*
+ * Return true if a signal replayed matches the match rules the client would
+ * have on a bus, see monitor_add() and __cmd_watch_services().
+ */
+static bool replay_signal_is_wanted(DBusMessage *message)
+{
+	DBusMessageIter iter;
+	const char *property;
+	int i;
+
+	if (!filter_installed)
+		return false;
+
+	if (!dbus_message_has_interface(message, key_service_interface))
+		return true;
+
+	// monitor[0] is the Service interface
+	if (monitor[0].enabled)
+		return true;
+
+	if (!dbus_message_has_member(message, key_sig_prop_changed))
+		return false;
+
+	if (watched_services && json_object_object_get_ex(watched_services,
+				dbus_message_get_path(message), NULL))
+		return true;
+
+	if (!dbus_message_iter_init(message, &iter) ||
+			dbus_message_iter_get_arg_type(&iter) !=
+			DBUS_TYPE_STRING)
+		return false;
+
+	dbus_message_iter_get_basic(&iter, &property);
+
+	for (i = 0; watch_global_properties[i]; i++) {
+		if (strcmp(property, watch_global_properties[i]) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Stop replaying the trace and tell commands_replay_end.
+ */
+static void replay_stop(int status)
+{
+	trace_close(replay_trace);
+	replay_trace = NULL;
+	loop_remove_idle(replay_idle);
+
+	if (replay_next)
+		dbus_message_unref(replay_next);
+
+	replay_next = NULL;
+
+	if (commands_replay_end)
+		commands_replay_end(status);
+}
+
+/*
+ * Return the delay in microseconds before the next message is due, 0 if it's
+ * due now, see replay_speed.
+ */
+static uint64_t replay_delay(void)
+{
+	uint64_t now, due;
+
+	if (replay_speed == 0)
+		return 0;
+
+	now = stats_now_us();
+
+	if (!replay_started) {
+		replay_started = true;
+		replay_begin_us = now;
+		replay_first_us = replay_next_us;
+	}
+
+	due = replay_begin_us;
+
+	if (replay_next_us > replay_first_us)
+		due += (replay_next_us - replay_first_us) / replay_speed;
+
+	return due > now ? due - now : 0;
+}
+
+/*
+ * Loop idle function: feed the next messages of the trace replayed, once they
+ * are due, to the functions the bus would have dispatched them to: signals to
+ * monitor_changed (if the client would have received them), method returns
+ * and errors to the callback of the call they answer (see
+ * dbus_offline_reply()) and method calls to the agent. A slice stops after a
+ * reply so the callback can stop the loop (e.g. in engine_init()).
+ * Return the delay in milliseconds before the next message is due, -1 once
+ * the replay is over.
+ */
+static int replay_idle(void)
+{
+	DBusMessage *message;
+	uint64_t delay;
+	int i, res, type;
+
+	if (!replay_trace)
+		return -1;
+
+	for (i = 0; i < COMMANDS_REPLAY_BATCH; i++) {
+		if (!replay_next) {
+			res = trace_read(replay_trace, &replay_next_us,
+					&replay_next);
+
+			if (res <= 0) {
+				replay_stop(res);
+				return -1;
+			}
+		}
+
+		if ((delay = replay_delay()) > 0)
+			return (delay + 999) / 1000;
+
+		message = replay_next;
+		replay_next = NULL;
+		type = dbus_message_get_type(message);
+
+		if (type == DBUS_MESSAGE_TYPE_SIGNAL &&
+				replay_signal_is_wanted(message))
+			monitor_changed(connection, message, NULL);
+
+		else if (type == DBUS_MESSAGE_TYPE_METHOD_RETURN ||
+				type == DBUS_MESSAGE_TYPE_ERROR)
+			dbus_offline_reply(message);
+
+		else if (type == DBUS_MESSAGE_TYPE_METHOD_CALL)
+			agent_dispatch(message);
+
+		dbus_message_unref(message);
+
+		if (type == DBUS_MESSAGE_TYPE_METHOD_RETURN ||
+				type == DBUS_MESSAGE_TYPE_ERROR)
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Replay a trace of messages (see trace.c and __cmd_record()) from the loop.
+ * The engine runs without a bus (engine_set_bus("offline")): the replay
+ * starts before engine_init(), whose calls are answered by the trace. A reply
+ * due before its call was sent is dropped, a slow client can miss replies at
+ * a high speed. commands_replay_end is called once the trace is over.
+ * Return 0 on success, -EALREADY if a trace is being replayed, -errno if the
+ * trace can't be opened.
+ * @param path the trace file
+ * @param speed 1 to replay at the speed of the recording, n to replay n times
+ *	faster, 0 to replay as fast as possible
+ */
+int __cmd_replay(const char *path, unsigned int speed)
+{
+	if (replay_trace)
+		return -EALREADY;
+
+	replay_trace = trace_open(path);
+
+	if (!replay_trace)
+		return -errno;
+
+	replay_speed = speed;
+	replay_started = false;
+	loop_add_idle(replay_idle);
+
+	return 0;
+}
+
+/*
+ * Record the messages of connman in a trace (see trace.c) to replay it with
+ * __cmd_replay(): the signals monitor_changed gets, the replies to the method
+ * calls and the method calls to the agent. The recording starts before
+ * engine_init() to hold the replies it waits for.
+ * Return 0 on success, -EALREADY if a trace is being recorded, -errno if the
+ * trace can't be created.
+ * @param path the trace file, it's overwritten
+ */
+int __cmd_record(const char *path)
+{
+	if (record_trace)
+		return -EALREADY;
+
+	record_trace = trace_create(path);
+
+	if (!record_trace)
+		return -errno;
+
+	record_start_us = stats_now_us();
+	record_status = 0;
+	dbus_reply_hook = record_reply;
+	update_filter();
+
+	return 0;
+}
+
+/*
+ * Stop the recording started by __cmd_record() and close the trace.
+ * Return 0 on success, -errno if a message couldn't be written.
+ */
+int __cmd_record_stop(void)
+{
+	int res;
+
+	if (!record_trace)
+		return 0;
+
+	if (connection && record_filter_installed)
+		dbus_connection_remove_filter(connection, record_filter, NULL);
+
+	record_filter_installed = false;
+	dbus_reply_hook = NULL;
+	res = trace_close(record_trace);
+	record_trace = NULL;
+
+	return record_status < 0 ? record_status : res;
+}
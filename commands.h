@@ -30,12 +30,18 @@
 #define JSON_COMMANDS_STRING_SIZE_SMALL 25
 #define JSON_COMMANDS_STRING_SIZE_MEDIUM 70
 
+// Messages of a trace replayed per loop iteration, see __cmd_replay().
+#define COMMANDS_REPLAY_BATCH 64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern void (*commands_callback)(struct json_object *data, json_bool is_error);
 extern void (*commands_signal)(struct json_object *data);
+extern void (*commands_replay_end)(int status);
+
+void __cmd_set_request_id(unsigned int id);
 
 int __cmd_state(void);
 
@@ -45,6 +51,9 @@ int __cmd_technologies(void);
 
 int __cmd_monitor(struct json_object *jobj);
 
+int __cmd_watch_services(struct json_object *services,
+		struct json_object *properties);
+
 int __cmd_connect(const char *serv_dbus_name);
 
 int __cmd_disconnect(const char *serv_dbus_name);
@@ -59,6 +68,12 @@ int __cmd_toggle_offline_mode(bool set_offline_to);
 
 int __cmd_remove(const char *serv_dbus_name);
 
+int __cmd_replay(const char *path, unsigned int speed);
+
+int __cmd_record(const char *path);
+
+int __cmd_record_stop(void);
+
 #ifdef __cplusplus
 }
 #endif
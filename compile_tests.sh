@@ -7,7 +7,10 @@ CC="gcc"
 #$CC $FLAGS -o test_json_utils test_json_utils.c json_utils.o keys.o
 
 # main_simple_commands
-#$CC $FLAGS -o main_simple_commands main_simple_commands.c -I/usr/include/dbus-1.0/ -I/usr/lib64/dbus-1.0/include -ldbus-1 -ljson -lncurses loop.o engine.o commands.o dbus_helpers.o json_utils.o dbus_json.o agent.o keys.o
+#$CC $FLAGS -o main_simple_commands main_simple_commands.c -I/usr/include/dbus-1.0/ -I/usr/lib64/dbus-1.0/include -ldbus-1 -ljson -lncurses loop.o engine.o commands.o dbus_helpers.o json_utils.o dbus_json.o agent.o keys.o stats.o coalesce.o ranking.o credentials.o trace.o
 
 # test_regex
 $CC $FLAGS -o test_regexp test_regexp.c json_utils.o keys.o
+
+# test_arena
+$CC -Wall -std=gnu99 -O2 -Wl,--wrap=malloc -o test_arena test_arena.c renderers.c vlist.c arena.c ncurses_utils.c keys.c json_utils.c string_utils.c -ljson -lmenu -lform -lncurses
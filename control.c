@@ -0,0 +1,888 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// struct ucred, see accept_client()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <json.h>
+
+#include "engine.h"
+#include "json_utils.h"
+#include "keys.h"
+#include "loop.h"
+#include "stats.h"
+
+#include "control.h"
+
+/*
+ * This file implements a headless control socket over the engine. Clients
+ * connect to a UNIX socket and write commands as json lines, in the format of
+ * engine_query(). Many commands can be in flight: every command gets a reply
+ * line, in the format of engine_callback with the status code added
+ * (key_status). Replies of connman come in any order, a client tells them
+ * apart with the request id of its commands: any json value, sent back as is.
+ * config_service gets a reply per option.
+ * The request ids of the clients are replaced by ids unique to the daemon
+ * before the commands go to the engine, see execute_line().
+ * A client also gets the events it subscribed to:
+ *	{ "command": "subscribe", "cmd_data": { "events": [ "agent" ] } }
+ *	"state", "technologies", "services": the change records of the
+ *		collection, see publish_change() in engine.c
+ *	"agent": the agent requests, answered with agent_response / agent_retry
+ * "unsubscribe" removes events, both reply with the events subscribed.
+ * Every service is watched until a client narrows the services it needs with
+ * watch_services; the engine then watches the services of all such clients,
+ * see update_watch().
+ */
+
+// Events a client can subscribe to.
+enum {
+	EVENT_STATE = 1 << 0,
+	EVENT_TECHNOLOGIES = 1 << 1,
+	EVENT_SERVICES = 1 << 2,
+	EVENT_AGENT = 1 << 3,
+};
+
+static const struct {
+	const char *name;
+	unsigned int event;
+} events[] = {
+	{ key_state, EVENT_STATE },
+	{ key_technologies, EVENT_TECHNOLOGIES },
+	{ key_services, EVENT_SERVICES },
+	{ key_event_agent, EVENT_AGENT },
+	{ NULL, 0 },
+};
+
+struct control_client {
+	int fd;				// -1 if the slot is free
+	unsigned int serial;		// tells apart clients of the same slot
+	unsigned int events;		// EVENT_* subscribed
+	struct json_object *watch;	// cmd_data of its last watch_services
+	char in[CONTROL_LINE_MAX_LEN];	// incomplete line received
+	size_t in_len;
+	char *out;			// waiting to be written
+	size_t out_len, out_size;
+};
+
+static struct control_client clients[CONTROL_MAX_CLIENTS];
+
+// Commands sent to the engine, by request id: the request with id n is in slot
+// n % CONTROL_MAX_PENDING. A slot is reused CONTROL_MAX_PENDING commands
+// later once its command got a reply (the next replies of config_service are
+// then dropped); until then, new commands are refused with -EBUSY.
+static struct {
+	unsigned int id;		// 0 if the slot is free
+	int client;
+	unsigned int serial;
+	struct json_object *client_id;	// request id of the client, can be NULL
+	bool answered;
+} requests[CONTROL_MAX_PENDING];
+
+static unsigned int last_request_id;
+
+// The listening socket, -1 if none.
+static int listen_fd = -1;
+
+// Its path, removed by control_terminate().
+static char *listen_path;
+
+// Request id of the command being executed by engine_query(), 0 if none.
+static unsigned int current_request_id;
+
+// The command being executed got a reply.
+static bool current_answered;
+
+static unsigned int last_serial;
+
+static int update_watch(void);
+
+static void client_close(struct control_client *client)
+{
+	loop_remove_fd(client->fd);
+	close(client->fd);
+	free(client->out);
+	client->out = NULL;
+	client->out_len = client->out_size = 0;
+	client->in_len = 0;
+	client->events = 0;
+	client->fd = -1;
+
+	if (client->watch) {
+		json_object_put(client->watch);
+		client->watch = NULL;
+		update_watch();
+	}
+}
+
+/*
+ * Write what's waiting, watch POLLOUT if something is left.
+ */
+static void client_flush(struct control_client *client)
+{
+	ssize_t len;
+
+	while (client->out_len > 0) {
+		len = send(client->fd, client->out, client->out_len,
+				MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		if (len < 0 && errno == EINTR)
+			continue;
+
+		if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+
+		if (len <= 0) {
+			client_close(client);
+			return;
+		}
+
+		client->out_len -= len;
+		memmove(client->out, client->out + len, client->out_len);
+	}
+
+	loop_set_fd_events(client->fd, client->out_len > 0 ?
+			POLLIN | POLLOUT : POLLIN);
+}
+
+/*
+ * Write a json line to a client.
+ */
+static void client_send(struct control_client *client, struct json_object *jobj)
+{
+	const char *str;
+	size_t len, size;
+	char *out;
+
+	if (client->fd < 0)
+		return;
+
+	stats_stage_begin(STATS_STAGE_SERIALIZE);
+	str = json_object_to_json_string(jobj);
+	len = strlen(str);
+	stats_stage_end(STATS_STAGE_SERIALIZE);
+
+	if (client->out_len + len + 1 > CONTROL_OUT_MAX_LEN) {
+		client_close(client);
+		return;
+	}
+
+	if (client->out_len + len + 1 > client->out_size) {
+		size = (client->out_len + len + 1) * 2;
+
+		if (!(out = realloc(client->out, size))) {
+			client_close(client);
+			return;
+		}
+
+		client->out = out;
+		client->out_size = size;
+	}
+
+	memcpy(client->out + client->out_len, str, len);
+	client->out[client->out_len + len] = '\n';
+	client->out_len += len + 1;
+	client_flush(client);
+}
+
+/*
+ * Reply to a command which didn't get a reply from the engine.
+ * @param client_id the request id of the client, can be NULL
+ */
+static void send_status(struct control_client *client, const char *cmd_name,
+		struct json_object *client_id, int status)
+{
+	struct json_object *res;
+
+	res = json_object_new_object();
+
+	if (cmd_name)
+		json_object_object_add(res, key_command,
+				json_object_new_string(cmd_name));
+
+	if (client_id)
+		json_object_object_add(res, key_request_id,
+				json_object_get(client_id));
+
+	json_object_object_add(res, key_status, json_object_new_int(status));
+
+	if (status < 0)
+		json_object_object_add(res, key_error,
+				json_object_new_string(strerror(-status)));
+
+	client_send(client, res);
+	json_object_put(res);
+}
+
+/*
+ * Subscribe or unsubscribe to the events of cmd_data, then reply with the
+ * events subscribed.
+ */
+static void subscribe(struct control_client *client, struct json_object *cmd,
+		const char *cmd_name, bool add)
+{
+	struct json_object *cmd_data, *list, *res, *client_id;
+	const char *name;
+	int i, j, len = 0;
+
+	json_object_object_get_ex(cmd, key_command_data, &cmd_data);
+
+	if (json_object_object_get_ex(cmd_data, key_events, &list) &&
+			json_object_get_type(list) == json_type_array)
+		len = json_object_array_length(list);
+
+	for (i = 0; i < len; i++) {
+		name = json_object_get_string(json_object_array_get_idx(list,
+					i));
+
+		for (j = 0; name && events[j].name; j++) {
+			if (strcmp(name, events[j].name) != 0)
+				continue;
+
+			if (add)
+				client->events |= events[j].event;
+			else
+				client->events &= ~events[j].event;
+		}
+	}
+
+	res = json_object_new_object();
+	json_object_object_add(res, key_command,
+			json_object_new_string(cmd_name));
+	list = json_object_new_array();
+
+	for (j = 0; events[j].name; j++) {
+		if (client->events & events[j].event)
+			json_object_array_add(list,
+					json_object_new_string(events[j].name));
+	}
+
+	json_object_object_add(res, key_events, list);
+
+	if (json_object_object_get_ex(cmd, key_request_id, &client_id))
+		json_object_object_add(res, key_request_id,
+				json_object_get(client_id));
+
+	client_send(client, res);
+	json_object_put(res);
+}
+
+/*
+ * Add the strings of an array to a set (a json object used as keys).
+ */
+static void add_to_set(struct json_object *set, struct json_object *array)
+{
+	int i;
+
+	for (i = 0; i < json_object_array_length(array); i++)
+		json_object_object_add(set, json_object_get_string(
+					json_object_array_get_idx(array, i)),
+				NULL);
+}
+
+/*
+ * Return an array of the keys of a set.
+ */
+static struct json_object* set_to_array(struct json_object *set)
+{
+	struct json_object *array;
+
+	array = json_object_new_array();
+
+	json_object_object_foreach(set, key, val) {
+		(void) val;
+		json_object_array_add(array, json_object_new_string(key));
+	}
+
+	return array;
+}
+
+/*
+ * Watch the union of the services watched by the clients, with the union of
+ * their properties (every property if one of them wants them all). Every
+ * service is watched while no client narrowed the services it needs.
+ * Return the result of engine_query().
+ */
+static int update_watch(void)
+{
+	struct json_object *serv_set, *prop_set, *cmd_data, *cmd, *list;
+	bool narrowed = false, all_props = false;
+	int i;
+
+	serv_set = json_object_new_object();
+	prop_set = json_object_new_object();
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		if (clients[i].fd < 0 || !clients[i].watch)
+			continue;
+
+		narrowed = true;
+
+		if (!json_object_object_get_ex(clients[i].watch, key_services,
+					&list))
+			continue;
+
+		add_to_set(serv_set, list);
+
+		if (json_object_object_get_ex(clients[i].watch,
+					key_properties, &list))
+			add_to_set(prop_set, list);
+		else
+			all_props = true;
+	}
+
+	engine_watch_all_services(!narrowed);
+
+	// Empty arrays don't pass the engine validation
+	cmd_data = json_object_new_object();
+
+	if (json_object_object_length(serv_set) > 0)
+		json_object_object_add(cmd_data, key_services,
+				set_to_array(serv_set));
+
+	if (!all_props && json_object_object_length(prop_set) > 0)
+		json_object_object_add(cmd_data, key_properties,
+				set_to_array(prop_set));
+
+	json_object_put(serv_set);
+	json_object_put(prop_set);
+
+	cmd = json_object_new_object();
+	json_object_object_add(cmd, key_command,
+			json_object_new_string(key_engine_watch_services));
+	json_object_object_add(cmd, key_command_data, cmd_data);
+
+	return engine_query(cmd);
+}
+
+/*
+ * Return true if the key of cmd_data is missing or a non empty array.
+ */
+static bool watch_list_is_valid(struct json_object *cmd_data, const char *key)
+{
+	struct json_object *list;
+
+	if (!json_object_object_get_ex(cmd_data, key, &list))
+		return true;
+
+	return json_object_get_type(list) == json_type_array &&
+		json_object_array_length(list) > 0;
+}
+
+/*
+ * Replace the services a client watches, then reply with the status. The
+ * engine validates the union of the clients' lists, the previous list of the
+ * client is restored if it's refused.
+ */
+static void watch(struct control_client *client, struct json_object *cmd,
+		const char *cmd_name)
+{
+	struct json_object *cmd_data = NULL, *client_id = NULL, *old_watch;
+	int res = -EINVAL;
+
+	json_object_object_get_ex(cmd, key_command_data, &cmd_data);
+	json_object_object_get_ex(cmd, key_request_id, &client_id);
+
+	if (!cmd_data || (json_object_get_type(cmd_data) == json_type_object &&
+				watch_list_is_valid(cmd_data, key_services) &&
+				watch_list_is_valid(cmd_data,
+					key_properties))) {
+		old_watch = client->watch;
+		client->watch = cmd_data ? json_object_get(cmd_data) :
+			json_object_new_object();
+
+		if ((res = update_watch()) < 0) {
+			json_object_put(client->watch);
+			client->watch = old_watch;
+			update_watch();
+		} else
+			json_object_put(old_watch);
+	}
+
+	send_status(client, cmd_name, client_id, res);
+}
+
+/*
+ * Return true if the command in the slot still waits for its reply, and its
+ * client for it.
+ */
+static bool request_is_pending(unsigned int slot)
+{
+	struct control_client *client = &clients[requests[slot].client];
+
+	return requests[slot].id != 0 && !requests[slot].answered &&
+		client->fd >= 0 && client->serial == requests[slot].serial;
+}
+
+/*
+ * Give the command of a client the next request id. The request id of the
+ * client is kept to be sent back with the replies, see send_reply().
+ * Return the request id, 0 if its slot is still pending.
+ */
+static unsigned int request_new(struct control_client *client,
+		struct json_object *cmd)
+{
+	struct json_object *client_id = NULL;
+	unsigned int id, slot;
+
+	// The engine only takes positive integers
+	id = last_request_id == INT_MAX ? 1 : last_request_id + 1;
+	slot = id % CONTROL_MAX_PENDING;
+
+	if (request_is_pending(slot))
+		return 0;
+
+	last_request_id = id;
+	json_object_put(requests[slot].client_id);
+
+	json_object_object_get_ex(cmd, key_request_id, &client_id);
+	requests[slot].id = id;
+	requests[slot].client = client - clients;
+	requests[slot].serial = client->serial;
+	requests[slot].client_id = json_object_get(client_id);
+	requests[slot].answered = false;
+
+	json_object_object_del(cmd, key_request_id);
+	json_object_object_add(cmd, key_request_id, json_object_new_int(id));
+
+	return id;
+}
+
+/*
+ * Execute a command line of a client.
+ */
+static void execute_line(struct control_client *client, const char *line)
+{
+	struct json_object *cmd, *client_id = NULL;
+	const char *cmd_name;
+	unsigned int id;
+	char *name;
+	int res;
+
+	cmd = json_tokener_parse(line);
+
+	if (!cmd || json_object_get_type(cmd) != json_type_object ||
+			!(cmd_name = __json_get_command_str(cmd))) {
+		send_status(client, NULL, NULL, -EINVAL);
+		json_object_put(cmd);
+		return;
+	}
+
+	if (strcmp(cmd_name, key_control_subscribe) == 0 ||
+			strcmp(cmd_name, key_control_unsubscribe) == 0) {
+		subscribe(client, cmd, cmd_name,
+				strcmp(cmd_name, key_control_subscribe) == 0);
+		json_object_put(cmd);
+		return;
+	}
+
+	// The engine only knows one set of services watched, for all clients
+	if (strcmp(cmd_name, key_engine_watch_services) == 0) {
+		watch(client, cmd, cmd_name);
+		json_object_put(cmd);
+		return;
+	}
+
+	// Too many commands wait for a reply
+	if (!(id = request_new(client, cmd))) {
+		json_object_object_get_ex(cmd, key_request_id, &client_id);
+		send_status(client, cmd_name, client_id, -EBUSY);
+		json_object_put(cmd);
+		return;
+	}
+
+	// The engine releases the command
+	name = strdup(cmd_name);
+	current_request_id = id;
+	current_answered = false;
+	res = engine_query(cmd);
+	current_request_id = 0;
+
+	if (!current_answered && res != -EINPROGRESS) {
+		requests[id % CONTROL_MAX_PENDING].answered = true;
+		send_status(client, name,
+				requests[id % CONTROL_MAX_PENDING].client_id,
+				res);
+	}
+
+	free(name);
+}
+
+/*
+ * Read the commands of a client, one per line.
+ */
+static void client_read(struct control_client *client)
+{
+	char *line, *end;
+	ssize_t len;
+
+	len = read(client->fd, client->in + client->in_len,
+			CONTROL_LINE_MAX_LEN - client->in_len - 1);
+
+	if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+				errno == EINTR))
+		return;
+
+	if (len <= 0) {
+		client_close(client);
+		return;
+	}
+
+	client->in_len += len;
+	client->in[client->in_len] = '\0';
+	line = client->in;
+
+	while (client->fd >= 0 && (end = strchr(line, '\n'))) {
+		*end = '\0';
+
+		if (end != line)
+			execute_line(client, line);
+
+		line = end + 1;
+	}
+
+	if (client->fd < 0)
+		return;
+
+	client->in_len -= line - client->in;
+	memmove(client->in, line, client->in_len);
+
+	// The line can't be completed
+	if (client->in_len == CONTROL_LINE_MAX_LEN - 1) {
+		send_status(client, NULL, NULL, -E2BIG);
+		client_close(client);
+	}
+}
+
+static void client_event(int fd, short revents)
+{
+	int i;
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS && clients[i].fd != fd; i++)
+		;
+
+	if (i == CONTROL_MAX_CLIENTS)
+		return;
+
+	if (revents & POLLOUT)
+		client_flush(&clients[i]);
+
+	if (clients[i].fd >= 0 && revents & (POLLIN | POLLHUP | POLLERR))
+		client_read(&clients[i]);
+}
+
+static void accept_client(int fd, short revents)
+{
+	struct ucred cred;
+	socklen_t cred_len = sizeof(cred);
+	int client_fd, i;
+
+	client_fd = accept(listen_fd, NULL, NULL);
+
+	if (client_fd < 0)
+		return;
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS && clients[i].fd >= 0; i++)
+		;
+
+	// Only the user running the daemon may drive it
+	if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred,
+				&cred_len) < 0 || cred.uid != geteuid() ||
+			i == CONTROL_MAX_CLIENTS ||
+			fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0 ||
+			loop_add_fd(client_fd, POLLIN, client_event) < 0) {
+		close(client_fd);
+		return;
+	}
+
+	clients[i].fd = client_fd;
+	clients[i].serial = ++last_serial;
+}
+
+/*
+ * Return the default path of the socket: CONTROL_DEFAULT_NAME in
+ * $XDG_RUNTIME_DIR, private to the user, or in /run without it.
+ */
+const char* control_default_path(void)
+{
+	static char path[PATH_MAX];
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+
+	if (!dir || dir[0] != '/')
+		dir = "/run";
+
+	snprintf(path, sizeof(path), "%s/%s", dir, CONTROL_DEFAULT_NAME);
+
+	return path;
+}
+
+/*
+ * Remove the socket left by a daemon which is gone. A socket a daemon still
+ * listens on, or a file which isn't a socket, is kept.
+ * Return 0 if the path is free, -EADDRINUSE if a daemon listens on it, -EEXIST
+ * if it isn't a socket, or a negative errno.
+ */
+static int remove_stale_socket(struct sockaddr_un *addr)
+{
+	struct stat st;
+	int fd, res;
+
+	if (lstat(addr->sun_path, &st) < 0)
+		return errno == ENOENT ? 0 : -errno;
+
+	if (!S_ISSOCK(st.st_mode))
+		return -EEXIST;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0)
+		return -errno;
+
+	res = connect(fd, (struct sockaddr *) addr, sizeof(*addr)) < 0 ?
+		-errno : 0;
+	close(fd);
+
+	if (res == 0)
+		return -EADDRINUSE;
+
+	// Nobody listens on it
+	if (res != -ECONNREFUSED)
+		return res;
+
+	return unlink(addr->sun_path) < 0 ? -errno : 0;
+}
+
+/*
+ * Listen for clients on a UNIX socket. The loop has to be initialized.
+ * The socket is only accessible to the user, clients of other users are
+ * refused in accept_client().
+ * Return 0, -EADDRINUSE if another daemon listens on the path, or a negative
+ * errno.
+ * @param path the path of the socket, replaced if it's a stale socket
+ */
+int control_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	mode_t old_umask;
+	int i, res;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++)
+		clients[i].fd = -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if ((res = remove_stale_socket(&addr)) < 0)
+		return res;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (listen_fd < 0)
+		return -errno;
+
+	old_umask = umask(077);
+	res = bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr));
+	umask(old_umask);
+
+	if (res < 0 || listen(listen_fd, CONTROL_MAX_CLIENTS) < 0 ||
+			fcntl(listen_fd, F_SETFL, O_NONBLOCK) < 0) {
+		res = -errno;
+		close(listen_fd);
+		listen_fd = -1;
+		return res;
+	}
+
+	if ((res = loop_add_fd(listen_fd, POLLIN, accept_client)) < 0) {
+		close(listen_fd);
+		listen_fd = -1;
+		return res;
+	}
+
+	listen_path = strdup(path);
+
+	// No client narrowed the services watched yet
+	update_watch();
+
+	return 0;
+}
+
+/*
+ * Send the change records of a batch to the clients subscribed to their
+ * collection.
+ */
+static void send_changes(struct json_object *jobj)
+{
+	struct json_object *changes, *change, *collection, *res, *array;
+	unsigned int event;
+	int i, j, k, len;
+
+	json_object_object_get_ex(jobj, key_changes, &changes);
+	len = json_object_array_length(changes);
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		if (clients[i].fd < 0 || !clients[i].events)
+			continue;
+
+		array = json_object_new_array();
+
+		for (j = 0; j < len; j++) {
+			change = json_object_array_get_idx(changes, j);
+			json_object_object_get_ex(change, key_change_collection,
+					&collection);
+			event = 0;
+
+			for (k = 0; events[k].name; k++) {
+				if (strcmp(events[k].name,
+						json_object_get_string(
+							collection)) == 0)
+					event = events[k].event;
+			}
+
+			if (clients[i].events & event)
+				json_object_array_add(array,
+						json_object_get(change));
+		}
+
+		if (json_object_array_length(array) > 0) {
+			res = json_object_new_object();
+			json_object_object_add(res, key_changes, array);
+			client_send(&clients[i], res);
+			json_object_put(res);
+		} else
+			json_object_put(array);
+	}
+}
+
+/*
+ * Send a reply to the client of the command with the request id, with the
+ * request id of the client. The reply is dropped if the client is gone or the
+ * command was forgotten.
+ */
+static void send_reply(struct json_object *jobj, unsigned int id)
+{
+	unsigned int slot = id % CONTROL_MAX_PENDING;
+	struct control_client *client;
+
+	if (id == 0 || requests[slot].id != id)
+		return;
+
+	requests[slot].answered = true;
+	client = &clients[requests[slot].client];
+
+	if (client->fd < 0 || client->serial != requests[slot].serial)
+		return;
+
+	json_object_object_del(jobj, key_request_id);
+
+	if (requests[slot].client_id)
+		json_object_object_add(jobj, key_request_id,
+				json_object_get(requests[slot].client_id));
+
+	client_send(client, jobj);
+}
+
+/*
+ * The engine_callback of the daemon: route the replies to the client of the
+ * command and the events to the clients subscribed.
+ */
+void control_callback(int status, struct json_object *jobj)
+{
+	struct json_object *id;
+	unsigned int request_id = 0;
+	int i;
+
+	json_object_object_add(jobj, key_status, json_object_new_int(status));
+
+	if (json_object_object_get_ex(jobj, key_request_id, &id))
+		request_id = json_object_get_int(id);
+
+	if (json_object_object_get_ex(jobj, key_changes, NULL)) {
+		send_changes(jobj);
+
+	} else if (json_object_object_get_ex(jobj, key_agent_msg, NULL) ||
+			json_object_object_get_ex(jobj, key_agent_error, NULL)) {
+		for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+			if (clients[i].fd >= 0 &&
+					clients[i].events & EVENT_AGENT)
+				client_send(&clients[i], jobj);
+		}
+
+	} else {
+		if (request_id != 0 && request_id == current_request_id)
+			current_answered = true;
+
+		send_reply(jobj, request_id);
+	}
+
+	json_object_put(jobj);
+}
+
+/*
+ * Disconnect the clients and remove the socket.
+ */
+void control_terminate(void)
+{
+	int i;
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		if (clients[i].fd >= 0)
+			client_close(&clients[i]);
+	}
+
+	if (listen_fd >= 0) {
+		loop_remove_fd(listen_fd);
+		close(listen_fd);
+		listen_fd = -1;
+	}
+
+	if (listen_path) {
+		unlink(listen_path);
+		free(listen_path);
+		listen_path = NULL;
+	}
+
+	for (i = 0; i < CONTROL_MAX_PENDING; i++) {
+		json_object_put(requests[i].client_id);
+		requests[i].client_id = NULL;
+		requests[i].id = 0;
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifndef __CONNMAN_CONTROL_H
+#define __CONNMAN_CONTROL_H
+
+#include <json.h>
+
+// Name of the socket in $XDG_RUNTIME_DIR, or in /run without it, see
+// control_default_path().
+#define CONTROL_DEFAULT_NAME "connman_json.sock"
+
+// Maximum number of clients connected at the same time.
+#define CONTROL_MAX_CLIENTS 32
+
+// Maximum length of a command line.
+#define CONTROL_LINE_MAX_LEN 8192
+
+// A client is disconnected if it doesn't read what's written to it and more
+// than this is waiting.
+#define CONTROL_OUT_MAX_LEN (1024 * 1024)
+
+// Number of commands remembered to route their replies, all clients included.
+#define CONTROL_MAX_PENDING 256
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char* control_default_path(void);
+
+int control_listen(const char *path);
+
+void control_callback(int status, struct json_object *jobj);
+
+void control_terminate(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
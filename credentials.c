@@ -0,0 +1,330 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <json.h>
+
+#include "json_utils.h"
+#include "keys.h"
+
+#include "credentials.h"
+
+/*
+ * This file keeps the answers to the agent "Input Requested" requests
+ * (Passphrase, Identity...), so the agent can answer connman at once without
+ * asking the user. The answers are loaded from a file at startup, and learned
+ * from the answers of the user only if credentials_remember_answers() allowed
+ * it: they stay in memory for the whole session. The credentials of a service are found by
+ * dbus name, by short dbus name (wifi_xxx_yyy_managed_psk), by hexadecimal
+ * SSID or by SSID:
+ * {
+ *	"MyNetwork": { "Passphrase": "secret" },
+ *	"wifi_0123456789ab_4d794e6574776f726b_managed_ieee8021x": {
+ *		"Identity": "user", "Passphrase": "secret"
+ *	}
+ * }
+ * The fields are checked with the trusted json of agent_response, see
+ * json_regex.c.
+ */
+
+// The trusted json of the agent answers, see generate_trusted_json().
+extern struct json_object *jregex_agent_response;
+
+// { "key": { "field": "value" } }
+static struct json_object *credentials;
+
+// Keep the answers of the user, see credentials_learn().
+static bool remember_answers = false;
+
+/*
+ * Return true if the fields can be sent to connman as they are.
+ */
+static bool fields_are_trusted(struct json_object *fields)
+{
+	struct json_object *trusted;
+
+	if (!jregex_agent_response || !json_object_object_get_ex(
+				jregex_agent_response, key_agent_msg_data,
+				&trusted))
+		return false;
+
+	if (json_object_get_type(fields) != json_type_object ||
+			json_object_object_length(fields) == 0)
+		return false;
+
+	return __json_type_dispatch(fields, trusted);
+}
+
+/*
+ * Add or replace the credentials of a service.
+ * Return 0, -EINVAL if the fields aren't valid agent answers.
+ * @param key dbus name, short dbus name, hexadecimal SSID or SSID
+ * @param fields { "field": "value" }, its reference count is incremented
+ */
+int credentials_add(const char *key, struct json_object *fields)
+{
+	if (!key || !fields_are_trusted(fields))
+		return -EINVAL;
+
+	if (!credentials)
+		credentials = json_object_new_object();
+
+	json_object_object_add(credentials, key, json_object_get(fields));
+
+	return 0;
+}
+
+/*
+ * Allow or forbid to keep the answers of the user, forbidden by default.
+ */
+void credentials_remember_answers(bool remember)
+{
+	remember_answers = remember;
+}
+
+/*
+ * Keep the answer of the user to an input request for the next connections,
+ * if credentials_remember_answers() allowed it.
+ * Return 0, -EPERM if answers aren't kept, -EINVAL if the fields aren't valid
+ * agent answers.
+ * @param serv_dbus_name the service
+ * @param fields { "field": "value" }, its reference count is incremented
+ */
+int credentials_learn(const char *serv_dbus_name, struct json_object *fields)
+{
+	if (!remember_answers)
+		return -EPERM;
+
+	return credentials_add(serv_dbus_name, fields);
+}
+
+/*
+ * Load the credentials in a file, see the format above. The jregex_* have to
+ * be generated (engine_init()).
+ * Return the number of credentials loaded, -ENOENT if the file can't be read,
+ * -EINVAL if an entry isn't valid (nothing is loaded then).
+ */
+int credentials_load(const char *path)
+{
+	struct json_object *file;
+	int nb = 0;
+
+	file = json_object_from_file((char *) path);
+
+	if (!file)
+		return -ENOENT;
+
+	if (json_object_get_type(file) != json_type_object) {
+		json_object_put(file);
+		return -EINVAL;
+	}
+
+	json_object_object_foreach(file, key, val) {
+		if (!fields_are_trusted(val) ||
+				strlen(key) >= CREDENTIALS_KEY_MAX_LEN) {
+			json_object_put(file);
+			return -EINVAL;
+		}
+	}
+
+	json_object_object_foreach(file, key2, val2) {
+		credentials_add(key2, val2);
+		nb++;
+	}
+
+	json_object_put(file);
+
+	return nb;
+}
+
+/*
+ * Extract the hexadecimal SSID of a wifi service dbus name:
+ * /net/connman/service/wifi_<address>_<ssid>_<mode>_<security>
+ * Return false if the service isn't a wifi service.
+ */
+static bool extract_ssid_hex(const char *serv_dbus_name, char *buf,
+		size_t size)
+{
+	const char *start, *end;
+	size_t i;
+
+	start = strstr(serv_dbus_name, "wifi_");
+
+	if (!start || !(start = strchr(start + 5, '_')))
+		return false;
+
+	start++;
+	end = strchr(start, '_');
+
+	if (!end || end == start || (size_t) (end - start) >= size ||
+			(end - start) % 2 != 0)
+		return false;
+
+	for (i = 0; start + i < end; i++) {
+		if (!isxdigit(start[i]))
+			return false;
+
+		buf[i] = start[i];
+	}
+
+	buf[i] = '\0';
+
+	return true;
+}
+
+/*
+ * Decode an hexadecimal SSID, in place.
+ * Return false if it isn't printable.
+ */
+static bool decode_ssid(char *ssid)
+{
+	unsigned int c;
+	size_t i, len = strlen(ssid);
+
+	for (i = 0; i < len / 2; i++) {
+		sscanf(ssid + i * 2, "%2x", &c);
+
+		if (!isprint(c))
+			return false;
+
+		ssid[i] = (char) c;
+	}
+
+	ssid[len / 2] = '\0';
+
+	return true;
+}
+
+/*
+ * Return the credentials of a service, NULL if none.
+ */
+static struct json_object* find(const char *serv_dbus_name)
+{
+	struct json_object *fields;
+	const char *short_name;
+	char ssid[CREDENTIALS_KEY_MAX_LEN];
+
+	if (!credentials || !serv_dbus_name)
+		return NULL;
+
+	if (json_object_object_get_ex(credentials, serv_dbus_name, &fields))
+		return fields;
+
+	short_name = strrchr(serv_dbus_name, '/');
+	short_name = short_name ? short_name + 1 : serv_dbus_name;
+
+	if (json_object_object_get_ex(credentials, short_name, &fields))
+		return fields;
+
+	if (!extract_ssid_hex(short_name, ssid, sizeof(ssid)))
+		return NULL;
+
+	if (json_object_object_get_ex(credentials, ssid, &fields))
+		return fields;
+
+	if (decode_ssid(ssid) &&
+			json_object_object_get_ex(credentials, ssid, &fields))
+		return fields;
+
+	return NULL;
+}
+
+/*
+ * Answer an "Input Requested" agent request with the credentials of the
+ * service.
+ * Return the answer (a new object), NULL if a mandatory field is unknown.
+ * @param serv_dbus_name the service
+ * @param requested the fields requested, see connman/doc/agent-api.txt:
+ *	{ "Passphrase": { "Type": "psk", "Requirement": "mandatory" }, ... }
+ */
+struct json_object* credentials_answer(const char *serv_dbus_name,
+		struct json_object *requested)
+{
+	struct json_object *fields, *answer, *value, *req;
+
+	fields = find(serv_dbus_name);
+
+	if (!fields || json_object_get_type(requested) != json_type_object)
+		return NULL;
+
+	answer = json_object_new_object();
+
+	json_object_object_foreach(requested, key, val) {
+		if (json_object_object_get_ex(fields, key, &value)) {
+			json_object_object_add(answer, key,
+					json_object_get(value));
+
+		} else if (json_object_object_get_ex(val, "Requirement", &req)
+				&& strcmp(json_object_get_string(req),
+					"mandatory") == 0) {
+			json_object_put(answer);
+			return NULL;
+		}
+	}
+
+	if (json_object_object_length(answer) == 0) {
+		json_object_put(answer);
+		return NULL;
+	}
+
+	return answer;
+}
+
+/*
+ * Forget the credentials of a service, e.g. connman reported they are wrong.
+ * The user will be asked the next time.
+ */
+void credentials_forget(const char *serv_dbus_name)
+{
+	const char *short_name;
+	char ssid[CREDENTIALS_KEY_MAX_LEN];
+
+	if (!credentials || !serv_dbus_name)
+		return;
+
+	json_object_object_del(credentials, serv_dbus_name);
+	short_name = strrchr(serv_dbus_name, '/');
+	short_name = short_name ? short_name + 1 : serv_dbus_name;
+	json_object_object_del(credentials, short_name);
+
+	if (!extract_ssid_hex(short_name, ssid, sizeof(ssid)))
+		return;
+
+	json_object_object_del(credentials, ssid);
+
+	if (decode_ssid(ssid))
+		json_object_object_del(credentials, ssid);
+}
+
+void credentials_clear(void)
+{
+	json_object_put(credentials);
+	credentials = NULL;
+}
@@ -0,0 +1,55 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifndef __CONNMAN_CREDENTIALS_H
+#define __CONNMAN_CREDENTIALS_H
+
+#include <stdbool.h>
+#include <json.h>
+
+// Maximum length of a key of the credentials (dbus name or SSID).
+#define CREDENTIALS_KEY_MAX_LEN 256
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int credentials_load(const char *path);
+
+int credentials_add(const char *key, struct json_object *fields);
+
+void credentials_remember_answers(bool remember);
+
+int credentials_learn(const char *serv_dbus_name, struct json_object *fields);
+
+struct json_object* credentials_answer(const char *serv_dbus_name,
+		struct json_object *requested);
+
+void credentials_forget(const char *serv_dbus_name);
+
+void credentials_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
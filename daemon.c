@@ -0,0 +1,216 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <dbus/dbus.h>
+
+#include "engine.h"
+#include "loop.h"
+#include "coalesce.h"
+#include "credentials.h"
+#include "control.h"
+
+/*
+ * Headless mode: the engine is driven through the control socket, see
+ * control.c.
+ */
+
+// The loop polls stdin for the ncurses client only.
+void ncurses_action(void)
+{
+}
+
+// Called after every dbus method return, see dbus_helpers.c.
+void callback_ended(void)
+{
+}
+
+static void stop_loop(int signum)
+{
+	loop_quit();
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-s socket] [-a bus] [-b messages] "
+			"[-B microseconds] [-c milliseconds] [-k file] [-K]\n"
+			"       [-w trace] [-r trace [-x speed]]\n"
+			"  -s  path of the control socket (default %s)\n"
+			"  -a  bus of connman: system (default), session or a "
+			"dbus address\n"
+			"  -b  dbus messages dispatched before polling the "
+			"clients again (default %d, 0: no limit)\n"
+			"  -B  time spent dispatching dbus messages before "
+			"polling the clients again (default %d, 0: no limit)\n"
+			"  -c  window coalescing PropertyChanged signals "
+			"(default %d, 0: per loop iteration)\n"
+			"  -k  json file of the credentials given to the agent "
+			"without asking\n"
+			"  -K  remember the credentials typed until the end of "
+			"the session\n"
+			"  -w  record the messages of connman in a trace file\n"
+			"  -r  replay a trace file instead of using a bus\n"
+			"  -x  speed of the replay: 1 (default) as recorded, n "
+			"times faster, 0 as fast as possible\n",
+			prog, control_default_path(), LOOP_DEFAULT_BUDGET_MSGS,
+			LOOP_DEFAULT_BUDGET_US, COALESCE_DEFAULT_WINDOW_MS);
+}
+
+/*
+ * Parse an unsigned integer option, exit on error.
+ */
+static unsigned int parse_uint_opt(const char *prog, const char *arg)
+{
+	char *end;
+	long val;
+
+	errno = 0;
+	val = strtol(arg, &end, 10);
+
+	if (errno || *end != '\0' || end == arg || val < 0) {
+		usage(prog);
+		exit(1);
+	}
+
+	return (unsigned int) val;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int budget_msgs = LOOP_DEFAULT_BUDGET_MSGS;
+	unsigned int budget_us = LOOP_DEFAULT_BUDGET_US;
+	const char *socket_path = control_default_path();
+	const char *credentials_path = NULL;
+	const char *record_path = NULL, *replay_path = NULL;
+	unsigned int replay_speed = 1;
+	int opt, res;
+
+	while ((opt = getopt(argc, argv, "s:a:b:B:c:k:Kw:r:x:h")) != -1) {
+		switch (opt) {
+			case 's':
+				socket_path = optarg;
+				break;
+
+			case 'a':
+				engine_set_bus(optarg);
+				break;
+
+			case 'b':
+				budget_msgs = parse_uint_opt(argv[0], optarg);
+				break;
+
+			case 'B':
+				budget_us = parse_uint_opt(argv[0], optarg);
+				break;
+
+			case 'c':
+				coalesce_set_window(parse_uint_opt(argv[0],
+							optarg));
+				break;
+
+			case 'k':
+				credentials_path = optarg;
+				break;
+
+			case 'K':
+				credentials_remember_answers(true);
+				break;
+
+			case 'w':
+				record_path = optarg;
+				break;
+
+			case 'r':
+				replay_path = optarg;
+				break;
+
+			case 'x':
+				replay_speed = parse_uint_opt(argv[0], optarg);
+				break;
+
+			default:
+				usage(argv[0]);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	engine_callback = control_callback;
+
+	// The startup replies are recorded (or replayed) too
+	if (record_path && (res = engine_record(record_path)) < 0) {
+		fprintf(stderr, "[-] Couldn't record in %s: %s\n",
+				record_path, strerror(-res));
+		exit(1);
+	}
+
+	if (replay_path && (res = engine_replay(replay_path,
+					replay_speed)) < 0) {
+		fprintf(stderr, "[-] Couldn't replay %s: %s\n", replay_path,
+				strerror(-res));
+		exit(1);
+	}
+
+	if (engine_init() < 0)
+		exit(1);
+
+	if (credentials_path &&
+			(res = credentials_load(credentials_path)) < 0) {
+		fprintf(stderr, "[-] Couldn't load the credentials in %s: %s\n",
+				credentials_path, strerror(-res));
+		engine_terminate();
+		exit(1);
+	}
+
+	signal(SIGINT, stop_loop);
+	signal(SIGTERM, stop_loop);
+
+	loop_init();
+	loop_set_dispatch_budget(budget_msgs, budget_us);
+
+	if ((res = control_listen(socket_path)) < 0) {
+		fprintf(stderr, "[-] Couldn't listen on %s: %s\n", socket_path,
+				strerror(-res));
+		engine_terminate();
+		exit(1);
+	}
+
+	loop_run(false);
+
+	control_terminate();
+	engine_terminate();
+
+	if (record_path && (res = engine_record_stop()) < 0)
+		fprintf(stderr, "[-] Couldn't record in %s: %s\n",
+				record_path, strerror(-res));
+	loop_terminate();
+
+	return 0;
+}
@@ -26,6 +26,9 @@
 #include <dbus/dbus.h>
 #include <json.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <stdio.h>
 #include <errno.h>
@@ -40,16 +43,40 @@
 struct dbus_callback {
 	connman_dbus_method_return_func_t cb;
 	void *user_data;
+	DBusMessage *call;	// only kept for dbus_reply_hook, can be NULL
 };
 
-static void dbus_method_reply(DBusPendingCall *call, void *user_data)
+// Hook given the replies of the bus with the call they answer, see
+// __cmd_record().
+extern void (*dbus_reply_hook)(DBusMessage *call, DBusMessage *reply);
+void (*dbus_reply_hook)(DBusMessage *call, DBusMessage *reply) = NULL;
+
+// A method call waiting for its reply without a bus, see dbus_set_offline().
+struct offline_call {
+	char *path;
+	char *member;
+	struct dbus_callback *callback;
+};
+
+// Are the method calls kept instead of being sent ?
+static bool offline = false;
+
+// The calls kept, the oldest first.
+static struct offline_call offline_calls[DBUS_OFFLINE_MAX_CALLS];
+
+// Count effective number of calls kept.
+static int offline_calls_count;
+
+// Method calls waiting for their reply, with or without a bus.
+static int pending_calls;
+
+/*
+ * Give the reply of a method call to its callback, then free the callback.
+ */
+static void method_return(DBusMessage *reply, struct dbus_callback *callback)
 {
-	struct dbus_callback *callback = user_data;
-	DBusMessage *reply;
 	DBusMessageIter iter;
 
-	reply = dbus_pending_call_steal_reply(call);
-	dbus_pending_call_unref(call);
 	if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
 		DBusError err;
 
@@ -69,9 +96,148 @@ end:
 	callback_ended();
 
 	free(callback);
+	pending_calls--;
+}
+
+static void dbus_method_reply(DBusPendingCall *call, void *user_data)
+{
+	DBusMessage *reply;
+
+	struct dbus_callback *callback = user_data;
+
+	reply = dbus_pending_call_steal_reply(call);
+	dbus_pending_call_unref(call);
+
+	if (callback->call) {
+		if (dbus_reply_hook)
+			dbus_reply_hook(callback->call, reply);
+
+		dbus_message_unref(callback->call);
+	}
+
+	method_return(reply, callback);
 	dbus_message_unref(reply);
 }
 
+/*
+ * Keep a method call until dbus_offline_reply() gives its reply.
+ */
+static int offline_call_keep(DBusMessage *message,
+		connman_dbus_method_return_func_t cb, void *user_data)
+{
+	struct offline_call *call;
+
+	if (!cb)
+		return -ENXIO;
+
+	if (offline_calls_count >= DBUS_OFFLINE_MAX_CALLS)
+		return -ENOMEM;
+
+	call = &offline_calls[offline_calls_count++];
+	call->path = strdup(dbus_message_get_path(message));
+	call->member = strdup(dbus_message_get_member(message));
+	call->callback = malloc(sizeof(struct dbus_callback));
+	assert(call->path && call->member && call->callback);
+	call->callback->cb = cb;
+	call->callback->user_data = user_data;
+	call->callback->call = NULL;
+	pending_calls++;
+
+	return -EINPROGRESS;
+}
+
+/*
+ * Fail the method calls waiting for their reply without a bus with a NoReply
+ * error. The calls sent by their callbacks are kept.
+ */
+void dbus_offline_cancel(void)
+{
+	struct offline_call calls[DBUS_OFFLINE_MAX_CALLS];
+	struct dbus_callback *callback;
+	int i, count = offline_calls_count;
+
+	memcpy(calls, offline_calls, sizeof(struct offline_call) * count);
+	offline_calls_count = 0;
+
+	for (i = 0; i < count; i++) {
+		callback = calls[i].callback;
+		callback->cb(NULL, DBUS_ERROR_NO_REPLY, callback->user_data);
+		callback_ended();
+		free(callback);
+		pending_calls--;
+		free(calls[i].path);
+		free(calls[i].member);
+	}
+}
+
+/*
+ * Run without a bus (or go back to the bus): the method calls aren't sent,
+ * they wait for their reply from dbus_offline_reply(), and the other messages
+ * (e.g. the replies of the agent) are dropped. This is how a trace of
+ * messages is replayed. Going back to the bus fails the calls still waiting
+ * with a NoReply error, see dbus_offline_cancel().
+ */
+void dbus_set_offline(bool enable)
+{
+	if (!enable)
+		dbus_offline_cancel();
+
+	offline = enable;
+}
+
+bool dbus_is_offline(void)
+{
+	return offline;
+}
+
+/*
+ * Return the number of method calls waiting for their reply.
+ */
+int dbus_pending_calls(void)
+{
+	return pending_calls;
+}
+
+/*
+ * Give a reply to the oldest call kept with the path and the member of the
+ * reply (see trace.c for how a reply tells the call it answers).
+ * Return 0 on success, -ENOENT if no call waits for this reply.
+ * @param reply a method return or an error, it isn't unreferenced here
+ */
+int dbus_offline_reply(DBusMessage *reply)
+{
+	struct dbus_callback *callback;
+	const char *path, *member;
+	int i;
+
+	path = dbus_message_get_path(reply);
+	member = dbus_message_get_member(reply);
+
+	if (!path || !member)
+		return -ENOENT;
+
+	for (i = 0; i < offline_calls_count; i++) {
+		if (strcmp(offline_calls[i].path, path) == 0 &&
+				strcmp(offline_calls[i].member, member) == 0)
+			break;
+	}
+
+	if (i == offline_calls_count)
+		return -ENOENT;
+
+	callback = offline_calls[i].callback;
+	free(offline_calls[i].path);
+	free(offline_calls[i].member);
+	offline_calls_count--;
+	memmove(&offline_calls[i], &offline_calls[i + 1],
+			sizeof(struct offline_call) * (offline_calls_count - i));
+
+	// The callback can send calls
+	method_return(reply, callback);
+
+	return 0;
+}
+
 int send_method_call(DBusConnection *connection,
 		DBusMessage *message, connman_dbus_method_return_func_t cb,
 		void *user_data)
@@ -80,6 +246,11 @@ int send_method_call(DBusConnection *connection,
 	DBusPendingCall *call;
 	struct dbus_callback *callback;
 
+	if (offline) {
+		res = offline_call_keep(message, cb, user_data);
+		goto end;
+	}
+
 	if (!dbus_connection_send_with_reply(connection, message, &call,
 				TIMEOUT))
 		goto end;
@@ -87,15 +258,21 @@ int send_method_call(DBusConnection *connection,
 	if (!call)
 		goto end;
 
-	if (cb) {
-		callback = malloc(sizeof(struct dbus_callback));
-		callback->cb = cb;
-		callback->user_data = user_data;
-		dbus_pending_call_set_notify(call, dbus_method_reply,
-				callback, NULL);
-		res = -EINPROGRESS;
+	if (!cb) {
+		// Nobody waits for the reply, as without a bus
+		dbus_pending_call_unref(call);
+		goto end;
 	}
 
+	callback = malloc(sizeof(struct dbus_callback));
+	assert(callback != NULL);
+	callback->cb = cb;
+	callback->user_data = user_data;
+	callback->call = dbus_reply_hook ? dbus_message_ref(message) : NULL;
+	dbus_pending_call_set_notify(call, dbus_method_reply, callback, NULL);
+	pending_calls++;
+	res = -EINPROGRESS;
+
 end:
         dbus_message_unref(message);
 	return res;
@@ -317,7 +494,10 @@ dbus_bool_t dbus_send_message(DBusConnection *connection, DBusMessage *message)
 	if (dbus_message_get_type(message) == DBUS_MESSAGE_TYPE_METHOD_CALL)
 		dbus_message_set_no_reply(message, TRUE);
 
-	result = dbus_connection_send(connection, message, NULL);
+	if (offline)
+		result = TRUE;
+	else
+		result = dbus_connection_send(connection, message, NULL);
 	dbus_message_unref(message);
 
 	return result;
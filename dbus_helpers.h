@@ -22,11 +22,15 @@
 #ifndef __CONNMAN_DBUS_HELPERS_H
 #define __CONNMAN_DBUS_HELPERS_H
 
+#include <stdbool.h>
 #include <dbus/dbus.h>
 #include <json.h>
 
 #define TIMEOUT           60000
 
+// Method calls waiting for their reply without a bus, see dbus_set_offline().
+#define DBUS_OFFLINE_MAX_CALLS 64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -39,6 +43,8 @@ typedef DBusMessage * (* DBusMethodFunction) (DBusConnection *connection,
  */
 extern void callback_ended(void);
 
+extern void (*dbus_reply_hook)(DBusMessage *call, DBusMessage *reply);
+
 typedef void (*connman_dbus_method_return_func_t)(DBusMessageIter *iter,
 		const char *error, void *user_data);
 
@@ -81,6 +87,16 @@ int dbus_set_property_array(DBusConnection *connection,
 		connman_dbus_append_func_t append_fn,
 		struct json_object *append_json_object);
 
+void dbus_set_offline(bool enable);
+
+void dbus_offline_cancel(void);
+
+bool dbus_is_offline(void);
+
+int dbus_pending_calls(void);
+
+int dbus_offline_reply(DBusMessage *reply);
+
 int send_method_call(DBusConnection *connection,
 		DBusMessage *message, connman_dbus_method_return_func_t cb,
 		void *user_data);
@@ -30,6 +30,7 @@
 #include <ncurses.h>
 
 #include "dbus_helpers.h"
+#include "stats.h"
 
 #include "dbus_json.h"
 
@@ -50,6 +51,8 @@ static struct json_object* _dbus_to_json(DBusMessageIter *iter);
 static struct json_object* dbus_basic_json(DBusMessageIter *iter)
 {
 	int arg_type, i;
+	unsigned char y;
+	dbus_uint16_t q;
 	dbus_bool_t b;
 	double d;
         char *str;
@@ -78,9 +81,18 @@ static struct json_object* dbus_basic_json(DBusMessageIter *iter)
                         res = json_object_new_boolean(1);
 		break;
 
+	// get_basic only writes the size of the type
 	case DBUS_TYPE_BYTE:
-	case DBUS_TYPE_INT32:
+		dbus_message_iter_get_basic(iter, &y);
+		res = json_object_new_int(y);
+		break;
+
 	case DBUS_TYPE_UINT16:
+		dbus_message_iter_get_basic(iter, &q);
+		res = json_object_new_int(q);
+		break;
+
+	case DBUS_TYPE_INT32:
 	case DBUS_TYPE_UINT32:
 		dbus_message_iter_get_basic(iter, &i);
                 res = json_object_new_int((int32_t) i);
@@ -176,7 +188,9 @@ static struct json_object* _dbus_to_json(DBusMessageIter *iter)
         case DBUS_TYPE_ARRAY:
                 dbus_message_iter_recurse(iter, &subiter);
 
-                if (dbus_message_iter_get_arg_type(&subiter) == DBUS_TYPE_DICT_ENTRY) 
+		// By signature: an empty dictionary is still a json object
+		if (dbus_message_iter_get_element_type(iter) ==
+				DBUS_TYPE_DICT_ENTRY)
                     res = dbus_dict_json(&subiter);
                 else
                     res = dbus_array_json(&subiter);
@@ -211,7 +225,10 @@ static struct json_object* _dbus_to_json(DBusMessageIter *iter)
  */
 struct json_object* dbus_to_json(DBusMessageIter *iter)
 {
-        struct json_object *res = NULL, *tmp = _dbus_to_json(iter);
+        struct json_object *res = NULL, *tmp;
+
+	stats_stage_begin(STATS_STAGE_DECODE);
+	tmp = _dbus_to_json(iter);
 
 	// This is useful for the TechnologyAdded signal for example
 	if (dbus_message_iter_next(iter) == TRUE) {
@@ -220,6 +237,8 @@ struct json_object* dbus_to_json(DBusMessageIter *iter)
 		json_object_array_add(res, _dbus_to_json(iter));
 	}
 
+	stats_stage_end(STATS_STAGE_DECODE);
+
         return (res == NULL ? tmp : res);
 }
 
@@ -25,17 +25,23 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
 #include <ncurses.h>
 
 #include "commands.h"
+#include "dbus_helpers.h"
 #include "json_utils.h"
 #include "loop.h"
 #include "dbus_json.h"
 #include "keys.h"
 #include "json_regex.h"
+#include "coalesce.h"
+#include "ranking.h"
+#include "credentials.h"
+#include "stats.h"
 
 #include "engine.h"
 
@@ -50,7 +56,7 @@
  * To achieve the first point the engine is whitelist based regarding the
  * commands and has a regex validation for data.
  * The engine also maintain a list of services, technologies and state (in
- * connman terms).
+ * connman terms). The services are also kept in order, see ranking.c.
  *
  * Due to the asynchronous nature of this connman interface, the engine will
  * listen for callbacks (from commands and agent) and will forward the callback
@@ -64,6 +70,9 @@ struct json_object *jregex_config_service;
 
 static DBusConnection *agent_dbus_conn;
 
+// The bus connman is on, see engine_set_bus().
+static const char *bus_name = NULL;
+
 // The callback the client has to implement / listen
 void (*engine_callback)(int status, struct json_object *jobj) = NULL;
 
@@ -79,6 +88,22 @@ static struct json_object *technologies;
 // The recorded services as given by connman-json
 static struct json_object *services;
 
+// Incremented on every change of the recorded data, see reply_query(). 64
+// bits never wrap: a wrap would make stale data look unchanged.
+static int64_t generation;
+
+// The generation of the last change of state, technologies and services.
+static int64_t state_gen, technologies_gen, services_gen;
+
+// Change records not yet sent to the client, see publish_change().
+static struct json_object *changes;
+
+// The order of the services changed since the last notification.
+static bool services_order_changed;
+
+// Request id of the query being executed, 0 if none, see engine_query().
+static unsigned int query_request_id;
+
 static void react_to_sig_service(struct json_object *interface,
 			struct json_object *path, struct json_object *data,
 			const char *sig_name);
@@ -91,9 +116,6 @@ static void react_to_sig_manager(struct json_object *interface,
 			struct json_object *path, struct json_object *data,
 			const char *sig_name);
 
-// This keep all agent related things, see agent.c
-static struct agent_data *agent_data_cache;
-
 /*
  * Forward callbacks from commands_callback (If the engine is not in state of
  * initialization)
@@ -102,14 +124,17 @@ static void engine_commands_cb(struct json_object *data, json_bool is_error)
 {
 	switch (init_status) {
 		case INIT_STATE:
+			json_object_put(state);
 			state = data;
 			break;
 
 		case INIT_TECHNOLOGIES:
+			json_object_put(technologies);
 			technologies = data;
 			break;
 
 		case INIT_SERVICES:
+			json_object_put(services);
 			services = data;
 			break;
 
@@ -123,25 +148,32 @@ static void engine_commands_cb(struct json_object *data, json_bool is_error)
 		loop_quit();
 }
 
+static struct json_object* get_service(const char *dbus_name);
+
 /*
- * Forward callbacks from the agent.
- * We only support a single agent request at the time. If an agent is already at
- * work, an error callback is emitted with the key_agent_error.
+ * Forward callbacks from the agent. Several agent requests can wait for an
+ * answer, the client answers with the key_agent_request_id of the request.
+ * The Name of the service is added to the message when the engine knows it.
  */
-static void engine_agent_cb(struct json_object *data, struct agent_data *request)
+static void engine_agent_cb(struct json_object *data)
 {
-	struct json_object *res;
-
-	if (agent_data_cache != NULL) {
-		res = json_object_new_object();
-		json_object_object_add(res, key_agent_error,
-				json_object_new_string("Already handling an "
-				"agent request"));
-		engine_callback(-ENOMEM, res);
-		return;
+	char serv_dbus_name[256];
+	struct json_object *serv_name, *serv, *name;
+
+	// The agent gives the short name of the service
+	if (json_object_object_get_ex(data, key_service, &serv_name)) {
+		snprintf(serv_dbus_name, 256, "/net/connman/service/%s",
+				json_object_get_string(serv_name));
+		serv_dbus_name[255] = '\0';
+		serv = get_service(serv_dbus_name);
+
+		if (serv && json_object_object_get_ex(
+					json_object_array_get_idx(serv, 1),
+					key_serv_name, &name))
+			json_object_object_add(data, key_serv_name,
+					json_object_get(name));
 	}
 
-	agent_data_cache = request;
 	engine_callback(0, data);
 }
 
@@ -153,30 +185,54 @@ static void engine_agent_error_cb(struct json_object *data)
 	engine_callback(-1, data);
 }
 
+/*
+ * Return the key_agent_request_id of the answer to an agent request, 0 if
+ * there is none.
+ */
+static unsigned int agent_request_id(struct json_object *data)
+{
+	struct json_object *id;
+
+	if (!json_object_object_get_ex(data, key_agent_request_id, &id))
+		return 0;
+
+	return json_object_get_int(id);
+}
+
 /*
  * Answer to an agent request (e.g. "Request Input").
+ * Return -EINVAL if the request doesn't wait for an answer (e.g. canceled).
  * @param data See json_regex, jregex_agent_response for format
  */
 static int agent_response(struct json_object *data)
 {
+	struct json_object *fields;
 	int res;
 
-	res = json_to_agent_response(data, agent_data_cache);
-	agent_data_cache = NULL;
+	if (!json_object_object_get_ex(data, key_agent_msg_data, &fields))
+		return -EINVAL;
 
-	return res;
+	res = json_to_agent_response(agent_request_id(data), fields);
+
+	return res == -ENOENT ? -EINVAL : res;
 }
 
 /*
  * Answer to an agent error regarding a request (e.g. "invalid-key").
- * @param data bool
+ * Return -EINVAL if the request doesn't wait for an answer (e.g. canceled).
+ * @param data See json_regex, jregex_agent_retry_response for format
  */
 static int agent_error_response(struct json_object *data)
 {
-	report_error_return(data, agent_data_cache);
-	agent_data_cache = NULL;
+	struct json_object *retry;
+	int res;
 
-	return -EINPROGRESS;
+	if (!json_object_object_get_ex(data, key_agent_msg_data, &retry))
+		return -EINVAL;
+
+	res = report_error_return(agent_request_id(data), retry);
+
+	return res == -ENOENT ? -EINVAL : res;
 }
 
 /*
@@ -193,13 +249,18 @@ static struct json_object* search_technology_or_service(
 	struct json_object *sub_array, *name;
 	const char *name_str;
 
-	if (!dbus_name)
+	if (!dbus_name || !ressource)
 		return NULL;
 
 	len = json_object_array_length(ressource);
 
 	for (i = 0; i < len && !found; i++) {
 		sub_array = json_object_array_get_idx(ressource, i);
+
+		// Removed services are NULL, see replace_service_in_services
+		if (!sub_array)
+			continue;
+
 		name = json_object_array_get_idx(sub_array, 0);
 		name_str = json_object_get_string(name);
 
@@ -232,11 +293,15 @@ static bool has_technology(const char *dbus_name)
 /*
  * Return the complete service record matching the dbus_name. If none can be
  * found, return NULL.
+ * The ranking is only built at the end of engine_init: a service it doesn't
+ * know yet is looked for in the services array.
  * @param dbus_name valid dbus name for a service
  */
 static struct json_object* get_service(const char *dbus_name)
 {
-	return search_technology_or_service(services, dbus_name);
+	struct json_object *serv = ranking_find(dbus_name);
+
+	return serv ? serv : search_technology_or_service(services, dbus_name);
 }
 
 /*
@@ -270,6 +335,160 @@ static struct json_object* coating(const char *cmd_name,
 	return res;
 }
 
+/*
+ * Record a change of a collection (state_gen, technologies_gen or
+ * services_gen).
+ */
+static void touch(int64_t *collection_gen)
+{
+	*collection_gen = ++generation;
+}
+
+/*
+ * Return true if the client already has the data of generation gen: the
+ * query holds the "generation" of the last reply the client got.
+ * @param query the data of the query, can be NULL
+ */
+static bool query_is_unchanged(struct json_object *query, int64_t gen)
+{
+	struct json_object *client_gen;
+
+	return query && json_object_object_get_ex(query, key_generation,
+			&client_gen) && json_object_get_int64(client_gen) >= gen;
+}
+
+/*
+ * Reply to a query on data last changed at generation gen. The reply holds
+ * the generation, the client sends it back with its next query: if nothing
+ * changed in between, it gets a short reply without data:
+ * {
+ *	"command": <cmd_name>,
+ *	"unchanged": true,
+ *	"generation": <gen>
+ * }
+ * @param query the data of the query, can be NULL
+ * @param data the data to send if it changed
+ */
+static void reply_query(const char *cmd_name, struct json_object *query,
+		int64_t gen, struct json_object *data)
+{
+	struct json_object *res;
+
+	if (query_is_unchanged(query, gen)) {
+		res = json_object_new_object();
+		json_object_object_add(res, key_command,
+				json_object_new_string(cmd_name));
+		json_object_object_add(res, key_unchanged,
+				json_object_new_boolean(TRUE));
+	} else
+		res = coating(cmd_name, data);
+
+	json_object_object_add(res, key_generation, json_object_new_int64(gen));
+
+	if (query_request_id)
+		json_object_object_add(res, key_request_id,
+				json_object_new_int(query_request_id));
+
+	engine_callback(0, res);
+}
+
+/*
+ * Queue a change record. The records queued during a loop iteration are sent
+ * to the client in one notification, see engine_changes_idle().
+ * @param kind key_change_kind_*
+ * @param collection key_state, key_technologies or key_services
+ * @param path the dbus name of the technology or service, NULL for the state
+ * Return the record, to add the details of the change.
+ */
+static struct json_object* publish_change(const char *kind,
+		const char *collection, const char *path)
+{
+	struct json_object *change;
+
+	if (!changes)
+		changes = json_object_new_array();
+
+	change = json_object_new_object();
+	json_object_object_add(change, key_change, json_object_new_string(kind));
+	json_object_object_add(change, key_change_collection,
+			json_object_new_string(collection));
+
+	if (path)
+		json_object_object_add(change, key_change_path,
+				json_object_new_string(path));
+
+	json_object_array_add(changes, change);
+
+	return change;
+}
+
+/*
+ * Set the value of a property and queue a change record:
+ * { "change": "property", "collection": ..., "path": ..., "property": key,
+ *   "old": previous value, "new": val }
+ * Return false if the property already had this value, nothing is done then.
+ * @param dict the state or the settings of a technology or service
+ * @param collection, path see publish_change()
+ * @param key the name of the property
+ * @param val the new value, its reference count is incremented
+ */
+static bool set_property(struct json_object *dict, const char *collection,
+		const char *path, const char *key, struct json_object *val)
+{
+	struct json_object *old, *change;
+
+	if (json_object_object_get_ex(dict, key, &old) &&
+			strcmp(json_object_to_json_string(old),
+				json_object_to_json_string(val)) == 0)
+		return false;
+
+	change = publish_change(key_change_kind_property, collection, path);
+	json_object_object_add(change, key_change_property,
+			json_object_new_string(key));
+	json_object_object_add(change, key_change_old, json_object_get(old));
+	json_object_object_add(change, key_change_new, json_object_get(val));
+
+	json_object_object_del(dict, key);
+	json_object_object_add(dict, key, json_object_get(val));
+
+	return true;
+}
+
+/*
+ * Loop idle function: send the change records queued during the iteration to
+ * the client in one notification, with the status code 0:
+ * { "changes": [ record, ... ] }
+ * Return -1, there is nothing to wait for.
+ */
+static int engine_changes_idle(void)
+{
+	struct json_object *jobj;
+
+	if (services_order_changed) {
+		publish_change(key_change_kind_order, key_services, NULL);
+		services_order_changed = false;
+	}
+
+	// The client gets the changes made during the initialisation later
+	if (!changes || !engine_callback)
+		return -1;
+
+	jobj = json_object_new_object();
+	json_object_object_add(jobj, key_changes, changes);
+	changes = NULL;
+	engine_callback(0, jobj);
+
+	return -1;
+}
+
+/*
+ * Return the most recent of two generations.
+ */
+static int64_t max_gen(int64_t a, int64_t b)
+{
+	return a > b ? a : b;
+}
+
 static int init_get_state(void)
 {
 	return __cmd_state();
@@ -291,10 +510,7 @@ static int init_get_services(void)
  */
 static int get_state(struct json_object *jobj)
 {
-	struct json_object *res;
-
-	res = coating(key_engine_get_state, state);
-	engine_callback(0, res);
+	reply_query(key_engine_get_state, jobj, state_gen, state);
 
 	return -EINPROGRESS;
 }
@@ -305,10 +521,7 @@ static int get_state(struct json_object *jobj)
  */
 static int get_services(struct json_object *jobj)
 {
-	struct json_object *res;
-
-	res = coating(key_engine_get_services, services);
-	engine_callback(0, res);
+	reply_query(key_engine_get_services, jobj, services_gen, services);
 
 	return -EINPROGRESS;
 }
@@ -319,10 +532,8 @@ static int get_services(struct json_object *jobj)
  */
 static int get_technologies(struct json_object *jobj)
 {
-	struct json_object *res;
-
-	res = coating(key_engine_get_technologies, technologies);
-	engine_callback(0, res);
+	reply_query(key_engine_get_technologies, jobj, technologies_gen,
+			technologies);
 
 	return -EINPROGRESS;
 }
@@ -350,7 +561,8 @@ static int get_home_page(struct json_object *jobj)
 	json_object_object_add(res, key_state, json_object_get(state));
 	json_object_object_add(res, key_technologies, json_object_get(technologies));
 
-	engine_callback(0, coating(key_engine_get_home_page, res));
+	reply_query(key_engine_get_home_page, jobj,
+			max_gen(state_gen, technologies_gen), res);
 
 	// coating increment ref count of res, but creating a new object already
 	// increment the ref count of res
@@ -363,45 +575,15 @@ static int get_home_page(struct json_object *jobj)
  * Return an array of relevant services matching a technology type:
  * If the technology is connected, the connected technology is returned.
  * If not, all services compatible with the technology are returned.
+ * The services are in the order of ranking.c, the array is shared: it must not
+ * be modified.
  * @param technology technology type
  * @param is_connected do we look for the connected service ?
  */
 static struct json_object* get_services_matching_tech_type(const char
 		*technology, bool is_connected)
 {
-	struct json_object *array_serv, *serv_dict, *serv_type, *res;
-	struct json_object *serv_state;
-	int len, i;
-	bool is_online, is_ready;
-
-	res = json_object_new_array();
-	len = json_object_array_length(services);
-
-	for (i = 0; i < len; i++) {
-		array_serv = json_object_array_get_idx(services, i);
-		serv_dict = json_object_array_get_idx(array_serv, 1);
-		json_object_object_get_ex(serv_dict, "Type", &serv_type);
-
-		if (strncmp(json_object_get_string(serv_type), technology, 256) == 0) {
-			json_object_object_get_ex(serv_dict, "State", &serv_state);
-
-			is_online = strncmp(json_object_get_string(serv_state),
-					"online", 256) == 0;
-			is_ready = strncmp(json_object_get_string(serv_state),
-					"ready", 256) == 0;
-
-			// Do we look for something we are connected to ?
-			//	Yes -> is the service online / ready ?
-			//		No -> continue search
-			//		Yes -> remember the service
-			if (is_connected && !(is_online || is_ready))
-				continue;
-
-			json_object_array_add(res, json_object_get(array_serv));
-		}
-	}
-
-	return res;
+	return ranking_services(technology, is_connected);
 }
 
 /*
@@ -413,6 +595,7 @@ static int get_services_from_tech(struct json_object *jobj)
 	struct json_object *tmp, *res, *res_serv, *res_tech, *tech_dict,
 			   *jtech_type, *tech_co;
 	const char *tech_dbus_name, *tech_type;
+	int64_t gen;
 
 	json_object_object_get_ex(jobj, key_technology, &tmp);
 	tech_dbus_name = json_object_get_string(tmp);
@@ -421,6 +604,13 @@ static int get_services_from_tech(struct json_object *jobj)
 	if (res_tech == NULL)
 		return -EINVAL;
 
+	gen = max_gen(technologies_gen, services_gen);
+
+	if (query_is_unchanged(jobj, gen)) {
+		reply_query(key_engine_get_services_from_tech, jobj, gen, NULL);
+		return -EINPROGRESS;
+	}
+
 	json_object_get(res_tech);
 	tech_dict = json_object_array_get_idx(res_tech, 1);
 	json_object_object_get_ex(tech_dict, "Type", &jtech_type);
@@ -433,7 +623,7 @@ static int get_services_from_tech(struct json_object *jobj)
 	res = json_object_new_object();
 	json_object_object_add(res, key_services, res_serv);
 	json_object_object_add(res, key_technology, res_tech);
-	engine_callback(0, coating(key_engine_get_services_from_tech, res));
+	reply_query(key_engine_get_services_from_tech, jobj, gen, res);
 	json_object_put(res);
 
 	return -EINPROGRESS;
@@ -611,8 +801,131 @@ static int engine_get_service(struct json_object *jobj)
 
 	json_object_object_get_ex(jobj, key_service, &tmp);
 	serv_dbus_name = json_object_get_string(tmp);
-	tmp = coating(key_engine_get_service, get_service(serv_dbus_name));
-	engine_callback(0, tmp);
+	reply_query(key_engine_get_service, jobj, services_gen,
+			get_service(serv_dbus_name));
+
+	return -EINPROGRESS;
+}
+
+/*
+ * Restrict the Service signals received to the services listed, see
+ * __cmd_watch_services() in commands.c. Services unknown to the engine are
+ * ignored.
+ * @param jobj NULL to watch no service, or:
+ * {
+ *	"services": [ "service dbus name", ... ], (optional)
+ *	"properties": [ "Strength", ... ] (optional, every property if missing)
+ * }
+ */
+static int watch_services(struct json_object *jobj)
+{
+	struct json_object *serv_list, *props, *known, *elem;
+	int i;
+
+	json_object_object_get_ex(jobj, key_services, &serv_list);
+	json_object_object_get_ex(jobj, key_properties, &props);
+	known = json_object_new_array();
+
+	for (i = 0; serv_list && i < json_object_array_length(serv_list); i++) {
+		elem = json_object_array_get_idx(serv_list, i);
+
+		if (has_service(json_object_get_string(elem)))
+			json_object_array_add(known, json_object_get(elem));
+	}
+
+	// The match rules are sent asynchronously, there is no reply
+	__cmd_watch_services(known, props);
+	json_object_put(known);
+
+	return 0;
+}
+
+/*
+ * Add the memory used by a collection to memory:
+ * { "objects": number of json objects, "bytes": estimated size }
+ * and to the totals in fp.
+ */
+static void add_footprint(struct json_object *memory, const char *name,
+		struct json_footprint *collection_fp, struct json_footprint *fp)
+{
+	struct json_object *jfp = json_object_new_object();
+
+	json_object_object_add(jfp, "objects",
+			json_object_new_int(collection_fp->objects));
+	json_object_object_add(jfp, "bytes",
+			json_object_new_int64(collection_fp->bytes));
+	json_object_object_add(memory, name, jfp);
+	fp->objects += collection_fp->objects;
+	fp->bytes += collection_fp->bytes;
+}
+
+/*
+ * Return via engine_callback stats_to_json() (see stats.c), with the memory
+ * used by the engine added to its "memory":
+ * {
+ *	"rss_bytes": ..., "heap_bytes": ...,
+ *	"json_objects": 1234,
+ *	"json_bytes": 98765,
+ *	"collections": {
+ *		"state": { "objects": 7, "bytes": 560 },
+ *		"technologies": { ... },
+ *		"services": { ... },
+ *		"changes": { ... },
+ *		"ranking": { ... }
+ *	},
+ *	"pending_calls": 0,
+ *	"agent_requests": 0
+ * }
+ * The sizes of the json objects are estimated, see __json_footprint(). In a
+ * steady state, none of the figures grows.
+ * @param jobj not used
+ */
+static int get_stats(struct json_object *jobj)
+{
+	struct json_object *stats, *memory, *collections, *res;
+	struct json_footprint fp = { 0, 0 }, collection_fp;
+	struct { const char *name; struct json_object *jobj; } walked[] = {
+		{ key_state, state },
+		{ key_technologies, technologies },
+		{ key_services, services },
+		{ key_changes, changes },
+	};
+	unsigned int i;
+
+	collections = json_object_new_object();
+
+	for (i = 0; i < sizeof(walked) / sizeof(walked[0]); i++) {
+		collection_fp.objects = 0;
+		collection_fp.bytes = 0;
+		__json_footprint(walked[i].jobj, &collection_fp);
+		add_footprint(collections, walked[i].name, &collection_fp, &fp);
+	}
+
+	collection_fp.objects = 0;
+	collection_fp.bytes = 0;
+	ranking_footprint(&collection_fp);
+	add_footprint(collections, "ranking", &collection_fp, &fp);
+
+	stats = stats_to_json();
+	json_object_object_get_ex(stats, "memory", &memory);
+	json_object_object_add(memory, "json_objects",
+			json_object_new_int(fp.objects));
+	json_object_object_add(memory, "json_bytes",
+			json_object_new_int64(fp.bytes));
+	json_object_object_add(memory, "collections", collections);
+	json_object_object_add(memory, "pending_calls",
+			json_object_new_int(dbus_pending_calls()));
+	json_object_object_add(memory, "agent_requests",
+			json_object_new_int(agent_pending_requests()));
+
+	res = coating(key_engine_get_stats, stats);
+	json_object_put(stats);
+
+	if (query_request_id)
+		json_object_object_add(res, key_request_id,
+				json_object_new_int(query_request_id));
+
+	engine_callback(0, res);
 
 	return -EINPROGRESS;
 }
@@ -637,12 +950,15 @@ static struct {
 		struct json_object *trusted_jobj;
 	} trusted;
 } cmd_table[] = {
-	{ key_engine_get_state, get_state, true, { "" } },
-	{ key_engine_get_services, get_services, true, { "" } },
-	{ key_engine_get_technologies, get_technologies, true, { "" } },
-	{ key_engine_get_home_page, get_home_page, true, { "" } },
+	{ key_engine_get_state, get_state, true, { key_engine_query_regex } },
+	{ key_engine_get_services, get_services, true, {
+		key_engine_query_regex } },
+	{ key_engine_get_technologies, get_technologies, true, {
+		key_engine_query_regex } },
+	{ key_engine_get_home_page, get_home_page, true, {
+		key_engine_query_regex } },
 	{ key_engine_get_services_from_tech, get_services_from_tech, true, {
-		key_engine_tech_regex } },
+		key_engine_tech_query_regex } },
 	{ key_engine_connect, connect_to_service, true, {
 		key_engine_serv_regex } },
 	{ key_engine_disconnect, disconnect_technology, true, {
@@ -658,7 +974,10 @@ static struct {
 	{ key_engine_remove_service, remove_service, true, {
 		key_engine_serv_regex } },
 	{ key_engine_get_service, engine_get_service, true, {
-		key_engine_serv_regex } },
+		key_engine_serv_query_regex } },
+	{ key_engine_watch_services, watch_services, true, {
+		key_engine_watch_regex } },
+	{ key_engine_get_stats, get_stats, true, { key_engine_stats_regex } },
 	{ NULL, }, // this is a sentinel
 };
 
@@ -718,7 +1037,9 @@ static bool command_data_is_clean(struct json_object *jobj, int cmd_pos)
 
 	assert(jcmd_data != NULL);
 
+	stats_stage_begin(STATS_STAGE_VALIDATE);
 	res = __json_type_dispatch(jobj, jcmd_data);
+	stats_stage_end(STATS_STAGE_VALIDATE);
 
 	if (cmd_table[cmd_pos].trusted_is_json_string)
 		json_object_put(jcmd_data);
@@ -728,8 +1049,8 @@ static bool command_data_is_clean(struct json_object *jobj, int cmd_pos)
 
 /*
  * The signal callback, this will dispatch the signal received to the
- * appropriate signal action. Currently the callback emitted to the client has a
- * 12345 status code.
+ * appropriate signal action. The signal isn't forwarded to the client, the
+ * actions publish what they changed, see publish_change().
  * @param jobj expected json:
  * {
  *	"interface": STRING
@@ -753,6 +1074,8 @@ static void engine_commands_sig(struct json_object *jobj)
 	json_object_object_get_ex(jobj, key_signal, &sig_name);
 	sig_name_str = json_object_get_string(sig_name);
 
+	stats_stage_begin(STATS_STAGE_APPLY);
+
 	if (strcmp(interface_str, "Service") == 0)
 		react_to_sig_service(interface, path, data, sig_name_str);
 
@@ -762,7 +1085,9 @@ static void engine_commands_sig(struct json_object *jobj)
 	else // Manager
 		react_to_sig_manager(interface, path, data, sig_name_str);
 
-	engine_callback(12345, jobj);
+	stats_stage_end(STATS_STAGE_APPLY);
+
+	json_object_put(jobj);
 }
 
 /*
@@ -779,7 +1104,7 @@ static void react_to_sig_service(struct json_object *interface,
 
 	snprintf(serv_dbus_name, 256, "/net/connman/service/%s", json_object_get_string(path));
 	serv_dbus_name[255] = '\0';
-	serv = search_technology_or_service(services, serv_dbus_name);
+	serv = get_service(serv_dbus_name);
 
 	if (!serv)
 		return;
@@ -788,9 +1113,15 @@ static void react_to_sig_service(struct json_object *interface,
 	val = json_object_array_get_idx(data, 1);
 	serv_dict = json_object_array_get_idx(serv, 1);
 
-	if (serv_dict && json_object_object_get_ex(serv_dict, key, NULL)) {
-		json_object_object_del(serv_dict, key);
-		json_object_object_add(serv_dict, key, json_object_get(val));
+	if (serv_dict && json_object_object_get_ex(serv_dict, key, NULL) &&
+			set_property(serv_dict, key_services, serv_dbus_name,
+				key, val)) {
+		if (ranking_is_sort_property(key)) {
+			ranking_update(serv);
+			services_order_changed = true;
+		}
+
+		touch(&services_gen);
 	}
 }
 
@@ -818,23 +1149,41 @@ static void react_to_sig_technology(struct json_object *interface,
 	val = json_object_array_get_idx(data, 1);
 	tech_dict = json_object_array_get_idx(tech, 1);
 
-	if (tech_dict && json_object_object_get_ex(tech_dict, key, NULL)) {
-		json_object_object_del(tech_dict, key);
-		json_object_object_add(tech_dict, key, json_object_get(val));
+	if (tech_dict && json_object_object_get_ex(tech_dict, key, NULL) &&
+			set_property(tech_dict, key_technologies,
+				tech_dbus_name, key, val))
+		touch(&technologies_gen);
+}
+
+/*
+ * Set the settings of a service property by property, see set_property().
+ * Return true if the order of the services may have changed.
+ */
+static bool update_service_settings(const char *serv_name,
+		struct json_object *old_dict, struct json_object *serv_dict)
+{
+	bool reorder = false;
+
+	json_object_object_foreach(serv_dict, key, val) {
+		if (set_property(old_dict, key_services, serv_name, key, val) &&
+				ranking_is_sort_property(key))
+			reorder = true;
 	}
+
+	return reorder;
 }
 
 /*
  * This function replace the settings of a service if it already exists, add it
  * if it doesn't in services global variable. If serv_dict is NULL, the service
- * is removed.
+ * is removed. The changes are published, see publish_change().
  * @param serv_name the dbus service name
  * @param serv_dict the settings of the service
  */
 static void replace_service_in_services(const char *serv_name,
 		struct json_object *serv_dict)
 {
-	struct json_object *sub_array, *tmp;
+	struct json_object *sub_array, *tmp, *old_dict;
 	int i, len;
 	bool found = false;
 
@@ -849,16 +1198,32 @@ static void replace_service_in_services(const char *serv_name,
 		tmp = json_object_array_get_idx(sub_array, 0);
 
 		if (tmp && strcmp(json_object_get_string(tmp), serv_name) == 0) {
-			if (serv_dict)
+			old_dict = json_object_array_get_idx(sub_array, 1);
+
+			if (serv_dict && old_dict) {
+				if (update_service_settings(serv_name,
+							old_dict, serv_dict)) {
+					ranking_update(sub_array);
+					services_order_changed = true;
+				}
+
+			} else if (serv_dict) {
 				json_object_array_put_idx(sub_array, 1,
 						json_object_get(serv_dict));
-			else {
+				ranking_update(sub_array);
+				services_order_changed = true;
+
+			} else {
 				/*
 				 * There isn't a function to remove something
 				 * from an array so we set the service as a
 				 * null pointer.
 				 */
+				publish_change(key_change_kind_removed,
+						key_services, serv_name);
+				ranking_remove(serv_name);
 				json_object_array_put_idx(services, i, NULL);
+				services_order_changed = true;
 			}
 
 			found = true;
@@ -870,6 +1235,9 @@ static void replace_service_in_services(const char *serv_name,
 		json_object_array_add(tmp, json_object_new_string(serv_name));
 		json_object_array_add(tmp, json_object_get(serv_dict));
 		json_object_array_add(services, tmp);
+		ranking_update(tmp);
+		publish_change(key_change_kind_added, key_services, serv_name);
+		services_order_changed = true;
 	}
 }
 
@@ -886,7 +1254,18 @@ static void react_to_sig_manager(struct json_object *interface,
 			   *tmp, *tmp_array, *better_services, *elem;
 	int i, len;
 
+	// A signal received during engine_init() can come before the
+	// collection it changes, whose reply then has the change
+	if (!services && strcmp(sig_name, key_sig_serv_changed) == 0)
+		return;
+
+	if (!technologies && (strcmp(sig_name, key_sig_tech_added) == 0 ||
+				strcmp(sig_name, key_sig_tech_removed) == 0))
+		return;
+
 	if (strcmp(sig_name, key_sig_serv_changed) == 0) {
+		touch(&services_gen);
+
 		// remove services (they disappeared)
 		serv_to_del = json_object_array_get_idx(data, 1);
 		len = json_object_array_length(serv_to_del);
@@ -904,13 +1283,12 @@ static void react_to_sig_manager(struct json_object *interface,
 			for (i = 0; i < json_object_array_length(services); i++) {
 				elem = json_object_array_get_idx(services, i);
 
-				if (elem != NULL) {
-					// No need to increment the refcount here,
-					// we just need a copy of the pointers.
-					json_object_array_add(better_services, elem);
-				}
+				if (elem != NULL)
+					json_object_array_add(better_services,
+							json_object_get(elem));
 			}
 
+			json_object_put(services);
 			services = better_services;
 		}
 
@@ -923,7 +1301,7 @@ static void react_to_sig_manager(struct json_object *interface,
 			serv_dict = json_object_array_get_idx(sub_array, 1);
 
 			// if the service have been "modified"
-			if (json_object_array_length(serv_dict)) {
+			if (json_object_object_length(serv_dict)) {
 				tmp_str = json_object_get_string(
 						json_object_array_get_idx(sub_array, 0));
 				replace_service_in_services(tmp_str, serv_dict);
@@ -940,15 +1318,24 @@ static void react_to_sig_manager(struct json_object *interface,
 		 */
 		tmp_str = json_object_get_string(json_object_array_get_idx(data,
 					0));
-		json_object_object_del(state, tmp_str);
-		json_object_object_add(state, tmp_str,
-				json_object_get(json_object_array_get_idx(data, 1)));
+
+		// Before the state is got at init, its reply has the new value
+		if (state && set_property(state, key_state, NULL, tmp_str,
+					json_object_array_get_idx(data, 1)))
+			touch(&state_gen);
 
 	} else if (strcmp(sig_name, key_sig_tech_added) == 0) {
 		json_object_array_add(technologies, json_object_get(data));
+		publish_change(key_change_kind_added, key_technologies,
+				json_object_get_string(
+					json_object_array_get_idx(data, 0)));
+		touch(&technologies_gen);
 
 	} else if (strcmp(sig_name, key_sig_tech_removed) == 0) {
+		touch(&technologies_gen);
 		tmp_str = json_object_get_string(data);
+		publish_change(key_change_kind_removed, key_technologies,
+				tmp_str);
 		tmp_array = json_object_new_array();
 		len = json_object_array_length(technologies);
 
@@ -958,45 +1345,183 @@ static void react_to_sig_manager(struct json_object *interface,
 			tmp = json_object_array_get_idx(sub_array, 0);
 			assert(tmp != NULL);
 
-			if (strcmp(tmp_str, json_object_get_string(tmp)) != 0) {
-				json_object_array_add(tmp_array, sub_array);
-			}
+			if (strcmp(tmp_str, json_object_get_string(tmp)) != 0)
+				json_object_array_add(tmp_array,
+						json_object_get(sub_array));
 		}
 
+		json_object_put(technologies);
 		technologies = tmp_array;
-		json_object_get(technologies);
 	}
 
 	// We ignore PeersChanged: we don't support P2P
 }
 
+/*
+ * Return the request id of a command, 0 if it has none and -1 if it isn't
+ * valid (not a positive integer).
+ */
+static int get_request_id(struct json_object *jobj)
+{
+	struct json_object *id;
+	int res;
+
+	if (!json_object_object_get_ex(jobj, key_request_id, &id))
+		return 0;
+
+	if (!json_object_is_type(id, json_type_int))
+		return -1;
+
+	res = json_object_get_int(id);
+
+	return res > 0 ? res : -1;
+}
+
 /*
  * This is the entry point for the client. Return -EINVAL if the command isn't
  * found or the data don't pass validation, -EINPROGRESS if everything went
- * right.
+ * right and the reply comes through engine_callback (at once if the engine
+ * has the data), 0 if the command is done and nothing will come (e.g.
+ * watch_services).
+ * The command can hold a request id, any positive integer chosen by the client:
+ * { "command": ..., "cmd_data": ..., "request_id": 42 }
+ * The replies of the command carry it (key_request_id), this is how replies of
+ * commands sent at the same time are told apart: replies of connman come in
+ * any order.
+ * @param jobj the command, the ownership is transferred
  */
 int engine_query(struct json_object *jobj)
 {
 	const char *command_str = NULL;
-	int res, cmd_pos;
+	int res, cmd_pos, request_id;
 	struct json_object *jcmd_data;
 
 	command_str = __json_get_command_str(jobj);
+	request_id = get_request_id(jobj);
 
-	if (!command_str || (cmd_pos = command_exist(command_str)) < 0)
+	if (!command_str || (cmd_pos = command_exist(command_str)) < 0 ||
+			request_id < 0) {
+		json_object_put(jobj);
 		return -EINVAL;
+	}
 
 	json_object_object_get_ex(jobj, key_command_data, &jcmd_data);
 
-	if (jcmd_data != NULL && !command_data_is_clean(jcmd_data, cmd_pos))
+	if (jcmd_data != NULL && !command_data_is_clean(jcmd_data, cmd_pos)) {
+		json_object_put(jobj);
 		return -EINVAL;
+	}
 
+	query_request_id = request_id;
+	__cmd_set_request_id(request_id);
 	res = cmd_table[cmd_pos].func(jcmd_data);
+	__cmd_set_request_id(0);
+	query_request_id = 0;
 	json_object_put(jobj);
 
 	return res;
 }
 
+/*
+ * Receive the Service signals of every service, on top of the services
+ * watched with key_engine_watch_services (e.g. for a client which doesn't
+ * know which services it needs), see __cmd_monitor() in commands.c.
+ * @param all false to only receive the signals watched
+ */
+void engine_watch_all_services(bool all)
+{
+	struct json_object *jobj, *jarray;
+
+	jobj = json_object_new_object();
+	jarray = json_object_new_array();
+	json_object_array_add(jarray, json_object_new_string("Service"));
+	json_object_object_add(jobj, all ? "monitor_add" : "monitor_del",
+			jarray);
+
+	__cmd_monitor(jobj);
+	json_object_put(jobj);
+}
+
+/*
+ * Choose the bus connman is on, to be called before engine_init().
+ * @param bus "system" (the default), "session", a dbus address, e.g.
+ *	"unix:path=/tmp/mock_bus", or "offline" for no bus at all: the
+ *	messages of connman come from a trace replayed, see __cmd_replay().
+ *	The string must outlive the engine.
+ */
+void engine_set_bus(const char *bus)
+{
+	bus_name = bus;
+}
+
+/*
+ * Replay a trace of the messages of connman instead of using a bus, to be
+ * called before engine_init(), see __cmd_replay().
+ * Return 0 on success, -errno if the trace can't be opened.
+ * @param path the trace file, written by engine_record() or connman_mock
+ * @param speed 1 for the speed of the recording, n for n times faster, 0 for
+ *	as fast as possible
+ */
+int engine_replay(const char *path, unsigned int speed)
+{
+	bus_name = "offline";
+
+	return __cmd_replay(path, speed);
+}
+
+/*
+ * Record the messages of connman in a trace until engine_record_stop(), to be
+ * called before engine_init() so the trace can be replayed with
+ * engine_replay(). See __cmd_record().
+ * Return 0 on success, -errno if the trace can't be created.
+ */
+int engine_record(const char *path)
+{
+	return __cmd_record(path);
+}
+
+/*
+ * Stop the recording and close the trace.
+ * Return 0 on success, -errno if the trace couldn't be written.
+ */
+int engine_record_stop(void)
+{
+	return __cmd_record_stop();
+}
+
+/*
+ * Return a shared connection to the bus chosen with engine_set_bus(), NULL on
+ * error (err is set) or if there is no bus.
+ */
+static DBusConnection* bus_get(DBusError *err)
+{
+	DBusConnection *conn;
+
+	if (dbus_is_offline())
+		return NULL;
+
+	if (!bus_name || strcmp(bus_name, "system") == 0)
+		return dbus_bus_get(DBUS_BUS_SYSTEM, err);
+
+	if (strcmp(bus_name, "session") == 0)
+		return dbus_bus_get(DBUS_BUS_SESSION, err);
+
+	conn = dbus_connection_open(bus_name, err);
+
+	if (!conn)
+		return NULL;
+
+	// The connection is shared, it's registered once
+	if (!dbus_bus_get_unique_name(conn) && !dbus_bus_register(conn, err)) {
+		dbus_connection_unref(conn);
+		return NULL;
+	}
+
+	dbus_connection_set_exit_on_disconnect(conn, TRUE);
+
+	return conn;
+}
+
 /*
  * The engine will initialize itself.
  * Dbus connections, callbacks, loop and cmd_table json object based validation
@@ -1008,11 +1533,12 @@ int engine_init(void)
 {
 	DBusError dbus_err;
 	struct json_object *jobj, *jarray;
-	int res = 0;
+	int res = 0, i;
 
 	// Getting dbus connection
+	dbus_set_offline(bus_name && strcmp(bus_name, "offline") == 0);
 	dbus_error_init(&dbus_err);
-	connection = dbus_bus_get(DBUS_BUS_SYSTEM, &dbus_err);
+	connection = bus_get(&dbus_err);
 
 	if (dbus_error_is_set(&dbus_err)) {
 		printf("\n[-] Error getting connection: %s\n", dbus_err.message);
@@ -1022,7 +1548,7 @@ int engine_init(void)
 
 	// Getting dbus connection for the agent
 	dbus_error_init(&dbus_err);
-	agent_dbus_conn = dbus_bus_get(DBUS_BUS_SYSTEM, &dbus_err);
+	agent_dbus_conn = bus_get(&dbus_err);
 
 	if (dbus_error_is_set(&dbus_err)) {
 		printf("\n[-] Error getting agent_dbus_conn: %s\n", dbus_err.message);
@@ -1032,15 +1558,18 @@ int engine_init(void)
 
 	// Callback affectation
 	commands_callback = engine_commands_cb;
-	commands_signal = engine_commands_sig;
+	commands_signal = coalesce_push;
+	coalesce_deliver = engine_commands_sig;
+	loop_add_idle(coalesce_idle);
+	loop_add_idle(engine_changes_idle);
 	agent_callback = engine_agent_cb;
 	agent_error_callback = engine_agent_error_cb;
 
-	// We monitor everything
+	// We monitor everything but services, the client tells which services
+	// it displays with key_engine_watch_services
 	jobj = json_object_new_object();
 	jarray = json_object_new_array();
 	json_object_array_add(jarray, json_object_new_string("Manager"));
-	json_object_array_add(jarray, json_object_new_string("Service"));
 	json_object_array_add(jarray, json_object_new_string("Technology"));
 	json_object_object_add(jobj, "monitor_add", jarray);
 
@@ -1050,6 +1579,9 @@ int engine_init(void)
 	if (res != -EINPROGRESS)
 		return res;
 
+	if ((res = __cmd_watch_services(NULL, NULL)) != -EINPROGRESS)
+		return res;
+
 	// We need the loop to get callbacks to init our things
 	loop_init();
 	init_status = INIT_STATE;
@@ -1079,8 +1611,10 @@ int engine_init(void)
 	loop_run(false);
 	init_status = INIT_OVER;
 
+	for (i = 0; i < json_object_array_length(services); i++)
+		ranking_update(json_object_array_get_idx(services, i));
+
 	agent_register(agent_dbus_conn);
-	agent_data_cache = NULL;
 	generate_trusted_json(); // See init_cmd_table()
 	init_cmd_table();
 
@@ -1092,13 +1626,28 @@ int engine_init(void)
  */
 void engine_terminate(void)
 {
+	// Without a bus, the calls left unanswered by the trace fail here,
+	// while the engine and the client are still there
+	if (dbus_is_offline())
+		dbus_set_offline(false);
+
 	json_object_put(technologies);
 	json_object_put(services);
 	json_object_put(state);
 	technologies = NULL;
 	services = NULL;
 	state = NULL;
-	agent_unregister(agent_dbus_conn, NULL);
+	loop_remove_idle(coalesce_idle);
+	loop_remove_idle(engine_changes_idle);
+	coalesce_terminate();
+	json_object_put(changes);
+	changes = NULL;
+	services_order_changed = false;
+	ranking_clear();
+	if (agent_dbus_conn)
+		agent_unregister(agent_dbus_conn, NULL);
+
+	credentials_clear();
 	free_trusted_json();
 }
 
@@ -34,6 +34,16 @@ extern void (*engine_callback)(int status, struct json_object *jobj);
 
 int engine_query(struct json_object *jobj);
 
+void engine_watch_all_services(bool all);
+
+void engine_set_bus(const char *bus);
+
+int engine_replay(const char *path, unsigned int speed);
+
+int engine_record(const char *path);
+
+int engine_record_stop(void);
+
 int engine_init(void);
 
 void engine_terminate(void);
@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# Run the fuzz targets on their corpus (fuzz/corpus/<target>):
+#	./fuzz.sh [seconds per target]
+# Built with --enable-fuzzing (CC=clang), each target is fuzzed for the given
+# time (60 s by default) and the new inputs are added to its corpus. Built
+# without it ("make fuzz_dbus_json fuzz_json_dispatch fuzz_engine_query"), the
+# corpus is only run, e.g. under the Address Sanitizer (--enable-asan).
+
+DIR=$(dirname "$0")
+SECONDS_PER_TARGET=${1:-60}
+
+for target in dbus_json json_dispatch engine_query; do
+	"$DIR/fuzz_$target" -max_total_time="$SECONDS_PER_TARGET" \
+		"$DIR/fuzz/corpus/$target" || exit 1
+done
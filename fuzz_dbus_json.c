@@ -0,0 +1,70 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <dbus/dbus.h>
+#include <json.h>
+
+#include "dbus_json.h"
+
+/*
+ * libFuzzer target of the decoding of the messages of connman: the input is a
+ * message in the dbus wire format (fuzz/corpus/dbus_json has the messages of
+ * a trace, see trace.c), its arguments are decoded by dbus_to_json() as
+ * monitor_changed and the method returns do, then serialized.
+ */
+
+// Called after every dbus method return, see dbus_helpers.c.
+void callback_ended(void)
+{
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct json_object *jobj;
+	DBusMessageIter iter;
+	DBusMessage *message;
+	DBusError err;
+
+	dbus_error_init(&err);
+	message = dbus_message_demarshal((const char *) data, size, &err);
+
+	if (!message) {
+		dbus_error_free(&err);
+		return 0;
+	}
+
+	// A message without arguments isn't decoded, see monitor_changed
+	if (dbus_message_iter_init(message, &iter)) {
+		jobj = dbus_to_json(&iter);
+		json_object_to_json_string(jobj);
+		json_object_put(jobj);
+	}
+
+	dbus_message_unref(message);
+
+	return 0;
+}
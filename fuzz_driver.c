@@ -0,0 +1,138 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/*
+ * Run a fuzz target without libFuzzer (e.g. built with gcc, see
+ * --enable-fuzzing): the inputs are the files given, or the files of the
+ * directories given, e.g. a corpus. Options (-max_total_time=...) are
+ * ignored.
+ */
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) __attribute__((weak));
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/*
+ * Give the content of a file to the target.
+ * Return 0 on success, -1 if the file can't be read.
+ */
+static int run_file(const char *path)
+{
+	uint8_t *data;
+	FILE *file;
+	long size;
+
+	file = fopen(path, "rb");
+
+	if (!file)
+		return -1;
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	data = malloc(size > 0 ? size : 1);
+
+	if (!data || fread(data, 1, size, file) != (size_t) size) {
+		free(data);
+		fclose(file);
+		return -1;
+	}
+
+	fclose(file);
+	LLVMFuzzerTestOneInput(data, size);
+	free(data);
+
+	return 0;
+}
+
+/*
+ * Run the files of a directory.
+ * Return the number of files run, -1 if the directory can't be read.
+ */
+static int run_dir(const char *path)
+{
+	char file_path[4096];
+	struct dirent *entry;
+	DIR *dir;
+	int nb = 0;
+
+	dir = opendir(path);
+
+	if (!dir)
+		return -1;
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		snprintf(file_path, sizeof(file_path), "%s/%s", path,
+				entry->d_name);
+
+		if (run_file(file_path) == 0)
+			nb++;
+	}
+
+	closedir(dir);
+
+	return nb;
+}
+
+int main(int argc, char *argv[])
+{
+	struct stat st;
+	int i, nb, total = 0;
+
+	if (LLVMFuzzerInitialize)
+		LLVMFuzzerInitialize(&argc, &argv);
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] == '-')
+			continue;
+
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+			nb = run_dir(argv[i]);
+		else
+			nb = run_file(argv[i]) == 0 ? 1 : -1;
+
+		if (nb < 0) {
+			fprintf(stderr, "[-] Couldn't read %s\n", argv[i]);
+			return 1;
+		}
+
+		total += nb;
+	}
+
+	printf("[*] %d inputs run\n", total);
+
+	return 0;
+}
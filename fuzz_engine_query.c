@@ -0,0 +1,123 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <json.h>
+
+#include "engine.h"
+#include "commands.h"
+#include "dbus_helpers.h"
+#include "loop.h"
+
+/*
+ * libFuzzer target of the commands of the clients: the input is a json
+ * command, as the headless daemon reads them, given to engine_query(). The
+ * engine runs without a bus, initialized once from a trace of connman
+ * (FUZZ_STARTUP_TRACE, written by connman_mock -a offline -w). The method
+ * calls of a command fail with a NoReply error after it, the replies and the
+ * errors are serialized as the daemon does.
+ */
+
+#ifndef FUZZ_STARTUP_TRACE
+#define FUZZ_STARTUP_TRACE "fuzz/startup.trace"
+#endif
+
+// The loop polls stdin for the ncurses client only.
+void ncurses_action(void)
+{
+}
+
+// Called after every dbus method return, see dbus_helpers.c.
+void callback_ended(void)
+{
+}
+
+static void fuzz_callback(int status, struct json_object *jobj)
+{
+	json_object_to_json_string(jobj);
+	json_object_put(jobj);
+}
+
+static void replay_end(int status)
+{
+	if (status < 0) {
+		fprintf(stderr, "[-] %s: %s\n", FUZZ_STARTUP_TRACE,
+				strerror(-status));
+		exit(1);
+	}
+
+	loop_quit();
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	int res;
+
+	engine_callback = fuzz_callback;
+	commands_replay_end = replay_end;
+
+	if ((res = engine_replay(FUZZ_STARTUP_TRACE, 0)) < 0) {
+		fprintf(stderr, "[-] %s: %s\n", FUZZ_STARTUP_TRACE,
+				strerror(-res));
+		exit(1);
+	}
+
+	if (engine_init() < 0)
+		exit(1);
+
+	// The rest of the trace: the agent registration and requests
+	loop_run(false);
+
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct json_object *jobj;
+	char *str;
+
+	str = malloc(size + 1);
+
+	if (!str)
+		return 0;
+
+	memcpy(str, data, size);
+	str[size] = '\0';
+	jobj = json_tokener_parse(str);
+	free(str);
+
+	if (!jobj)
+		return 0;
+
+	engine_query(jobj);
+	dbus_offline_cancel();
+
+	return 0;
+}
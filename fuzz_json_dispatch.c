@@ -0,0 +1,107 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <json.h>
+
+#include "json_utils.h"
+#include "json_regex.h"
+#include "keys.h"
+
+/*
+ * libFuzzer target of the validation of the commands: the first byte of the
+ * input picks the trusted json of a command (see cmd_table in engine.c), the
+ * rest is the untrusted "cmd_data" checked by __json_type_dispatch().
+ */
+
+// The trusted json generated by json_regex.c, engine.c owns them.
+struct json_object *jregex_agent_response;
+struct json_object *jregex_agent_retry_response;
+struct json_object *jregex_config_service;
+
+// The trusted json strings of the commands.
+static const char *trusted_strings[] = {
+	key_engine_tech_regex,
+	key_engine_serv_regex,
+	key_engine_query_regex,
+	key_engine_tech_query_regex,
+	key_engine_serv_query_regex,
+	key_engine_watch_regex,
+	NULL,
+};
+
+// The trusted json of the commands, the strings parsed then the generated.
+static struct json_object *trusted[16];
+
+// Count effective number of trusted json.
+static int nb_trusted;
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	int i;
+
+	generate_trusted_json();
+
+	for (i = 0; trusted_strings[i]; i++)
+		trusted[nb_trusted++] = json_tokener_parse(trusted_strings[i]);
+
+	trusted[nb_trusted++] = jregex_agent_response;
+	trusted[nb_trusted++] = jregex_agent_retry_response;
+	trusted[nb_trusted++] = jregex_config_service;
+
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct json_object *jobj;
+	char *str;
+
+	if (size < 1)
+		return 0;
+
+	// json_tokener_parse() needs a string
+	str = malloc(size);
+
+	if (!str)
+		return 0;
+
+	memcpy(str, data + 1, size - 1);
+	str[size - 1] = '\0';
+	jobj = json_tokener_parse(str);
+	free(str);
+
+	if (!jobj)
+		return 0;
+
+	__json_type_dispatch(jobj, trusted[data[0] % nb_trusted]);
+	json_object_put(jobj);
+
+	return 0;
+}
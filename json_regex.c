@@ -54,17 +54,23 @@ void generate_trusted_json(void)
 {
 	struct json_object *tmp, *opt, *arr;
 
+	// The answer to the agent request key_agent_request_id
+	tmp = json_object_new_object();
+	json_object_object_add(tmp, "Name", json_object_new_string("^([[:print:]]+)$"));
+	json_object_object_add(tmp, "SSID", json_object_new_string("^([[:xdigit:]]+)$"));
+	json_object_object_add(tmp, "Identity", json_object_new_string("^([[:print:]]+)$"));
+	json_object_object_add(tmp, "Passphrase", json_object_new_string("^([[:print:]]*)$"));
+	json_object_object_add(tmp, "PreviousPassphrase", json_object_new_string("^([[:print:]]*)$"));
+	json_object_object_add(tmp, "WPS", json_object_new_string("^([[:digit:]]*)$"));
+	json_object_object_add(tmp, "Username", json_object_new_string("^([[:print:]]*)$"));
+	json_object_object_add(tmp, "Password", json_object_new_string("^([[:print:]]*)$"));
 	jregex_agent_response = json_object_new_object();
-	json_object_object_add(jregex_agent_response, "Name", json_object_new_string("^([[:print:]]+)$"));
-	json_object_object_add(jregex_agent_response, "SSID", json_object_new_string("^([[:xdigit:]]+)$"));
-	json_object_object_add(jregex_agent_response, "Identity", json_object_new_string("^([[:print:]]+)$"));
-	json_object_object_add(jregex_agent_response, "Passphrase", json_object_new_string("^([[:print:]]*)$"));
-	json_object_object_add(jregex_agent_response, "PreviousPassphrase", json_object_new_string("^([[:print:]]*)$"));
-	json_object_object_add(jregex_agent_response, "WPS", json_object_new_string("^([[:digit:]]*)$"));
-	json_object_object_add(jregex_agent_response, "Username", json_object_new_string("^([[:print:]]*)$"));
-	json_object_object_add(jregex_agent_response, "Password", json_object_new_string("^([[:print:]]*)$"));
+	json_object_object_add(jregex_agent_response, key_agent_request_id, json_object_new_int(0));
+	json_object_object_add(jregex_agent_response, key_agent_msg_data, tmp);
 
-	jregex_agent_retry_response = json_object_new_boolean(TRUE);
+	jregex_agent_retry_response = json_object_new_object();
+	json_object_object_add(jregex_agent_retry_response, key_agent_request_id, json_object_new_int(0));
+	json_object_object_add(jregex_agent_retry_response, key_agent_msg_data, json_object_new_boolean(TRUE));
 
 	// See commands.c __cmd_config_service for a better idea of the format.
 	jregex_config_service = json_object_new_object();
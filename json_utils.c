@@ -36,7 +36,8 @@
 #include "json_utils.h"
 
 /*
- * This file handle the validation of json input data.
+ * This file handle the validation of json input data, and estimates the memory
+ * used by json objects.
  */
 
 /*
@@ -196,3 +197,52 @@ const char* __json_get_command_str(struct json_object *jobj)
 
 	return NULL;
 }
+
+static void object_footprint(struct json_object *jobj,
+		struct json_footprint *fp)
+{
+	json_object_object_foreach(jobj, key, val) {
+		fp->bytes += JSON_FOOTPRINT_ENTRY + strlen(key) + 1;
+		__json_footprint(val, fp);
+	}
+}
+
+/*
+ * Add the json objects of the tree jobj and an estimate of their size to fp.
+ * The size counts the objects, the strings, the hash table entries with their
+ * key and the array slots, see JSON_FOOTPRINT_*. This function is recursive.
+ * @param jobj the tree to walk, can be NULL
+ */
+void __json_footprint(struct json_object *jobj, struct json_footprint *fp)
+{
+	int i, len;
+
+	if (!jobj)
+		return;
+
+	fp->objects++;
+	fp->bytes += JSON_FOOTPRINT_NODE;
+
+	switch (json_object_get_type(jobj)) {
+
+		case json_type_string:
+			fp->bytes += strlen(json_object_get_string(jobj)) + 1;
+			break;
+
+		case json_type_object:
+			object_footprint(jobj, fp);
+			break;
+
+		case json_type_array:
+			len = json_object_array_length(jobj);
+			fp->bytes += JSON_FOOTPRINT_SLOT * len;
+
+			for (i = 0; i < len; i++)
+				__json_footprint(json_object_array_get_idx(jobj, i),
+						fp);
+			break;
+
+		default:
+			break;
+	}
+}
@@ -22,6 +22,22 @@
 #ifndef __CONNMAN_JSON_UTILS_H
 #define __CONNMAN_JSON_UTILS_H
 
+#include <stddef.h>
+#include <stdbool.h>
+#include <json.h>
+
+// Estimated sizes in bytes of a json object, of an entry of its hash table
+// (key not included) and of a slot of an array, see __json_footprint().
+#define JSON_FOOTPRINT_NODE 48
+#define JSON_FOOTPRINT_ENTRY 32
+#define JSON_FOOTPRINT_SLOT 8
+
+// Memory used by json objects, see __json_footprint().
+struct json_footprint {
+	unsigned int objects;
+	size_t bytes;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,6 +49,8 @@ bool __json_type_dispatch(struct json_object *jobj,
 
 const char* __json_get_command_str(struct json_object *jobj);
 
+void __json_footprint(struct json_object *jobj, struct json_footprint *fp);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,6 +25,28 @@ const char key_technology[] = "technology";
 const char key_service[] = "service";
 const char key_services[] = "services";
 const char key_options[] = "options";
+const char key_properties[] = "properties";
+const char key_generation[] = "generation";
+const char key_unchanged[] = "unchanged";
+const char key_request_id[] = "request_id";
+
+const char key_changes[] = "changes";
+const char key_change[] = "change";
+const char key_change_collection[] = "collection";
+const char key_change_path[] = "path";
+const char key_change_property[] = "property";
+const char key_change_old[] = "old";
+const char key_change_new[] = "new";
+const char key_change_kind_property[] = "property";
+const char key_change_kind_added[] = "added";
+const char key_change_kind_removed[] = "removed";
+const char key_change_kind_order[] = "order";
+
+const char key_status[] = "status";
+const char key_events[] = "events";
+const char key_control_subscribe[] = "subscribe";
+const char key_control_unsubscribe[] = "unsubscribe";
+const char key_event_agent[] = "agent";
 
 const char key_command[] = "command";
 const char key_command_data[] = "cmd_data";
@@ -48,6 +70,13 @@ const char key_engine_remove_service[] = "remove_service";
 const char key_engine_tech_regex[] = "{ \"technology\": \"(%5C%5C|/|([a-zA-Z]))+\" }";
 const char key_engine_serv_regex[] = "{ \"service\": \"(%5C%5C|/|([a-zA-Z]))+\" }";
 const char key_engine_get_service[] = "get_service";
+const char key_engine_watch_services[] = "watch_services";
+const char key_engine_get_stats[] = "get_stats";
+const char key_engine_query_regex[] = "{ \"generation\": 0 }";
+const char key_engine_tech_query_regex[] = "{ \"technology\": \"(%5C%5C|/|([a-zA-Z]))+\", \"generation\": 0 }";
+const char key_engine_serv_query_regex[] = "{ \"service\": \"(%5C%5C|/|([a-zA-Z]))+\", \"generation\": 0 }";
+const char key_engine_stats_regex[] = "{ }";
+const char key_engine_watch_regex[] = "{ \"services\": [ \"(%5C%5C|/|([a-zA-Z]))+\" ], \"properties\": [ \"^([[:alnum:]]+)$\" ] }";
 
 const char key_success[] = "OK";
 const char key_error[] = "ERROR";
@@ -64,6 +93,8 @@ char key_agent_interface[] = "net.connman.Agent";
 const char key_agent_error_message[] = "agent_error_message";
 const char key_agent_error_callback[] = "agent_error_callback";
 const char key_agent_msg_data[] = "agent_msg_data";
+const char key_agent_request_id[] = "agent_request_id";
+const char key_agent_request_canceled[] = "Agent canceled";
 const char key_agent_request_browser[] = "Agent RequestBrowser";
 const char key_agent_request_input[] = "Input Requested";
 
@@ -28,6 +28,28 @@ extern const char key_technology[];
 extern const char key_service[];
 extern const char key_services[];
 extern const char key_options[];
+extern const char key_properties[];
+extern const char key_generation[];
+extern const char key_unchanged[];
+extern const char key_request_id[];
+
+extern const char key_changes[];
+extern const char key_change[];
+extern const char key_change_collection[];
+extern const char key_change_path[];
+extern const char key_change_property[];
+extern const char key_change_old[];
+extern const char key_change_new[];
+extern const char key_change_kind_property[];
+extern const char key_change_kind_added[];
+extern const char key_change_kind_removed[];
+extern const char key_change_kind_order[];
+
+extern const char key_status[];
+extern const char key_events[];
+extern const char key_control_subscribe[];
+extern const char key_control_unsubscribe[];
+extern const char key_event_agent[];
 
 extern const char key_command[];
 extern const char key_command_data[];
@@ -52,6 +74,13 @@ extern const char key_engine_remove_service[];
 extern const char key_engine_tech_regex[];
 extern const char key_engine_serv_regex[];
 extern const char key_engine_get_service[];
+extern const char key_engine_watch_services[];
+extern const char key_engine_get_stats[];
+extern const char key_engine_query_regex[];
+extern const char key_engine_tech_query_regex[];
+extern const char key_engine_serv_query_regex[];
+extern const char key_engine_stats_regex[];
+extern const char key_engine_watch_regex[];
 
 extern const char key_success[];
 extern const char key_error[];
@@ -68,6 +97,8 @@ extern char key_agent_interface[];
 extern const char key_agent_error_message[];
 extern const char key_agent_error_callback[];
 extern const char key_agent_msg_data[];
+extern const char key_agent_request_id[];
+extern const char key_agent_request_canceled[];
 extern const char key_agent_request_browser[];
 extern const char key_agent_request_input[];
 
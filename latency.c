@@ -0,0 +1,300 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <json.h>
+
+#include "engine.h"
+#include "loop.h"
+#include "keys.h"
+#include "stats.h"
+#include "credentials.h"
+#include "player.h"
+
+/*
+ * Connect latency of the engine on a bus next to connman_mock (see
+ * latency.sh): the client connects, one after the other, to secured wifi
+ * services never connected before and answers the agent requests it gets at
+ * once, as a user typing instantly would. The time from the connect command
+ * to its return is measured, with the credentials of the services given with
+ * -k (the agent answers connman itself) or without (the request goes through
+ * the client).
+ */
+
+// Services connected to, at most.
+#define LATENCY_MAX_SERVICES 256
+
+// A connection not returned after that long failed.
+#define LATENCY_TIMEOUT_MS 10000
+
+// Services to connect to (-n).
+static int nb_connects = 10;
+
+static char *services[LATENCY_MAX_SERVICES];
+static int nb_services;
+
+// The service being connected to, its index in services.
+static int current = -1;
+
+static uint64_t connect_us;
+
+// Agent requests received by the client, and the time spent from the connect
+// command to them.
+static int nb_agent_requests;
+static uint64_t agent_total_us;
+
+// Connections returned: total, min and max times.
+static int nb_connected, nb_failed;
+static uint64_t total_us, min_us, max_us;
+
+/*
+ * Connect to the next service, stop the loop once they all returned.
+ */
+static void connect_next(void)
+{
+	struct json_object *data;
+
+	if (++current >= nb_services) {
+		loop_quit();
+		return;
+	}
+
+	data = json_object_new_object();
+	json_object_object_add(data, key_service,
+			json_object_new_string(services[current]));
+	connect_us = stats_now_us();
+	player_send_command(key_engine_connect, data);
+}
+
+/*
+ * Keep the secured services never connected of a get_services_from_tech
+ * reply, then start connecting.
+ */
+static void pick_services(struct json_object *reply)
+{
+	struct json_object *data, *list, *serv, *dict, *security, *favorite;
+	const char *sec;
+	int i;
+
+	if (!json_object_object_get_ex(reply, key_command_data, &data) ||
+			!json_object_object_get_ex(data, key_services, &list))
+		return;
+
+	for (i = 0; i < json_object_array_length(list) &&
+			nb_services < nb_connects; i++) {
+		serv = json_object_array_get_idx(list, i);
+		dict = json_object_array_get_idx(serv, 1);
+
+		if (!json_object_object_get_ex(dict, key_serv_security,
+					&security) ||
+				!json_object_object_get_ex(dict,
+					key_serv_favorite, &favorite) ||
+				json_object_get_boolean(favorite))
+			continue;
+
+		sec = json_object_to_json_string(security);
+
+		if (!strstr(sec, "psk"))
+			continue;
+
+		services[nb_services++] = strdup(json_object_get_string(
+					json_object_array_get_idx(serv, 0)));
+	}
+
+	connect_next();
+}
+
+/*
+ * Count an agent request, then answer it.
+ */
+static void answer_agent(struct json_object *request)
+{
+	nb_agent_requests++;
+	agent_total_us += stats_now_us() - connect_us;
+	player_answer_agent(request, "latency");
+}
+
+/*
+ * The connect command returned, successfully or not.
+ */
+static void connect_returned(bool failed)
+{
+	uint64_t us = stats_now_us() - connect_us;
+
+	if (failed) {
+		nb_failed++;
+	} else {
+		if (nb_connected == 0 || us < min_us)
+			min_us = us;
+
+		if (us > max_us)
+			max_us = us;
+
+		total_us += us;
+		nb_connected++;
+	}
+
+	connect_next();
+}
+
+static void latency_callback(int status, struct json_object *jobj)
+{
+	struct json_object *cmd, *tmp;
+	const char *cmd_name = NULL;
+
+	if (json_object_object_get_ex(jobj, key_command, &cmd))
+		cmd_name = json_object_get_string(cmd);
+
+	if (json_object_object_get_ex(jobj, key_agent_msg, NULL))
+		answer_agent(jobj);
+
+	else if (current >= 0 && current < nb_services &&
+			json_object_object_get_ex(jobj,
+				key_return_force_refresh, &tmp) &&
+			strcmp(json_object_get_string(tmp),
+				key_connect_return) == 0)
+		connect_returned(json_object_object_get_ex(jobj, key_error,
+					NULL));
+
+	else if (current < 0 && cmd_name && strcmp(cmd_name,
+				key_engine_get_services_from_tech) == 0)
+		pick_services(jobj);
+
+	json_object_put(jobj);
+}
+
+/*
+ * Loop idle function: give up a connection which doesn't return.
+ */
+static int latency_idle(void)
+{
+	uint64_t elapsed_ms;
+
+	if (current < 0 || current >= nb_services)
+		return LATENCY_TIMEOUT_MS;
+
+	elapsed_ms = (stats_now_us() - connect_us) / 1000;
+
+	if (elapsed_ms < LATENCY_TIMEOUT_MS)
+		return LATENCY_TIMEOUT_MS - elapsed_ms;
+
+	printf("[-] %s: no return after %d ms\n", services[current],
+			LATENCY_TIMEOUT_MS);
+	connect_returned(true);
+
+	return LATENCY_TIMEOUT_MS;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-a bus] [-n services] [-k file]\n"
+			"  -a  bus connman is on: system (default), session "
+			"or a dbus address\n"
+			"  -n  services to connect to (default %d, at most "
+			"%d)\n"
+			"  -k  json file of the credentials given to the agent "
+			"without asking\n", prog, nb_connects,
+			LATENCY_MAX_SERVICES);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *credentials_path = NULL;
+	char *end;
+	int opt, res, i;
+
+	while ((opt = getopt(argc, argv, "a:n:k:h")) != -1) {
+		switch (opt) {
+			case 'a':
+				engine_set_bus(optarg);
+				break;
+
+			case 'n':
+				nb_connects = strtol(optarg, &end, 10);
+
+				if (*end != '\0' || end == optarg ||
+						nb_connects <= 0 || nb_connects >
+						LATENCY_MAX_SERVICES) {
+					usage(argv[0]);
+					exit(1);
+				}
+
+				break;
+
+			case 'k':
+				credentials_path = optarg;
+				break;
+
+			default:
+				usage(argv[0]);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	engine_callback = latency_callback;
+
+	if (engine_init() < 0)
+		exit(1);
+
+	if (credentials_path &&
+			(res = credentials_load(credentials_path)) < 0) {
+		fprintf(stderr, "[-] Couldn't load the credentials in %s: %s\n",
+				credentials_path, strerror(-res));
+		engine_terminate();
+		exit(1);
+	}
+
+	loop_add_idle(latency_idle);
+	player_query_services();
+	loop_run(false);
+	loop_remove_idle(latency_idle);
+	engine_terminate();
+	loop_terminate();
+
+	printf("[*] %s: %d connections, %d failed, %d agent requests to the "
+			"client\n", credentials_path ? "with credentials" :
+			"without credentials", nb_connected, nb_failed,
+			nb_agent_requests);
+
+	if (nb_agent_requests)
+		printf("\tconnect to agent request: %.3f ms on average\n",
+				agent_total_us / 1000.0 / nb_agent_requests);
+
+	if (nb_connected)
+		printf("\tconnect latency: %.3f ms on average, min %.3f, max "
+				"%.3f\n", total_us / 1000.0 / nb_connected,
+				min_us / 1000.0, max_us / 1000.0);
+
+	for (i = 0; i < nb_services; i++)
+		free(services[i]);
+
+	printf("\n[*] the end.\n");
+
+	return nb_connected == nb_services && nb_services > 0 ? 0 : 1;
+}
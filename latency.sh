@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Connect latency of the engine, with and without the credentials of the
+# services given to the agent (-k): connman_latency connects to secured
+# services of connman_mock, one after the other:
+#	./latency.sh [services]
+# e.g. "./latency.sh 10" (the default). Each run has its own mock, where no
+# service was connected before.
+
+DIR=$(dirname "$0")
+SERVICES=${1:-10}
+CREDENTIALS=$(mktemp) || exit 1
+trap 'rm -f "$CREDENTIALS"' EXIT
+
+# connman_mock names its wifi services Mock0000, Mock0001... one in three is
+# not secured
+WIFI=$((SERVICES * 3 / 2 + 1))
+SEP=""
+{
+	echo "{"
+
+	for i in $(seq 0 $((WIFI - 1))); do
+		printf '%s\t"Mock%04x": { "Passphrase": "latency" }' "$SEP" "$i"
+		SEP=$',\n'
+	done
+
+	echo
+	echo "}"
+} > "$CREDENTIALS"
+
+"$DIR/mock-bus.sh" -n "$WIFI" -- \
+	"$DIR/connman_latency" -a @BUS@ -n "$SERVICES" || exit 1
+
+"$DIR/mock-bus.sh" -n "$WIFI" -- \
+	"$DIR/connman_latency" -a @BUS@ -n "$SERVICES" -k "$CREDENTIALS"
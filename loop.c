@@ -33,11 +33,13 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "stats.h"
+
 #include "loop.h"
 
 /*
  * This file is a custom implementation of main loop, it's used to listen for
- * events from dbus and stdin.
+ * events from dbus, stdin and other file descriptors (see loop_add_fd()).
  */
 
 // The dbus connection to listen to.
@@ -48,6 +50,10 @@ extern void ncurses_action(void);
 
 #define WATCHEDS_MAX_COUNT 20
 
+#define IDLES_MAX_COUNT 8
+
+#define FDS_MAX_COUNT 40
+
 // Indicate if the loop has to be stopped.
 static int stop_loop = 0;
 
@@ -57,6 +63,26 @@ static DBusWatch *watcheds[WATCHEDS_MAX_COUNT];
 // Count effective number of dbus watch.
 static int watcheds_count;
 
+// Functions called on every iteration, see loop_add_idle().
+static loop_idle_func idles[IDLES_MAX_COUNT];
+
+// Count effective number of idle functions.
+static int idles_count;
+
+// File descriptors watched, see loop_add_fd().
+static struct {
+	int fd;
+	short events;
+	loop_fd_func func;
+} fds_watched[FDS_MAX_COUNT];
+
+// Count effective number of file descriptors watched.
+static int fds_watched_count;
+
+// Dispatch budgets, see loop_set_dispatch_budget().
+static unsigned int budget_msgs = LOOP_DEFAULT_BUDGET_MSGS;
+static unsigned int budget_us = LOOP_DEFAULT_BUDGET_US;
+
 /*
  * Add a dbus watch.
  */
@@ -92,8 +118,10 @@ static void remove_watch(DBusWatch *watch, void *data)
  */
 void loop_init(void)
 {
-	dbus_connection_set_watch_functions(connection, add_watch, remove_watch,
-			NULL, NULL, NULL);
+	// There is no connection without a bus, see dbus_set_offline()
+	if (connection)
+		dbus_connection_set_watch_functions(connection, add_watch,
+				remove_watch, NULL, NULL, NULL);
 }
 
 /*
@@ -101,9 +129,13 @@ void loop_init(void)
  */
 void loop_terminate(void)
 {
-	dbus_connection_unref(connection);
+	if (connection)
+		dbus_connection_unref(connection);
+
 	connection = 0;
 	watcheds_count = 0;
+	idles_count = 0;
+	fds_watched_count = 0;
 }
 
 /*
@@ -114,15 +146,193 @@ void loop_quit(void)
 	stop_loop = 1;
 }
 
+/*
+ * Limit the work done by a single dispatch slice. When the budget is exhausted
+ * the rest of the dbus backlog is left for the next iterations of the loop, so
+ * stdin keeps being polled during signal storms.
+ * @param max_msgs maximum number of messages dispatched per slice, 0 for no
+ *	limit
+ * @param max_us maximum time in microseconds spent dispatching per slice, 0
+ *	for no limit
+ */
+void loop_set_dispatch_budget(unsigned int max_msgs, unsigned int max_us)
+{
+	budget_msgs = max_msgs;
+	budget_us = max_us;
+}
+
+/*
+ * Register a function called on every iteration of the loop, before polling.
+ * The function returns the delay in milliseconds before it needs to be called
+ * again, or -1 if it doesn't need to: the poll timeout is the smallest delay.
+ * @param func the function to register
+ */
+int loop_add_idle(loop_idle_func func)
+{
+	int i;
+
+	for (i = 0; i < idles_count; i++) {
+		if (idles[i] == func)
+			return -EALREADY;
+	}
+
+	if (idles_count >= IDLES_MAX_COUNT)
+		return -ENOMEM;
+
+	idles[idles_count++] = func;
+
+	return 0;
+}
+
+/*
+ * Unregister a function registered with loop_add_idle().
+ * @param func the function to unregister
+ */
+void loop_remove_idle(loop_idle_func func)
+{
+	int i;
+
+	for (i = 0; i < idles_count; i++) {
+		if (idles[i] == func) {
+			idles[i] = idles[--idles_count];
+			break;
+		}
+	}
+}
+
+/*
+ * Return the index of a watched file descriptor, -1 if it isn't watched.
+ */
+static int find_fd(int fd)
+{
+	int i;
+
+	for (i = 0; i < fds_watched_count; i++) {
+		if (fds_watched[i].fd == fd)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Watch a file descriptor: func is called when poll() reports one of the
+ * events (or an error / hang up) on it.
+ * @param fd the file descriptor
+ * @param events poll() events, e.g. POLLIN
+ * @param func the function to call with the events reported
+ */
+int loop_add_fd(int fd, short events, loop_fd_func func)
+{
+	if (find_fd(fd) >= 0)
+		return -EALREADY;
+
+	if (fds_watched_count >= FDS_MAX_COUNT)
+		return -ENOMEM;
+
+	fds_watched[fds_watched_count].fd = fd;
+	fds_watched[fds_watched_count].events = events;
+	fds_watched[fds_watched_count].func = func;
+	fds_watched_count++;
+
+	return 0;
+}
+
+/*
+ * Change the events watched on a file descriptor, e.g. add POLLOUT while there
+ * is something to write.
+ */
+int loop_set_fd_events(int fd, short events)
+{
+	int i = find_fd(fd);
+
+	if (i < 0)
+		return -ENOENT;
+
+	fds_watched[i].events = events;
+
+	return 0;
+}
+
+/*
+ * Stop watching a file descriptor registered with loop_add_fd(). It can be
+ * called from a file descriptor function.
+ */
+void loop_remove_fd(int fd)
+{
+	int i = find_fd(fd);
+
+	if (i >= 0)
+		fds_watched[i] = fds_watched[--fds_watched_count];
+}
+
+/*
+ * Run the idle functions and return the poll timeout they need.
+ */
+static int run_idles(void)
+{
+	int i, timeout, res = -1;
+
+	for (i = 0; i < idles_count; i++) {
+		timeout = idles[i]();
+
+		if (timeout >= 0 && (res < 0 || timeout < res))
+			res = timeout;
+	}
+
+	return res;
+}
+
+/*
+ * Return true if dbus messages are waiting to be dispatched.
+ */
+static bool dispatch_backlog(void)
+{
+	return connection && dbus_connection_get_dispatch_status(connection) ==
+		DBUS_DISPATCH_DATA_REMAINS;
+}
+
+/*
+ * Dispatch dbus messages until the queue is empty or the budget is exhausted.
+ * Return true if messages are left in the queue.
+ */
+static bool dispatch_slice(void)
+{
+	unsigned int nb_msgs = 0;
+	uint64_t deadline = 0;
+	bool remains;
+
+	stats_dispatch_begin();
+
+	if (budget_us)
+		deadline = stats_now_us() + budget_us;
+
+	while ((remains = dispatch_backlog())) {
+		if (budget_msgs && nb_msgs >= budget_msgs)
+			break;
+
+		if (deadline && nb_msgs > 0 && stats_now_us() >= deadline)
+			break;
+
+		dbus_connection_dispatch(connection);
+		nb_msgs++;
+	}
+
+	stats_dispatch_end(nb_msgs, remains);
+
+	return remains;
+}
+
 /*
  * Run the loop.
  * @param poll_stdin Do the loop have to poll on stdin
  */
 void loop_run(bool poll_stdin)
 {
-	struct pollfd fds[WATCHEDS_MAX_COUNT];
+	struct pollfd fds[WATCHEDS_MAX_COUNT + FDS_MAX_COUNT + 1];
 	DBusWatch *tmp_watcher;
-	int nfds, i, status, processdbus;
+	int nfds, nb_dbus, nb_fds, i, j, status, processdbus, timeout;
+	bool backlog = false;
 	unsigned int flags;
 	short revents, cond;
 
@@ -150,6 +360,16 @@ void loop_run(bool poll_stdin)
 			}
 		}
 
+		nb_dbus = nfds;
+
+		for (i = 0; i < fds_watched_count; i++) {
+			fds[nfds].fd = fds_watched[i].fd;
+			fds[nfds].events = fds_watched[i].events;
+			nfds++;
+		}
+
+		nb_fds = nfds - nb_dbus;
+
 		if (poll_stdin) {
 			fds[nfds].fd = 0;
 			fds[nfds].events = POLLHUP | POLLERR | POLLIN;
@@ -157,21 +377,23 @@ void loop_run(bool poll_stdin)
 		}
 
 
-		// poll
-		status = poll(fds, (nfds_t) nfds, -1);
-		if (status <= 0 && errno != EINTR) {
+		timeout = run_idles();
+
+		// poll, don't wait if a dbus backlog is pending
+		stats_poll_begin();
+		status = poll(fds, (nfds_t) nfds, backlog ? 0 : timeout);
+		stats_poll_end();
+
+		if (status < 0 && errno != EINTR) {
 			printf("\n[-] poll error %d:%s\n", errno,
 					strerror(errno));
 			break;
 		}
 
 		// process
-		processdbus = 0;
+		processdbus = backlog;
 
-		if (poll_stdin)
-			nfds--;
-
-		for (i = 0; i < nfds; ++i) {
+		for (i = 0; i < nb_dbus; ++i) {
 			revents = fds[i].revents;
 			if (revents) {
 				flags = 0;
@@ -190,13 +412,24 @@ void loop_run(bool poll_stdin)
 			}
 		}
 
-		if (processdbus) {
-			while (dbus_connection_dispatch(connection) ==
-					DBUS_DISPATCH_DATA_REMAINS);
+		backlog = false;
+
+		if (processdbus)
+			backlog = dispatch_slice();
+
+		// The functions may remove file descriptors, look them up again
+		for (i = nb_dbus; i < nb_dbus + nb_fds; i++) {
+			if (!fds[i].revents || (j = find_fd(fds[i].fd)) < 0)
+				continue;
+
+			fds_watched[j].func(fds[i].fd, fds[i].revents);
 		}
-		
-		if (poll_stdin && fds[nfds].revents & POLLIN)
+
+		if (poll_stdin && fds[nb_dbus + nb_fds].revents & POLLIN) {
+			stats_action_begin();
 			ncurses_action();
+			stats_action_end();
+		}
 
 	} // end while
 	stop_loop = 0;
@@ -22,12 +22,36 @@
 #ifndef __CONNMAN_LOOP_H
 #define __CONNMAN_LOOP_H
 
+#include <stdbool.h>
+
+// Default dispatch budget, see loop_set_dispatch_budget().
+#define LOOP_DEFAULT_BUDGET_MSGS 64
+#define LOOP_DEFAULT_BUDGET_US 10000
+
+// Idle function, see loop_add_idle().
+typedef int (*loop_idle_func)(void);
+
+// File descriptor function, see loop_add_fd().
+typedef void (*loop_fd_func)(int fd, short revents);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void loop_init(void);
 
+void loop_set_dispatch_budget(unsigned int max_msgs, unsigned int max_us);
+
+int loop_add_idle(loop_idle_func func);
+
+void loop_remove_idle(loop_idle_func func);
+
+int loop_add_fd(int fd, short events, loop_fd_func func);
+
+int loop_set_fd_events(int fd, short events);
+
+void loop_remove_fd(int fd);
+
 void loop_run(bool poll_stdin);
 
 void loop_quit(void);
@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <dbus/dbus.h>
 #include <signal.h>
@@ -40,6 +41,9 @@
 #include "keys.h"
 #include "popup.h"
 #include "special_win.h"
+#include "stats.h"
+#include "coalesce.h"
+#include "credentials.h"
 
 /*
  * This file is the glue between ncurses and the engine.
@@ -67,8 +71,50 @@ static void connect_to_service(void);
 static void get_state(void);
 static void print_home_page(void);
 static void exec_refresh(void);
+static void schedule_refresh(void);
+static void update_watched_services(void);
 static void get_service_settings(void);
 
+// Minimum delay between two refreshes triggered by events (30 Hz).
+#define REFRESH_FRAME_INTERVAL_US (1000000 / 30)
+
+// Actions of the user remembered until the reply of connman, see
+// query_action().
+#define MAX_ACTIONS_PENDING 16
+
+// The current context has to be refreshed, see schedule_refresh().
+static bool refresh_pending = false;
+
+// The next refresh has to render the context from scratch (e.g. the windows
+// were recreated), see exec_refresh().
+static bool refresh_from_scratch = false;
+
+// When the last refresh was executed.
+static uint64_t last_refresh_us;
+
+// Service properties displayed in the services list, State and Favorite are
+// always watched by the engine.
+static const char *services_list_properties[] = {
+	key_serv_ethernet,
+	key_serv_name,
+	key_serv_security,
+	key_serv_strength,
+	NULL,
+};
+
+// Last watch_services command sent, see update_watched_services().
+static char *last_watch = NULL;
+
+// Actions sent by the user, by request id: the action with id n is in slot
+// n % MAX_ACTIONS_PENDING.
+static struct {
+	unsigned int id;
+	const char *cmd_name;
+} actions_pending[MAX_ACTIONS_PENDING];
+
+// Request id of the last action sent.
+static unsigned int last_request_id;
+
 // Refres isn't automatic, this could be problematic in high wifi density areas:
 // your cursor would move around endlessly. Thus, automatic refresh is disabled
 // by default in the context CONTEXT_SERVICES. The variable here force the
@@ -78,6 +124,15 @@ static bool allow_refresh = false;
 // This is used to store requests from the agent.
 static char **agent_request_input_fields;
 
+// The agent request answered by the popup, see popup_btn_action_ok().
+static unsigned int popup_agent_request_id;
+
+// Agent requests waiting for the popup to be free, in order of arrival.
+static struct json_object *agent_msgs_pending[AGENT_MAX_REQUESTS];
+
+// Number of agent requests in agent_msgs_pending.
+static int nb_agent_msgs_pending;
+
 /*
  * Those are special windows, they are over anything until 'Esc'.
  * It's handy for error reporting and help messages.
@@ -154,6 +209,50 @@ static void report_error()
 			" Invalid argument/value.");
 }
 
+/*
+ * Send an action to connman (connect, scan...). Its reply is recognized by its
+ * request id, see action_of_reply(): it refreshes the current context.
+ * @param cmd the command, the ownership is transferred
+ * @param cmd_name the name of the command, a key_engine_* string
+ */
+static void query_action(struct json_object *cmd, const char *cmd_name)
+{
+	unsigned int slot;
+
+	if (++last_request_id > INT_MAX)
+		last_request_id = 1;
+
+	slot = last_request_id % MAX_ACTIONS_PENDING;
+	actions_pending[slot].id = last_request_id;
+	actions_pending[slot].cmd_name = cmd_name;
+	json_object_object_add(cmd, key_request_id,
+			json_object_new_int(last_request_id));
+
+	if (engine_query(cmd) == -EINVAL)
+		report_error();
+}
+
+/*
+ * Return the name of the action a reply answers, NULL if it isn't the reply
+ * of an action sent by query_action().
+ */
+static const char* action_of_reply(struct json_object *jobj)
+{
+	struct json_object *tmp;
+	unsigned int id, slot;
+
+	if (!json_object_object_get_ex(jobj, key_request_id, &tmp))
+		return NULL;
+
+	id = json_object_get_int(tmp);
+	slot = id % MAX_ACTIONS_PENDING;
+
+	if (id == 0 || actions_pending[slot].id != id)
+		return NULL;
+
+	return actions_pending[slot].cmd_name;
+}
+
 /*
  * Create a help window matching the context.
  */
@@ -172,6 +271,7 @@ static void get_help_window()
 				" * Press 'p' to toggle a technology's power state\n"
 				" * Press 'o' to toggle the OfflineMode (power on/off all technologies)\n"
 				" * Press 'F5' to force refresh\n"
+				" * Press 'F8' to start instrumentation, press it again to dump it\n"
 				" * Press '^C' to quit";
 			break;
 
@@ -194,6 +294,7 @@ static void get_help_window()
 				" * Press 's' to configure the service\n"
 				" * Press 'r' to remove saved information on a service\n"
 				" * Press 'Return'/'Enter' to connect\n"
+				" * Press 'page_up'/'page_down' to scroll by pages\n"
 				" * Press 'F5' to force a refresh\n"
 				" * Press 'F6' to force a rescan for the technology (some technologies don't support this)\n"
 				" * Press '^C' to quit";
@@ -222,6 +323,9 @@ static void popup_free(void)
 
 	free(popup_btn_action);
 	popup_delete();
+
+	// Redraw what was under the popup
+	refresh_from_scratch = true;
 	exec_refresh();
 }
 
@@ -238,6 +342,9 @@ static void stop_loop(int signum, siginfo_t *si, void *useless)
 	if (popup_exists())
 		popup_free();
 
+	while (nb_agent_msgs_pending > 0)
+		json_object_put(agent_msgs_pending[--nb_agent_msgs_pending]);
+
 	if (win_exists(win_error))
 		win_driver(&win_error, 27);
 
@@ -278,6 +385,8 @@ static void create_win(void)
 	win_footer = newwin(2, COLS, LINES-2, 0);
 	assert(win_footer != NULL && win_header != NULL);
 
+	// After a resize the terminal content is unknown: the windows must be
+	// sent entirely, not only the lines ncurses thinks changed
 	redrawwin(win_header);
 	redrawwin(win_body);
 	redrawwin(win_footer);
@@ -318,7 +427,8 @@ static void resize(int signum, siginfo_t *si, void *useless)
 	delete_win();
 	create_win();
 	get_state();
-	exec_refresh();
+	refresh_from_scratch = true;
+	schedule_refresh();
 	loop_run(true);
 
 	if (popup_exists())
@@ -345,6 +455,24 @@ static void exec_refresh(void)
 	FIELD *tmp_field;
 	struct userptr_data *tmp;
 
+	refresh_pending = false;
+	last_refresh_us = stats_now_us();
+	stats_redraw_done();
+
+	// The views are updated in place if the engine data changed, see
+	// add_view_generation(), __renderers_home_page and __renderers_services
+	if (!refresh_from_scratch && ((context.current_context ==
+				CONTEXT_SERVICES && services_list) ||
+			(context.current_context == CONTEXT_HOME && main_menu) ||
+			((context.current_context == CONTEXT_SERVICE_CONFIG ||
+			  context.current_context ==
+			  CONTEXT_SERVICE_CONFIG_STANDALONE) && main_form))) {
+		context_actions[context.current_context].func_refresh();
+		return;
+	}
+
+	refresh_from_scratch = false;
+
 	if (nb_fields != 0) {
 		tmp_field = current_field(main_form);
 		assert(tmp_field != NULL);
@@ -356,12 +484,132 @@ static void exec_refresh(void)
 		assert(item != NULL);
 		tmp = item_userptr(item);
 		context.cursor_id = strdup(tmp->dbus_name);
+	} else if ((tmp = __renderers_services_current()) != NULL) {
+		context.cursor_id = strdup(tmp->dbus_name);
 	}
 
 	context_actions[context.current_context].func_free();
 	context_actions[context.current_context].func_refresh();
 }
 
+/*
+ * Mark the current context as dirty, it will be refreshed by refresh_idle().
+ * Bursts of events end up in a single refresh.
+ */
+static void schedule_refresh(void)
+{
+	refresh_pending = true;
+	stats_redraw_requested();
+}
+
+/*
+ * Loop idle function: execute the pending refresh, at most once per
+ * REFRESH_FRAME_INTERVAL_US.
+ * Return the delay in milliseconds before the refresh can be done, -1 if none
+ * is pending.
+ */
+static int refresh_idle(void)
+{
+	uint64_t elapsed;
+
+	if (!refresh_pending)
+		return -1;
+
+	elapsed = stats_now_us() - last_refresh_us;
+
+	if (elapsed < REFRESH_FRAME_INTERVAL_US)
+		return (int) ((REFRESH_FRAME_INTERVAL_US - elapsed + 999) / 1000);
+
+	exec_refresh();
+
+	return -1;
+}
+
+/*
+ * Tell the engine which services are on screen, so that only their signals
+ * are received. In CONTEXT_SERVICES, only the rows visible and the properties
+ * displayed are watched; in the service configuration every property of the
+ * service is. Nothing is sent if the set didn't change.
+ */
+static void update_watched_services(void)
+{
+	struct json_object *cmd, *cmd_data, *serv_list, *props;
+	const char *dbus_name;
+	int i, first, count;
+
+	serv_list = json_object_new_array();
+	props = NULL;
+
+	switch (context.current_context) {
+		case CONTEXT_SERVICES:
+			// The list is being rebuilt, wait for it
+			if (!services_list) {
+				json_object_put(serv_list);
+				return;
+			}
+
+			vlist_visible(services_list, &first, &count);
+
+			for (i = first; i < first + count; i++) {
+				dbus_name = json_object_get_string(
+						json_object_array_get_idx(
+						vlist_row(services_list, i), 0));
+
+				if (dbus_name)
+					json_object_array_add(serv_list,
+						json_object_new_string(
+							dbus_name));
+			}
+
+			props = json_object_new_array();
+
+			for (i = 0; services_list_properties[i]; i++)
+				json_object_array_add(props,
+						json_object_new_string(
+						services_list_properties[i]));
+			break;
+
+		case CONTEXT_SERVICE_CONFIG:
+		case CONTEXT_SERVICE_CONFIG_STANDALONE:
+			if (context.serv->dbus_name)
+				json_object_array_add(serv_list,
+						json_object_new_string(
+						context.serv->dbus_name));
+			break;
+
+		default:
+			break;
+	}
+
+	// Empty arrays don't pass the engine validation
+	cmd_data = json_object_new_object();
+
+	if (json_object_array_length(serv_list) > 0)
+		json_object_object_add(cmd_data, key_services, serv_list);
+	else
+		json_object_put(serv_list);
+
+	if (props)
+		json_object_object_add(cmd_data, key_properties, props);
+
+	if (last_watch && strcmp(last_watch,
+				json_object_to_json_string(cmd_data)) == 0) {
+		json_object_put(cmd_data);
+		return;
+	}
+
+	free(last_watch);
+	last_watch = strdup(json_object_to_json_string(cmd_data));
+
+	cmd = json_object_new_object();
+	json_object_object_add(cmd, key_command,
+			json_object_new_string(key_engine_watch_services));
+	json_object_object_add(cmd, key_command_data, cmd_data);
+
+	if (engine_query(cmd) == -EINVAL)
+		report_error();
+}
+
 /*
  * Reset cursor position before refresh.
  * We use a value put in userptr by the renderers, this value is the "true"
@@ -370,50 +618,36 @@ static void exec_refresh(void)
  */
 void repos_cursor(void)
 {
-	int i, j;
-	struct userptr_data *tmp;
-	ITEM *item;
+	int i;
 
 	if (!context.cursor_id)
 		return;
 
-	if (nb_fields != 0) { // On forms
-
-		for (i = 0; i < nb_fields; i++) {
-			if (!(field_opts(main_fields[i]) & O_ACTIVE))
-				continue;
+	i = __renderers_cursor_index(context.cursor_id);
 
-			tmp = field_userptr(main_fields[i]);
-
-			if (strncmp(tmp->dbus_name, context.cursor_id, 256) == 0) {
-				// This trick print the page of the field and
-				// set the cursor on the correct field.
-				unpost_form(main_form);
-				main_form->curpage = main_fields[i]->page;
-				main_form->current = main_fields[i];
-				post_form(main_form);
-				break;
-			}
+	if (nb_fields != 0) { // On forms
+		if (i >= 0 && (field_opts(main_fields[i]) & O_ACTIVE)) {
+			// This trick print the page of the field and set the
+			// cursor on the correct field.
+			unpost_form(main_form);
+			main_form->curpage = main_fields[i]->page;
+			main_form->current = main_fields[i];
+			post_form(main_form);
 		}
 
 	} else if (nb_items != 0) { // On menus
-		for (i = 0; i < nb_items; i++) {
-			item = main_items[i];
-			tmp = item_userptr(item);
-
-			if (strncmp(context.cursor_id, tmp->dbus_name, 256) == 0) {
-				for (j = 0; j < i; j++)
-					menu_driver(main_menu, REQ_NEXT_ITEM);
-
-				wrefresh(main_menu->usersub);
-				break;
-			}
+		if (i >= 0) {
+			set_current_item(main_menu, main_items[i]);
+			screen_damage(main_menu->usersub);
 		}
+
+	} else if (services_list) {
+		vlist_set_current_key(services_list, context.cursor_id);
 	}
 
 	free(context.cursor_id);
 	context.cursor_id = NULL;
-	wrefresh(win_body);
+	screen_damage(win_body);
 }
 
 /*
@@ -464,6 +698,18 @@ static void exec_back(void)
 	context_actions[context.current_context].func_back();
 }
 
+/*
+ * Remember the generation of the data of a reply just rendered, see
+ * add_view_generation().
+ */
+static void set_view_generation(struct json_object *jobj)
+{
+	struct json_object *gen;
+
+	if (json_object_object_get_ex(jobj, key_generation, &gen))
+		view_generation = json_object_get_int64(gen);
+}
+
 /*
  * Execute a renderer action based on the jobj command name.
  * @param jobj See engine.c for more details.
@@ -476,12 +722,19 @@ static void action_on_cmd_callback(struct json_object *jobj)
 	json_object_object_get_ex(jobj, key_command_data, &data);
 	cmd_name = __json_get_command_str(jobj);
 
+	// The view is up to date
+	if (json_object_object_get_ex(jobj, key_unchanged, NULL))
+		return;
+
 	/* dispatch according to the command name */
-	if (strcmp(key_engine_get_home_page, cmd_name) == 0)
+	if (strcmp(key_engine_get_home_page, cmd_name) == 0) {
 		__renderers_home_page(data);
+		set_view_generation(jobj);
 
-	else if (strcmp(key_engine_get_services_from_tech, cmd_name) == 0)
+	} else if (strcmp(key_engine_get_services_from_tech, cmd_name) == 0) {
 		__renderers_services(data);
+		set_view_generation(jobj);
+	}
 
 	else if (strcmp(key_engine_get_state, cmd_name) == 0)
 		__renderers_state(data);
@@ -493,80 +746,199 @@ static void action_on_cmd_callback(struct json_object *jobj)
 		json_object_object_add(tmp, key_services, array);
 		__renderers_services(tmp);
 		json_object_put(tmp);
+		set_view_generation(jobj);
 
 	} else
 		print_info_in_footer(true, "Unknown command called");
 }
 
 /*
- * Execute a refresh or back action depending on the signal data.
- * If the technology the user is currently looking at is removed, exec_back() is
- * executed. Else, exec_refresh() is executed, see comments on allow_refresh for
- * more details.
- * @param jobj See the format in commands.c monitor_changed().
+ * Return the string member key of a change record, NULL if it has none.
+ * @param change see publish_change() in engine.c
  */
-static void action_on_signal(struct json_object *jobj)
+static const char* change_str(struct json_object *change, const char *key)
 {
-	struct json_object *sig_path, *sig_data, *sig_name;
-	json_bool tmp_bool;
-	bool is_tech_removed, is_current_tech, got_connected, got_removed;
-	const char *tmp_str;
-	char *dbus_short_name;
+	struct json_object *tmp;
 
-	json_object_object_get_ex(jobj, key_command_path, &sig_path);
-	json_object_object_get_ex(jobj, key_command_data, &sig_data);
-	json_object_object_get_ex(jobj, key_signal, &sig_name);
+	if (!json_object_object_get_ex(change, key, &tmp))
+		return NULL;
 
-	is_tech_removed = strncmp(key_sig_tech_removed, json_object_get_string(sig_name), 50) == 0;
+	return json_object_get_string(tmp);
+}
 
-	if (context.tech->dbus_name == NULL)
-		is_current_tech = false;
-	else
-		is_current_tech = strncmp(context.tech->dbus_name, json_object_to_json_string(sig_data), 256) == 0;
+/*
+ * Return true if the change record is about the technology or service with
+ * the dbus name.
+ */
+static bool change_is_about(struct json_object *change, const char *dbus_name)
+{
+	const char *path = change_str(change, key_change_path);
 
-	if (is_tech_removed && is_current_tech) {
-		exec_back();
-		return;
-	}
+	return path && dbus_name && strcmp(path, dbus_name) == 0;
+}
 
-	got_connected = false;
-	got_removed = false;
+/*
+ * Return true if the change record affects what the current context displays.
+ */
+static bool change_is_displayed(struct json_object *change)
+{
+	const char *collection = change_str(change, key_change_collection);
 
-	if (sig_data && json_object_get_type(sig_data) == json_type_array) {
-		tmp_str = json_object_get_string(json_object_array_get_idx(sig_data, 0));
-		tmp_bool = json_object_get_boolean(json_object_array_get_idx(sig_data, 1));
+	switch (context.current_context) {
+		case CONTEXT_HOME:
+			return strcmp(collection, key_services) != 0;
 
-		if (tmp_str && strcmp("Connected", tmp_str) == 0 && tmp_bool)
-			got_connected = true;
+		case CONTEXT_SERVICES:
+			return strcmp(collection, key_services) == 0 ||
+				change_is_about(change, context.tech->dbus_name);
 
-		if (tmp_str && strcmp("Favorite", tmp_str) == 0 && !tmp_bool)
-			got_removed = true;
+		case CONTEXT_SERVICE_CONFIG:
+		case CONTEXT_SERVICE_CONFIG_STANDALONE:
+			return change_is_about(change, context.serv->dbus_name);
 	}
 
-	if (context.current_context == CONTEXT_SERVICE_CONFIG ||
-			context.current_context == CONTEXT_SERVICE_CONFIG_STANDALONE) {
-		if (context.serv->dbus_name == NULL)
-			return;
+	return true;
+}
 
-		dbus_short_name = extract_dbus_short_name(context.serv->dbus_name);
+/*
+ * Return true if the change record has to be displayed even in the services
+ * list: a technology got connected or a service has been removed.
+ */
+static bool change_is_important(struct json_object *change)
+{
+	struct json_object *val;
+	const char *property = change_str(change, key_change_property);
+
+	if (!property || !json_object_object_get_ex(change, key_change_new,
+				&val))
+		return false;
+
+	if (strcmp("Connected", property) == 0 && json_object_get_boolean(val))
+		return true;
+
+	return strcmp(key_serv_favorite, property) == 0 &&
+		!json_object_get_boolean(val);
+}
+
+/*
+ * Execute a refresh or back action depending on the changes published by the
+ * engine. If the technology the user is currently looking at is removed,
+ * exec_back() is executed. Else, a refresh is scheduled if a change is
+ * displayed in the current context, see comments on allow_refresh for more
+ * details.
+ * @param jobj { "changes": [ record, ... ] }, see publish_change() in engine.c
+ */
+static void action_on_changes(struct json_object *jobj)
+{
+	struct json_object *changes, *change;
+	bool displayed = false, important = false;
+	const char *kind;
+	int i, len;
+
+	json_object_object_get_ex(jobj, key_changes, &changes);
+	len = json_object_array_length(changes);
 
-		if (strcmp(dbus_short_name, json_object_get_string(sig_path)) != 0) {
-			free(dbus_short_name);
+	for (i = 0; i < len; i++) {
+		change = json_object_array_get_idx(changes, i);
+		kind = change_str(change, key_change);
+
+		if (context.current_context != CONTEXT_HOME &&
+				strcmp(kind, key_change_kind_removed) == 0 &&
+				change_is_about(change, context.tech->dbus_name)) {
+			exec_back();
 			return;
 		}
 
-		free(dbus_short_name);
+		displayed |= change_is_displayed(change);
+		important |= change_is_important(change);
 	}
 
+	if (!displayed)
+		return;
+
 	// This is to prevent always changing wifi services in areas
 	// with a load of networks
 	if (context.current_context != CONTEXT_SERVICES ||
-			(allow_refresh || got_connected || got_removed)) {
-		exec_refresh();
+			(allow_refresh || important)) {
+		schedule_refresh();
 		allow_refresh = false;
 	}
 }
 
+static void action_on_agent_msg(struct json_object *jobj);
+static void action_on_agent_error(struct json_object *jobj);
+
+/*
+ * Return the key_agent_request_id of an agent message, 0 if none.
+ */
+static unsigned int agent_msg_id(struct json_object *jobj)
+{
+	struct json_object *id;
+
+	if (!json_object_object_get_ex(jobj, key_agent_request_id, &id))
+		return 0;
+
+	return json_object_get_int(id);
+}
+
+/*
+ * Keep an agent message until the popup is free, see agent_popup_next().
+ * @param jobj the agent message, its reference count is incremented
+ */
+static void agent_msg_push(struct json_object *jobj)
+{
+	// The agent cancels the requests it can't keep
+	if (nb_agent_msgs_pending == AGENT_MAX_REQUESTS)
+		return;
+
+	agent_msgs_pending[nb_agent_msgs_pending++] = json_object_get(jobj);
+}
+
+/*
+ * Forget the pending agent message with the id.
+ */
+static void agent_msg_drop(unsigned int id)
+{
+	int i;
+
+	for (i = 0; i < nb_agent_msgs_pending; i++) {
+		if (agent_msg_id(agent_msgs_pending[i]) != id)
+			continue;
+
+		json_object_put(agent_msgs_pending[i]);
+		nb_agent_msgs_pending--;
+		memmove(&agent_msgs_pending[i], &agent_msgs_pending[i+1],
+				sizeof(struct json_object *) *
+				(nb_agent_msgs_pending - i));
+		return;
+	}
+}
+
+/*
+ * The popup has been closed, create the popup of the next agent message.
+ */
+static void agent_popup_next(void)
+{
+	struct json_object *jobj;
+
+	popup_agent_request_id = 0;
+
+	if (nb_agent_msgs_pending == 0 || popup_exists())
+		return;
+
+	jobj = agent_msgs_pending[0];
+	nb_agent_msgs_pending--;
+	memmove(&agent_msgs_pending[0], &agent_msgs_pending[1],
+			sizeof(struct json_object *) * nb_agent_msgs_pending);
+
+	if (json_object_object_get_ex(jobj, key_agent_msg, NULL))
+		action_on_agent_msg(jobj);
+	else
+		action_on_agent_error(jobj);
+
+	json_object_put(jobj);
+}
+
 /*
  * The user pressed "OK" button on an agent request, all fields of the popup
  * form are extracted and the agent response is sent. The popup will also be
@@ -574,7 +946,7 @@ static void action_on_signal(struct json_object *jobj)
  */
 static void popup_btn_action_ok(void)
 {
-	struct json_object *cmd, *cmd_data;
+	struct json_object *cmd, *cmd_data, *fields;
 	int i;
 	char *label_str, *field_str;
 	char *label_str_clean, *field_str_clean;
@@ -583,6 +955,9 @@ static void popup_btn_action_ok(void)
 	json_object_object_add(cmd, key_command,
 			json_object_new_string(key_engine_agent_response));
 	cmd_data = json_object_new_object();
+	json_object_object_add(cmd_data, key_agent_request_id,
+			json_object_new_int(popup_agent_request_id));
+	fields = json_object_new_object();
 
 	for (i = 0; i < popup_form->maxfield; i++) {
 		label_str = field_buffer(popup_fields[i], 0);
@@ -598,16 +973,18 @@ static void popup_btn_action_ok(void)
 		if (!field_str_clean)
 			field_str_clean = "";
 
-		json_object_object_add(cmd_data, label_str_clean,
+		json_object_object_add(fields, label_str_clean,
 				json_object_new_string(field_str_clean));
 	}
 
+	json_object_object_add(cmd_data, key_agent_msg_data, fields);
 	json_object_object_add(cmd, key_command_data, cmd_data);
 
 	if (engine_query(cmd) == -EINVAL)
 		report_error();
 
 	popup_free();
+	agent_popup_next();
 }
 
 /*
@@ -616,18 +993,23 @@ static void popup_btn_action_ok(void)
  */
 static void popup_btn_action_retry(int retry)
 {
-	struct json_object *cmd;
+	struct json_object *cmd, *cmd_data;
 
 	cmd = json_object_new_object();
 	json_object_object_add(cmd, key_command,
 			json_object_new_string(key_engine_agent_retry));
-	json_object_object_add(cmd, key_command_data,
+	cmd_data = json_object_new_object();
+	json_object_object_add(cmd_data, key_agent_request_id,
+			json_object_new_int(popup_agent_request_id));
+	json_object_object_add(cmd_data, key_agent_msg_data,
 			json_object_new_boolean(retry));
+	json_object_object_add(cmd, key_command_data, cmd_data);
 
 	if (engine_query(cmd) == -EINVAL)
 		report_error();
 
 	popup_free();
+	agent_popup_next();
 }
 
 /*
@@ -715,24 +1097,43 @@ static void agent_input_popup(const char *serv_name, struct json_object *data)
 }
 
 /*
- * Create the popup from an agent request.
+ * Create the popup from an agent request. If the popup is already in use, the
+ * request waits for its turn, see agent_popup_next().
  * Note: only "Input Requested" is fully supported for now.
  * @param jobj the agent request
  */
 static void action_on_agent_msg(struct json_object *jobj)
 {
-	struct json_object *request, *service, *data;
+	struct json_object *request, *service, *data, *name;
 	const char *request_str, *service_str, *fmt = "The network %s request"
 		" credentials";
 	char buf[150];
+	unsigned int id;
 	int i;
 
-	assert(!popup_exists());
 	json_object_object_get_ex(jobj, key_agent_msg, &request);
 	json_object_object_get_ex(jobj, key_agent_msg_data, &data);
 	json_object_object_get_ex(jobj, key_service, &service);
 	request_str = json_object_get_string(request);
 	service_str = json_object_get_string(service);
+	id = agent_msg_id(jobj);
+
+	if (strcmp(key_agent_request_canceled, request_str) == 0) {
+		if (popup_exists() && id == popup_agent_request_id) {
+			popup_free();
+			agent_popup_next();
+		} else
+			agent_msg_drop(id);
+
+		return;
+	}
+
+	if (popup_exists()) {
+		agent_msg_push(jobj);
+		return;
+	}
+
+	popup_agent_request_id = id;
 
 	if (strncmp(key_agent_request_input, request_str, 15) == 0)
 		agent_input_popup(service_str, data);
@@ -749,7 +1150,11 @@ static void action_on_agent_msg(struct json_object *jobj)
 				json_object_get_string(jobj));
 	}
 
-	snprintf(buf, 150, fmt, context.serv->pretty_name);
+	// The engine adds the Name of the service when it knows it
+	if (json_object_object_get_ex(jobj, key_serv_name, &name))
+		service_str = json_object_get_string(name);
+
+	snprintf(buf, 150, fmt, service_str ? service_str : "");
 	buf[149] = '\0';
 	popup_new(18, 76, (LINES-17)/2, (COLS-75)/2,
 			agent_request_input_fields, buf);
@@ -780,7 +1185,6 @@ static void action_on_agent_error(struct json_object *jobj)
 	struct json_object *tmp;
 	struct popup_actions *popup_btn_no, *popup_btn_yes;
 
-	assert(!popup_exists());
 	json_object_object_get_ex(jobj, key_agent_error, &tmp);
 	error_msg_str = json_object_get_string(tmp);
 	json_object_object_get_ex(jobj, key_service, &tmp);
@@ -788,6 +1192,20 @@ static void action_on_agent_error(struct json_object *jobj)
 	json_object_object_get_ex(jobj, key_agent_error_message, &tmp);
 	msg_str = json_object_get_string(tmp);
 
+	// Errors of the agent itself (e.g. registration) can't be answered
+	if (agent_msg_id(jobj) == 0) {
+		print_info_in_footer2(true, "Agent error: %s %s",
+				error_msg_str, service_str);
+		return;
+	}
+
+	if (popup_exists()) {
+		agent_msg_push(jobj);
+		return;
+	}
+
+	popup_agent_request_id = agent_msg_id(jobj);
+
 	snprintf(buf, 150, fmt, error_msg_str, service_str, msg_str);
 	buf[149] = '\0';
 
@@ -811,39 +1229,47 @@ static void action_on_agent_error(struct json_object *jobj)
  * Dispatch the callback data to the appropriate functions based on the presence
  * of the attributes in jobj:
  *	- key_command
- *	- key_signal
+ *	- key_changes
  *	- key_agent_msg
  *	- key_agent_error
- *	- key_return_force_refresh
+ *	- key_request_id of an action, see query_action()
  * @param status the status code of this callback, status < 0 is an error
  * @param jobj see above
  */
 static void main_callback(int status, struct json_object *jobj)
 {
-	struct json_object *cmd_tmp, *signal, *agent_msg, *agent_error,
-			*return_user_data, *error;
-	const char *error_str;
+	struct json_object *cmd_tmp, *changes, *agent_msg, *agent_error,
+			*error;
+	const char *error_str, *action;
 
 	json_object_object_get_ex(jobj, key_error, &error);
 	error_str = json_object_get_string(error);
+	action = action_of_reply(jobj);
 
 	if (status < 0) {
-		print_info_in_footer2(true, "Error (code %d) %s", -status,
+		print_info_in_footer2(true, "Error (code %d) %s%s%s", -status,
+				action ? action : "", action ? ": " : "",
 				error_str ? error_str : "[ no error message ]");
 	}
 
 	/* get the main object items */
 	json_object_object_get_ex(jobj, key_command, &cmd_tmp);
-	json_object_object_get_ex(jobj, key_signal, &signal);
+	json_object_object_get_ex(jobj, key_changes, &changes);
 	json_object_object_get_ex(jobj, key_agent_msg, &agent_msg);
 	json_object_object_get_ex(jobj, key_agent_error, &agent_error);
-	json_object_object_get_ex(jobj, key_return_force_refresh, &return_user_data);
 
-	if (cmd_tmp)
+	if (cmd_tmp) {
+		stats_stage_begin(STATS_STAGE_RENDER);
 		action_on_cmd_callback(jobj);
-
-	else if (signal)
-		action_on_signal(jobj);
+		stats_stage_end(STATS_STAGE_RENDER);
+		stats_render_done();
+		update_watched_services();
+
+	} else if (changes) {
+		stats_stage_begin(STATS_STAGE_RENDER);
+		action_on_changes(jobj);
+		stats_stage_end(STATS_STAGE_RENDER);
+	}
 
 	else if (agent_msg)
 		action_on_agent_msg(jobj);
@@ -851,9 +1277,9 @@ static void main_callback(int status, struct json_object *jobj)
 	else if (agent_error)
 		action_on_agent_error(jobj);
 
-	else if (return_user_data) {
+	else if (action) {
 		allow_refresh = true;
-		exec_refresh();
+		schedule_refresh();
 
 	} else {
 		int i = 0;
@@ -879,18 +1305,37 @@ static void main_callback(int status, struct json_object *jobj)
 		win_driver(&win_help, 0);
 }
 
+/*
+ * Add the generation of the data on screen to the data of a query: if the
+ * view is being refreshed and nothing changed, the engine replies
+ * "unchanged" and nothing is redrawn (see action_on_cmd_callback).
+ * @param cmd_data the data of the query
+ */
+static void add_view_generation(struct json_object *cmd_data)
+{
+	if (view_generation >= 0)
+		json_object_object_add(cmd_data, key_generation,
+				json_object_new_int64(view_generation));
+}
+
 /*
  * Asks for the home page.
  */
 static void print_home_page(void)
 {
-	struct json_object *cmd;
+	struct json_object *cmd, *tmp;
 
-	werase(win_footer);
 	cmd = json_object_new_object();
 	json_object_object_add(cmd, key_command,
 			json_object_new_string(key_engine_get_home_page));
 
+	if (view_generation >= 0) {
+		tmp = json_object_new_object();
+		add_view_generation(tmp);
+		json_object_object_add(cmd, key_command_data, tmp);
+	} else
+		werase(win_footer);
+
 	if (engine_query(cmd) == -EINVAL)
 		report_error();
 }
@@ -928,6 +1373,7 @@ static void print_services_for_tech(void)
 			json_object_new_string(key_engine_get_services_from_tech));
 	json_object_object_add(tmp, key_technology,
 			json_object_new_string(context.tech->dbus_name));
+	add_view_generation(tmp);
 	json_object_object_add(cmd, key_command_data, tmp);
 
 	if (engine_query(cmd) == -EINVAL)
@@ -953,13 +1399,12 @@ static void connect_to_service(void)
 			json_object_new_string(context.serv->dbus_name));
 	json_object_object_add(cmd, key_command_data, tmp);
 
-	if (engine_query(cmd) == -EINVAL)
-		report_error();
+	query_action(cmd, key_engine_connect);
 
 	werase(win_body);
 	mvwprintw(win_body, 1, 2, "Connecting...");
 	box(win_body, 0, 0);
-	wrefresh(win_body);
+	screen_damage(win_body);
 }
 
 /*
@@ -982,8 +1427,7 @@ static void disconnect_of_service(struct userptr_data *data)
 			json_object_new_string(data->dbus_name));
 	json_object_object_add(cmd, key_command_data, tmp);
 
-	if (engine_query(cmd) == -EINVAL)
-		report_error();
+	query_action(cmd, key_engine_disconnect);
 }
 
 /*
@@ -1006,8 +1450,7 @@ static void toggle_power_tech(struct userptr_data *data)
 			json_object_new_string(data->dbus_name));
 	json_object_object_add(cmd, key_command_data, tmp);
 
-	if (engine_query(cmd) == -EINVAL)
-		report_error();
+	query_action(cmd, key_engine_toggle_tech_power);
 }
 
 /*
@@ -1021,8 +1464,7 @@ static void toggle_offline_mode()
 	json_object_object_add(cmd, key_command,
 			json_object_new_string(key_engine_toggle_offline_mode));
 
-	if (engine_query(cmd) == -EINVAL)
-		report_error();
+	query_action(cmd, key_engine_toggle_offline_mode);
 }
 
 /*
@@ -1045,8 +1487,7 @@ static void scan_tech(const char *tech_dbus_name)
 			json_object_new_string(key_engine_scan_tech));
 	json_object_object_add(cmd, key_command_data, tmp);
 
-	if (engine_query(cmd) == -EINVAL)
-		report_error();
+	query_action(cmd, key_engine_scan_tech);
 }
 
 /*
@@ -1070,8 +1511,7 @@ static void remove_service(struct userptr_data *data)
 			json_object_new_string(data->dbus_name));
 	json_object_object_add(cmd, key_command_data, tmp);
 
-	if (engine_query(cmd) == -EINVAL)
-		report_error();
+	query_action(cmd, key_engine_remove_service);
 }
 
 /*
@@ -1092,6 +1532,7 @@ static void get_service_settings(void)
 			json_object_new_string(key_engine_get_service));
 	json_object_object_add(tmp, key_service,
 			json_object_new_string(context.serv->dbus_name));
+	add_view_generation(tmp);
 	json_object_object_add(cmd, key_command_data, tmp);
 
 	if (engine_query(cmd) == -EINVAL)
@@ -1247,8 +1688,18 @@ static void modify_service_config(void)
 	json_object_object_add(cmd, key_command,
 			json_object_new_string(key_engine_config_service));
 
-	if (engine_query(cmd) == -EINVAL)
-		report_error();
+	query_action(cmd, key_engine_config_service);
+}
+
+/*
+ * Apply an edition request to the current field of the configuration form.
+ * The field is marked as changed: refreshes won't overwrite it, see
+ * __renderers_services.
+ */
+static void form_edit(int req)
+{
+	form_driver(main_form, req);
+	set_field_status(current_field(main_form), TRUE);
 }
 
 /*
@@ -1301,18 +1752,18 @@ static void exec_action_context_home(int ch)
  */
 static void exec_action_context_service_config(int ch)
 {
-	int cur_page = form_page(main_form);
+	int cur_page = form_page(main_form), i;
 	struct userptr_data *data;
 
 	if (field_type(current_field(main_form)) == TYPE_ENUM) {
 		switch (ch) {
 			case KEY_LEFT:
-				form_driver(main_form, REQ_PREV_CHOICE);
+				form_edit(REQ_PREV_CHOICE);
 				return;
 
 			case ' ':
 			case KEY_RIGHT:
-				form_driver(main_form, REQ_NEXT_CHOICE);
+				form_edit(REQ_NEXT_CHOICE);
 				return;
 
 			case KEY_UP:
@@ -1351,12 +1802,12 @@ static void exec_action_context_service_config(int ch)
 		// Delete the char before cursor
 		case KEY_BACKSPACE:
 		case 127:
-			form_driver(main_form, REQ_DEL_PREV);
+			form_edit(REQ_DEL_PREV);
 			break;
 
 		// Delete the char under the cursor
 		case KEY_DC:
-			form_driver(main_form, REQ_DEL_CHAR);
+			form_edit(REQ_DEL_CHAR);
 			break;
 
 		case KEY_LEFT:
@@ -1380,11 +1831,16 @@ static void exec_action_context_service_config(int ch)
 			context.serv->dbus_name = strdup(data->dbus_name);
 			modify_service_config();
 			print_info_in_footer(false, "Configuring...");
+
+			// The edits are submitted, connman has the last word
+			for (i = 0; i < nb_fields; i++)
+				set_field_status(main_fields[i], FALSE);
+
 			break;
 
 		default:
 			if ((unsigned) field_opts(current_field(main_form)) & O_EDIT)
-				form_driver(main_form, ch);
+				form_edit(ch);
 			break;
 	}
 }
@@ -1394,31 +1850,41 @@ static void exec_action_context_service_config(int ch)
  */
 static void exec_action_context_services(int ch)
 {
-	ITEM *item;
 	struct userptr_data *userptr;
 
 	switch (ch) {
 		case KEY_DOWN:
-			menu_driver(main_menu, REQ_DOWN_ITEM);
+			if (services_list)
+				vlist_driver(services_list, VLIST_REQ_DOWN);
 			break;
 
 		case KEY_UP:
-			menu_driver(main_menu, REQ_UP_ITEM);
+			if (services_list)
+				vlist_driver(services_list, VLIST_REQ_UP);
+			break;
+
+		case KEY_NPAGE:
+			if (services_list)
+				vlist_driver(services_list, VLIST_REQ_PAGE_DOWN);
+			break;
+
+		case KEY_PPAGE:
+			if (services_list)
+				vlist_driver(services_list, VLIST_REQ_PAGE_UP);
 			break;
 
 		case 'r':
-			item = current_item(main_menu);
-			remove_service(item_userptr(item));
+			remove_service(__renderers_services_current());
 			break;
 
 		case KEY_ENTER:
 		case 10:
-			item = current_item(main_menu);
+			userptr = __renderers_services_current();
 
-			if (!item) // No services available but the user presses Enter
+			if (!userptr) // No services available but the user presses Enter
 				break;
 
-			exec_action(item_userptr(item));
+			exec_action(userptr);
 			print_info_in_footer(false, "Connecting...");
 			break;
 
@@ -1432,8 +1898,7 @@ static void exec_action_context_services(int ch)
 			break;
 
 		case 's':
-			item = current_item(main_menu);
-			userptr = item_userptr(item);
+			userptr = __renderers_services_current();
 
 			if (!userptr)
 				break;
@@ -1445,6 +1910,51 @@ static void exec_action_context_services(int ch)
 	}
 }
 
+/*
+ * Debug keystroke: the first hit starts the loop instrumentation, next hits
+ * dump the collected data in stats_dump_path() and print a summary in the
+ * footer.
+ */
+static void toggle_stats(void)
+{
+	struct json_object *jstats, *loop, *iterations, *msgs, *max_msgs,
+			   *backlog;
+	const char *path;
+	int res;
+
+	if (!stats_enabled()) {
+		stats_enable(true);
+		print_info_in_footer(false, "Instrumentation started, 'F8' to "
+				"dump it");
+		return;
+	}
+
+	path = stats_dump_path();
+	res = stats_dump(path);
+
+	if (res < 0) {
+		print_info_in_footer(true, "Couldn't write %s: %s",
+				path, strerror(-res));
+		return;
+	}
+
+	jstats = stats_to_json();
+	json_object_object_get_ex(jstats, "loop", &loop);
+	json_object_object_get_ex(loop, "iterations", &iterations);
+	json_object_object_get_ex(loop, "dispatched_msgs", &msgs);
+	json_object_object_get_ex(loop, "dispatched_max_per_wakeup", &max_msgs);
+	json_object_object_get_ex(loop, "backlog_depth_max", &backlog);
+
+	print_info_in_footer(false, "Instrumentation dumped in %s", path);
+	print_info_in_footer2(false, "%s iterations, %s messages dispatched "
+			"(at most %s per wakeup, backlog %s)",
+			json_object_get_string(iterations),
+			json_object_get_string(msgs),
+			json_object_get_string(max_msgs),
+			json_object_get_string(backlog));
+	json_object_put(jstats);
+}
+
 /*
  * Called by the main loop, dispatch key pressed according to the context.
  */
@@ -1460,8 +1970,8 @@ void ncurses_action(void)
 			return;
 
 		// If the user hit 'Esc', we have to force the redraw of win_body
-		redrawwin(win_body);
-		wrefresh(win_body);
+		touchwin(win_body);
+		screen_damage(win_body);
 		return;
 	}
 
@@ -1473,8 +1983,8 @@ void ncurses_action(void)
 			return;
 
 		// If the user hit 'Esc', we have to force the redraw of win_body
-		redrawwin(win_body);
-		wrefresh(win_body);
+		touchwin(win_body);
+		screen_damage(win_body);
 		return;
 	}
 
@@ -1489,10 +1999,16 @@ void ncurses_action(void)
 	}
 
 	if (ch == KEY_F(5)) {
+		refresh_from_scratch = true;
 		exec_refresh();
 		return;
 	}
 
+	if (ch == KEY_F(8)) {
+		toggle_stats();
+		return;
+	}
+
 	if (ch == KEY_F(1)) {
 		get_help_window();
 		win_refresh(win_help);
@@ -1517,6 +2033,7 @@ void ncurses_action(void)
 
 		case CONTEXT_SERVICES:
 			exec_action_context_services(ch);
+			update_watched_services();
 			break;
 
 		default:
@@ -1525,19 +2042,137 @@ void ncurses_action(void)
 			break;
 	}
 
-	wrefresh(win_body);
+	screen_damage(win_body);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-a bus] [-b messages] [-B microseconds] "
+			"[-c milliseconds] [-k file] [-K]\n"
+			"       [-w trace] [-r trace [-x speed]]\n"
+			"  -a  bus of connman: system (default), session or a "
+			"dbus address\n"
+			"  -b  dbus messages dispatched before polling stdin "
+			"again (default %d, 0: no limit)\n"
+			"  -B  time spent dispatching dbus messages before "
+			"polling stdin again (default %d, 0: no limit)\n"
+			"  -c  window coalescing PropertyChanged signals "
+			"(default %d, 0: per loop iteration)\n"
+			"  -k  json file of the credentials given to the agent "
+			"without asking\n"
+			"  -K  remember the credentials typed until the end of "
+			"the session\n"
+			"  -w  record the messages of connman in a trace file\n"
+			"  -r  replay a trace file instead of using a bus\n"
+			"  -x  speed of the replay: 1 (default) as recorded, n "
+			"times faster, 0 as fast as possible\n",
+			prog, LOOP_DEFAULT_BUDGET_MSGS,
+			LOOP_DEFAULT_BUDGET_US, COALESCE_DEFAULT_WINDOW_MS);
+}
+
+/*
+ * Parse an unsigned integer option, exit on error.
+ */
+static unsigned int parse_uint_opt(const char *prog, const char *arg)
+{
+	char *end;
+	long val;
+
+	errno = 0;
+	val = strtol(arg, &end, 10);
+
+	if (errno || *end != '\0' || end == arg || val < 0) {
+		usage(prog);
+		exit(1);
+	}
+
+	return (unsigned int) val;
 }
 
 /*
  * Initialize everything, run the loop then terminate everything.
  */
-int main(void)
+int main(int argc, char *argv[])
 {
 	struct sigaction sig_int, sig_winch;
+	unsigned int budget_msgs = LOOP_DEFAULT_BUDGET_MSGS;
+	unsigned int budget_us = LOOP_DEFAULT_BUDGET_US;
+	const char *credentials_path = NULL;
+	const char *record_path = NULL, *replay_path = NULL;
+	unsigned int replay_speed = 1;
+	int opt, res;
+
+	while ((opt = getopt(argc, argv, "a:b:B:c:k:Kw:r:x:h")) != -1) {
+		switch (opt) {
+			case 'a':
+				engine_set_bus(optarg);
+				break;
+
+			case 'b':
+				budget_msgs = parse_uint_opt(argv[0], optarg);
+				break;
+
+			case 'B':
+				budget_us = parse_uint_opt(argv[0], optarg);
+				break;
+
+			case 'c':
+				coalesce_set_window(parse_uint_opt(argv[0],
+							optarg));
+				break;
+
+			case 'k':
+				credentials_path = optarg;
+				break;
+
+			case 'K':
+				credentials_remember_answers(true);
+				break;
+
+			case 'w':
+				record_path = optarg;
+				break;
+
+			case 'r':
+				replay_path = optarg;
+				break;
+
+			case 'x':
+				replay_speed = parse_uint_opt(argv[0], optarg);
+				break;
+
+			default:
+				usage(argv[0]);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	// The startup replies are recorded (or replayed) too
+	if (record_path && (res = engine_record(record_path)) < 0) {
+		fprintf(stderr, "[-] Couldn't record in %s: %s\n",
+				record_path, strerror(-res));
+		exit(1);
+	}
+
+	if (replay_path && (res = engine_replay(replay_path,
+					replay_speed)) < 0) {
+		fprintf(stderr, "[-] Couldn't replay %s: %s\n", replay_path,
+				strerror(-res));
+		exit(1);
+	}
 
 	if (engine_init() < 0)
 		exit(1);
 
+	// The entries are checked with the trusted json of the engine
+	if (credentials_path &&
+			(res = credentials_load(credentials_path)) < 0) {
+		fprintf(stderr, "[-] Couldn't load the credentials in %s: %s\n",
+				credentials_path, strerror(-res));
+		engine_terminate();
+		exit(1);
+	}
+
 	engine_callback = main_callback;
 
 	// Affect actions to SIGINT and SIGWINCH
@@ -1551,6 +2186,9 @@ int main(void)
 	sigaction(SIGWINCH, &sig_winch, NULL);
 
 	loop_init();
+	loop_set_dispatch_budget(budget_msgs, budget_us);
+	loop_add_idle(refresh_idle);
+	loop_add_idle(screen_idle);
 
 	initscr();
 	assert(LINES >= 24 && COLS >= 80);
@@ -1572,10 +2210,15 @@ int main(void)
 	print_home_page();
 
 	loop_run(true);
+	res = record_path ? engine_record_stop() : 0;
 	loop_terminate();
 
 	delete_win();
 	endwin();
 
+	if (res < 0)
+		fprintf(stderr, "[-] Couldn't record in %s: %s\n",
+				record_path, strerror(-res));
+
 	return 0;
 }
@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Run a command next to a mock connman (connman_mock) on a private bus:
+#	./mock-bus.sh [connman_mock options] -- command [arguments]
+# @BUS@ in the arguments is replaced by the address of the bus, which is also
+# in $MOCK_BUS, e.g.:
+#	./mock-bus.sh -n 200 -r 1000 -- ./connman_ncurses -a @BUS@
+
+MOCK_ARGS=()
+
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+	MOCK_ARGS+=("$1")
+	shift
+done
+
+shift
+
+if [ $# -eq 0 ]; then
+	echo "Usage: $0 [connman_mock options] -- command [arguments]" >&2
+	exit 1
+fi
+
+DIR=$(dirname "$0")
+BUS=($(dbus-daemon --session --fork --print-address=1 --print-pid=1)) || exit 1
+export MOCK_BUS=${BUS[0]}
+trap 'kill $MOCK_PID ${BUS[1]} 2>/dev/null' EXIT
+
+"$DIR/connman_mock" -a "$MOCK_BUS" "${MOCK_ARGS[@]}" &
+MOCK_PID=$!
+
+# Wait for the mock to own net.connman
+for i in $(seq 50); do
+	dbus-send --bus="$MOCK_BUS" --print-reply --dest=org.freedesktop.DBus \
+		/ org.freedesktop.DBus.NameHasOwner string:net.connman \
+		2>/dev/null | grep -q true && break
+	sleep 0.1
+done
+
+ARGS=()
+
+for arg in "$@"; do
+	ARGS+=("${arg//@BUS@/$MOCK_BUS}")
+done
+
+"${ARGS[@]}"
@@ -0,0 +1,1329 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+#include <dbus/dbus.h>
+
+#include "trace.h"
+
+/*
+ * A stand-in for connmand, to run the clients without connman: it owns
+ * net.connman on the bus given (usually a private one, see mock-bus.sh) and
+ * serves the Manager, Technology and Service methods used by commands.c with a
+ * wired service and mock wifi services. Connecting to a new secured service
+ * asks the passphrase to the registered agent.
+ * It can emit a signal storm at a given rate, see usage().
+ * What it sends can be written in a trace (see trace.c). Without a bus, it
+ * plays a client session and a storm to write a trace, see script_session().
+ */
+
+#define MOCK_MAX_SERVICES 4096
+
+#define MOCK_PATH_MAX_LEN 96
+
+#define MOCK_NAME_MAX_LEN 16
+
+// At most this many storm signals are sent between two dispatches.
+#define MOCK_STORM_BATCH 1024
+
+#define MOCK_WIFI_PATH "/net/connman/technology/wifi"
+
+#define MOCK_ERROR "net.connman.Error."
+
+// The client played without a bus, see script_session().
+#define MOCK_SCRIPT_CLIENT ":1.1"
+#define MOCK_SCRIPT_AGENT "/connman_json_agent"
+
+enum storm_kind {
+	STORM_STRENGTH,		// Service PropertyChanged Strength
+	STORM_SERVICES,		// Manager ServicesChanged
+	STORM_STATE,		// Manager PropertyChanged State
+	STORM_MIXED,		// all of the above in turn
+	STORM_CHURN,		// a service leaves and comes back (ServicesChanged)
+};
+
+static const char *storm_kinds[] = { "strength", "services", "state", "mixed",
+	"churn", NULL };
+
+struct mock_service {
+	char path[MOCK_PATH_MAX_LEN];
+	char name[MOCK_NAME_MAX_LEN];
+	bool is_wifi;
+	const char *security;
+	const char *state;
+	unsigned char strength;
+	bool favorite;
+	dbus_bool_t autoconnect;
+	DBusMessage *connecting;	// Connect waiting for the agent
+	bool out_of_range;		// removed by the churn storm
+};
+
+static struct {
+	const char *path;
+	const char *name;
+	const char *type;
+	dbus_bool_t powered;
+	dbus_bool_t connected;
+} technologies[] = {
+	{ "/net/connman/technology/ethernet", "Wired", "ethernet", TRUE, TRUE },
+	{ MOCK_WIFI_PATH, "WiFi", "wifi", TRUE, FALSE },
+	{ NULL },
+};
+
+static DBusConnection *conn;
+
+static struct mock_service services[MOCK_MAX_SERVICES];
+
+static int nb_services;
+
+static const char *manager_state = "online";
+
+static dbus_bool_t offline_mode;
+
+// The agent registered, NULL if none.
+static char *agent_owner, *agent_path;
+
+static enum storm_kind storm_kind = STORM_STRENGTH;
+
+// Storm signals per second, 0 for no storm.
+static unsigned int storm_rate;
+
+// Storm signals to send, 0 for no limit.
+static unsigned long storm_count;
+
+static unsigned long storm_sent;
+
+static unsigned int seed = 1;
+
+// The trace of what is sent, NULL if none, see trace_time().
+static struct trace *trace;
+
+// Without a bus, the time of the trace is made up, see script_session().
+static uint64_t trace_start_us, script_time_us;
+
+static volatile sig_atomic_t running = 1;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Return the time of a message written in the trace.
+ */
+static uint64_t trace_time(void)
+{
+	if (!conn)
+		return script_time_us;
+
+	return now_us() - trace_start_us;
+}
+
+static const char* type_signature(int type)
+{
+	switch (type) {
+		case DBUS_TYPE_BOOLEAN:
+			return DBUS_TYPE_BOOLEAN_AS_STRING;
+
+		case DBUS_TYPE_BYTE:
+			return DBUS_TYPE_BYTE_AS_STRING;
+
+		default:
+			return DBUS_TYPE_STRING_AS_STRING;
+	}
+}
+
+/*
+ * Append a variant holding a basic value.
+ */
+static void append_variant(DBusMessageIter *iter, int type, const void *val)
+{
+	DBusMessageIter variant;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT,
+			type_signature(type), &variant);
+	dbus_message_iter_append_basic(&variant, type, val);
+	dbus_message_iter_close_container(iter, &variant);
+}
+
+/*
+ * Append a { key: variant } entry to an a{sv} dictionary.
+ */
+static void append_entry(DBusMessageIter *dict, const char *key, int type,
+		const void *val)
+{
+	DBusMessageIter entry;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	append_variant(&entry, type, val);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+/*
+ * Append a { key: array of strings } entry.
+ * @param strs the strings, NULL terminated
+ */
+static void append_entry_strings(DBusMessageIter *dict, const char *key,
+		const char **strs)
+{
+	DBusMessageIter entry, variant, array;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "as",
+			&variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "s",
+			&array);
+
+	for (; *strs; strs++)
+		dbus_message_iter_append_basic(&array, DBUS_TYPE_STRING, strs);
+
+	dbus_message_iter_close_container(&variant, &array);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+/*
+ * Append a { key: { string: string } } entry.
+ * @param pairs keys and values in turn, NULL terminated
+ */
+static void append_entry_dict(DBusMessageIter *dict, const char *key,
+		const char **pairs)
+{
+	DBusMessageIter entry, variant, sub;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "a{sv}",
+			&variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "{sv}",
+			&sub);
+
+	for (; pairs[0] && pairs[1]; pairs += 2)
+		append_entry(&sub, pairs[0], DBUS_TYPE_STRING, &pairs[1]);
+
+	dbus_message_iter_close_container(&variant, &sub);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static bool service_is_connected(struct mock_service *serv)
+{
+	return strcmp(serv->state, "ready") == 0 ||
+		strcmp(serv->state, "online") == 0;
+}
+
+/*
+ * A wifi service is visible when wifi is powered and it's in range.
+ */
+static bool service_is_visible(struct mock_service *serv)
+{
+	return !serv->is_wifi || (technologies[1].powered &&
+			!serv->out_of_range);
+}
+
+static void append_service_dict(DBusMessageIter *iter,
+		struct mock_service *serv)
+{
+	DBusMessageIter dict;
+	dbus_bool_t favorite = serv->favorite, immutable = FALSE;
+	const char *type = serv->is_wifi ? "wifi" : "ethernet";
+	const char *name = serv->name;
+	const char *security[] = { serv->security, NULL };
+	const char *none[] = { NULL };
+	const char *nameservers[] = { "192.168.1.1", NULL };
+	const char *ethernet[] = { "Method", "auto", "Interface",
+		serv->is_wifi ? "wlan0" : "eth0", "Address",
+		"00:11:22:33:44:55", NULL };
+	const char *ipv4[] = { "Method", "dhcp", "Address", "192.168.1.42",
+		"Netmask", "255.255.255.0", "Gateway", "192.168.1.1", NULL };
+	const char *ipv4_config[] = { "Method", "dhcp", NULL };
+	const char *ipv6_config[] = { "Method", "auto", "Privacy", "disabled",
+		NULL };
+	const char *proxy[] = { "Method", "direct", NULL };
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+	append_entry(&dict, "Type", DBUS_TYPE_STRING, &type);
+	append_entry_strings(&dict, "Security", serv->is_wifi ? security : none);
+	append_entry(&dict, "State", DBUS_TYPE_STRING, &serv->state);
+
+	if (serv->is_wifi)
+		append_entry(&dict, "Strength", DBUS_TYPE_BYTE, &serv->strength);
+
+	append_entry(&dict, "Favorite", DBUS_TYPE_BOOLEAN, &favorite);
+	append_entry(&dict, "Immutable", DBUS_TYPE_BOOLEAN, &immutable);
+	append_entry(&dict, "AutoConnect", DBUS_TYPE_BOOLEAN,
+			&serv->autoconnect);
+	append_entry(&dict, "Name", DBUS_TYPE_STRING, &name);
+	append_entry_dict(&dict, "Ethernet", ethernet);
+	append_entry_dict(&dict, "IPv4", service_is_connected(serv) ?
+			ipv4 : none);
+	append_entry_dict(&dict, "IPv4.Configuration", ipv4_config);
+	append_entry_dict(&dict, "IPv6", none);
+	append_entry_dict(&dict, "IPv6.Configuration", ipv6_config);
+	append_entry_strings(&dict, "Nameservers", service_is_connected(serv) ?
+			nameservers : none);
+	append_entry_strings(&dict, "Nameservers.Configuration", none);
+	append_entry_strings(&dict, "Timeservers", none);
+	append_entry_strings(&dict, "Timeservers.Configuration", none);
+	append_entry_strings(&dict, "Domains", none);
+	append_entry_strings(&dict, "Domains.Configuration", none);
+	append_entry_dict(&dict, "Proxy", proxy);
+	append_entry_dict(&dict, "Proxy.Configuration", none);
+	append_entry_dict(&dict, "Provider", none);
+	dbus_message_iter_close_container(iter, &dict);
+}
+
+/*
+ * Append a (oa{sv}) structure of a service.
+ * @param only the property to put in the dictionary, NULL for all of them and
+ *	"" for none (ServicesChanged lists unchanged services without
+ *	properties)
+ */
+static void append_service(DBusMessageIter *array, struct mock_service *serv,
+		const char *only)
+{
+	DBusMessageIter st, dict;
+	const char *path = serv->path;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, NULL, &st);
+	dbus_message_iter_append_basic(&st, DBUS_TYPE_OBJECT_PATH, &path);
+
+	if (only == NULL)
+		append_service_dict(&st, serv);
+
+	else {
+		dbus_message_iter_open_container(&st, DBUS_TYPE_ARRAY, "{sv}",
+				&dict);
+
+		if (strcmp(only, "Strength") == 0)
+			append_entry(&dict, "Strength", DBUS_TYPE_BYTE,
+					&serv->strength);
+
+		dbus_message_iter_close_container(&st, &dict);
+	}
+
+	dbus_message_iter_close_container(array, &st);
+}
+
+static void append_technology_dict(DBusMessageIter *iter, int i)
+{
+	DBusMessageIter dict;
+	dbus_bool_t tethering = FALSE;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+	append_entry(&dict, "Name", DBUS_TYPE_STRING, &technologies[i].name);
+	append_entry(&dict, "Type", DBUS_TYPE_STRING, &technologies[i].type);
+	append_entry(&dict, "Powered", DBUS_TYPE_BOOLEAN,
+			&technologies[i].powered);
+	append_entry(&dict, "Connected", DBUS_TYPE_BOOLEAN,
+			&technologies[i].connected);
+	append_entry(&dict, "Tethering", DBUS_TYPE_BOOLEAN, &tethering);
+	dbus_message_iter_close_container(iter, &dict);
+}
+
+/*
+ * Append a (oa{sv}) structure of a technology.
+ */
+static void append_technology(DBusMessageIter *array, int i)
+{
+	DBusMessageIter st;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, NULL, &st);
+	dbus_message_iter_append_basic(&st, DBUS_TYPE_OBJECT_PATH,
+			&technologies[i].path);
+	append_technology_dict(&st, i);
+	dbus_message_iter_close_container(array, &st);
+}
+
+static void send_signal(DBusMessage *sig)
+{
+	if (!sig)
+		return;
+
+	if (trace && trace_write(trace, trace_time(), sig, NULL) < 0)
+		fprintf(stderr, "[-] Failed to write the trace\n");
+
+	if (conn)
+		dbus_connection_send(conn, sig, NULL);
+
+	dbus_message_unref(sig);
+}
+
+/*
+ * Send the reply of a method call, the trace tells which call it answers.
+ */
+static void send_reply(DBusMessage *call, DBusMessage *reply)
+{
+	if (!reply)
+		return;
+
+	if (trace && trace_write(trace, trace_time(), reply, call) < 0)
+		fprintf(stderr, "[-] Failed to write the trace\n");
+
+	if (conn)
+		dbus_connection_send(conn, reply, NULL);
+
+	dbus_message_unref(reply);
+}
+
+static void property_changed(const char *path, const char *interface,
+		const char *name, int type, const void *val)
+{
+	DBusMessage *sig;
+	DBusMessageIter iter;
+
+	sig = dbus_message_new_signal(path, interface, "PropertyChanged");
+	dbus_message_iter_init_append(sig, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &name);
+	append_variant(&iter, type, val);
+	send_signal(sig);
+}
+
+/*
+ * Emit ServicesChanged: every visible service in order, with the properties of
+ * changed (all of them if only is NULL), and the wifi services removed if wifi
+ * is off.
+ * @param changed the service changed, NULL if all of them changed
+ */
+static void services_changed(struct mock_service *changed, const char *only)
+{
+	DBusMessage *sig;
+	DBusMessageIter iter, array;
+	const char *path;
+	int i;
+
+	sig = dbus_message_new_signal("/", "net.connman.Manager",
+			"ServicesChanged");
+	dbus_message_iter_init_append(sig, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(oa{sv})",
+			&array);
+
+	for (i = 0; i < nb_services; i++) {
+		if (!service_is_visible(&services[i]))
+			continue;
+
+		append_service(&array, &services[i], !changed ? NULL :
+				&services[i] == changed ? only : "");
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "o", &array);
+
+	for (i = 0; i < nb_services; i++) {
+		if (service_is_visible(&services[i]))
+			continue;
+
+		path = services[i].path;
+		dbus_message_iter_append_basic(&array, DBUS_TYPE_OBJECT_PATH,
+				&path);
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+	send_signal(sig);
+}
+
+/*
+ * Update Connected of the technologies and State of the manager.
+ */
+static void update_connected(void)
+{
+	dbus_bool_t connected;
+	const char *state;
+	int i, j;
+
+	for (i = 0; technologies[i].path; i++) {
+		connected = FALSE;
+
+		for (j = 0; j < nb_services; j++) {
+			if (services[j].is_wifi == (i == 1) &&
+					service_is_connected(&services[j]))
+				connected = TRUE;
+		}
+
+		if (connected != technologies[i].connected) {
+			technologies[i].connected = connected;
+			property_changed(technologies[i].path,
+					"net.connman.Technology", "Connected",
+					DBUS_TYPE_BOOLEAN, &connected);
+		}
+	}
+
+	state = technologies[0].connected || technologies[1].connected ?
+		"online" : "idle";
+
+	if (strcmp(state, manager_state) != 0) {
+		manager_state = state;
+		property_changed("/", "net.connman.Manager", "State",
+				DBUS_TYPE_STRING, &state);
+	}
+}
+
+static void set_state(struct mock_service *serv, const char *state)
+{
+	serv->state = state;
+	property_changed(serv->path, "net.connman.Service", "State",
+			DBUS_TYPE_STRING, &state);
+}
+
+static DBusMessage* error_reply(DBusMessage *msg, const char *error)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), MOCK_ERROR "%s", error);
+
+	return dbus_message_new_error(msg, name, NULL);
+}
+
+/*
+ * Go through the states of a connection, up to online.
+ */
+static void connect_done(struct mock_service *serv)
+{
+	dbus_bool_t favorite = TRUE;
+
+	set_state(serv, "association");
+	set_state(serv, "configuration");
+	set_state(serv, "ready");
+
+	if (!serv->favorite) {
+		serv->favorite = true;
+		property_changed(serv->path, "net.connman.Service", "Favorite",
+				DBUS_TYPE_BOOLEAN, &favorite);
+	}
+
+	set_state(serv, "online");
+	update_connected();
+}
+
+/*
+ * The agent answered RequestInput: connect if it gave a passphrase.
+ */
+static void agent_input_done(struct mock_service *serv, bool has_passphrase)
+{
+	DBusMessage *connect_reply;
+
+	if (!serv->connecting)
+		return;
+
+	if (has_passphrase) {
+		connect_done(serv);
+		connect_reply = dbus_message_new_method_return(serv->connecting);
+	} else {
+		set_state(serv, "failure");
+		connect_reply = error_reply(serv->connecting, "OperationAborted");
+	}
+
+	send_reply(serv->connecting, connect_reply);
+	dbus_message_unref(serv->connecting);
+	serv->connecting = NULL;
+}
+
+static void agent_input_return(DBusPendingCall *call, void *user_data)
+{
+	struct mock_service *serv = user_data;
+	DBusMessage *reply;
+	DBusMessageIter iter, dict, entry;
+	const char *key;
+	bool has_passphrase = false;
+
+	reply = dbus_pending_call_steal_reply(call);
+	dbus_pending_call_unref(call);
+
+	if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+			dbus_message_iter_init(reply, &iter) &&
+			dbus_message_iter_get_arg_type(&iter) ==
+			DBUS_TYPE_ARRAY) {
+		dbus_message_iter_recurse(&iter, &dict);
+
+		while (dbus_message_iter_get_arg_type(&dict) ==
+				DBUS_TYPE_DICT_ENTRY) {
+			dbus_message_iter_recurse(&dict, &entry);
+			dbus_message_iter_get_basic(&entry, &key);
+
+			if (strcmp(key, "Passphrase") == 0)
+				has_passphrase = true;
+
+			dbus_message_iter_next(&dict);
+		}
+	}
+
+	dbus_message_unref(reply);
+	agent_input_done(serv, has_passphrase);
+}
+
+/*
+ * Ask the passphrase of a service to the agent.
+ * Return false if there is no agent.
+ */
+static bool request_input(struct mock_service *serv)
+{
+	DBusMessage *msg;
+	DBusMessageIter iter, dict, entry, variant, sub;
+	DBusPendingCall *call;
+	const char *path = serv->path, *key = "Passphrase";
+	const char *passphrase[] = { "Type", "psk", "Requirement", "mandatory",
+		NULL };
+
+	if (!agent_owner)
+		return false;
+
+	msg = dbus_message_new_method_call(agent_owner, agent_path,
+			"net.connman.Agent", "RequestInput");
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_OBJECT_PATH, &path);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+	dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY, NULL,
+			&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "a{sv}",
+			&variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "{sv}",
+			&sub);
+	append_entry(&sub, passphrase[0], DBUS_TYPE_STRING, &passphrase[1]);
+	append_entry(&sub, passphrase[2], DBUS_TYPE_STRING, &passphrase[3]);
+	dbus_message_iter_close_container(&variant, &sub);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(&dict, &entry);
+	dbus_message_iter_close_container(&iter, &dict);
+
+	if (trace && trace_write(trace, trace_time(), msg, NULL) < 0)
+		fprintf(stderr, "[-] Failed to write the trace\n");
+
+	// Without a bus, script_session() answers for the agent
+	if (!conn) {
+		dbus_message_unref(msg);
+		return true;
+	}
+
+	if (!dbus_connection_send_with_reply(conn, msg, &call, -1) || !call) {
+		dbus_message_unref(msg);
+		return false;
+	}
+
+	dbus_pending_call_set_notify(call, agent_input_return, serv, NULL);
+	dbus_message_unref(msg);
+
+	return true;
+}
+
+/*
+ * Read the name and the basic value of a (sv) SetProperty call.
+ * Return false if the value isn't of the type wanted.
+ */
+static bool get_set_property(DBusMessage *msg, const char **name, int type,
+		void *val)
+{
+	DBusMessageIter iter, variant;
+
+	if (!dbus_message_iter_init(msg, &iter) ||
+			dbus_message_iter_get_arg_type(&iter) !=
+			DBUS_TYPE_STRING)
+		return false;
+
+	dbus_message_iter_get_basic(&iter, name);
+	dbus_message_iter_next(&iter);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_VARIANT)
+		return false;
+
+	dbus_message_iter_recurse(&iter, &variant);
+
+	if (dbus_message_iter_get_arg_type(&variant) != type)
+		return false;
+
+	dbus_message_iter_get_basic(&variant, val);
+
+	return true;
+}
+
+static DBusMessage* manager_method(DBusMessage *msg, const char *member)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	dbus_bool_t session_mode = FALSE, bool_val;
+	const char *name, *path;
+	int i;
+
+	if (strcmp(member, "GetProperties") == 0) {
+		reply = dbus_message_new_method_return(msg);
+		dbus_message_iter_init_append(reply, &iter);
+		dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}",
+				&array);
+		append_entry(&array, "State", DBUS_TYPE_STRING, &manager_state);
+		append_entry(&array, "OfflineMode", DBUS_TYPE_BOOLEAN,
+				&offline_mode);
+		append_entry(&array, "SessionMode", DBUS_TYPE_BOOLEAN,
+				&session_mode);
+		dbus_message_iter_close_container(&iter, &array);
+
+		return reply;
+	}
+
+	if (strcmp(member, "GetTechnologies") == 0 ||
+			strcmp(member, "GetServices") == 0) {
+		reply = dbus_message_new_method_return(msg);
+		dbus_message_iter_init_append(reply, &iter);
+		dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+				"(oa{sv})", &array);
+
+		if (member[3] == 'T') {
+			for (i = 0; technologies[i].path; i++)
+				append_technology(&array, i);
+		} else {
+			for (i = 0; i < nb_services; i++) {
+				if (service_is_visible(&services[i]))
+					append_service(&array, &services[i],
+							NULL);
+			}
+		}
+
+		dbus_message_iter_close_container(&iter, &array);
+
+		return reply;
+	}
+
+	if (strcmp(member, "SetProperty") == 0) {
+		if (!get_set_property(msg, &name, DBUS_TYPE_BOOLEAN, &bool_val) ||
+				strcmp(name, "OfflineMode") != 0)
+			return error_reply(msg, "InvalidArguments");
+
+		offline_mode = bool_val;
+		property_changed("/", "net.connman.Manager", "OfflineMode",
+				DBUS_TYPE_BOOLEAN, &offline_mode);
+
+		return dbus_message_new_method_return(msg);
+	}
+
+	if (strcmp(member, "RegisterAgent") == 0) {
+		if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_OBJECT_PATH,
+					&path, DBUS_TYPE_INVALID))
+			return error_reply(msg, "InvalidArguments");
+
+		if (agent_owner)
+			return error_reply(msg, "AlreadyExists");
+
+		agent_owner = strdup(dbus_message_get_sender(msg));
+		agent_path = strdup(path);
+
+		return dbus_message_new_method_return(msg);
+	}
+
+	if (strcmp(member, "UnregisterAgent") == 0) {
+		free(agent_owner);
+		free(agent_path);
+		agent_owner = agent_path = NULL;
+
+		return dbus_message_new_method_return(msg);
+	}
+
+	return NULL;
+}
+
+static DBusMessage* technology_method(DBusMessage *msg, const char *member,
+		int tech)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	dbus_bool_t powered;
+	const char *name;
+	int i;
+
+	if (strcmp(member, "GetProperties") == 0) {
+		reply = dbus_message_new_method_return(msg);
+		dbus_message_iter_init_append(reply, &iter);
+		append_technology_dict(&iter, tech);
+
+		return reply;
+	}
+
+	if (strcmp(member, "SetProperty") == 0) {
+		if (!get_set_property(msg, &name, DBUS_TYPE_BOOLEAN, &powered) ||
+				strcmp(name, "Powered") != 0)
+			return error_reply(msg, "InvalidArguments");
+
+		if (powered == technologies[tech].powered)
+			return error_reply(msg, powered ? "AlreadyEnabled" :
+					"AlreadyDisabled");
+
+		technologies[tech].powered = powered;
+		property_changed(technologies[tech].path,
+				"net.connman.Technology", "Powered",
+				DBUS_TYPE_BOOLEAN, &powered);
+
+		if (tech == 1) {
+			for (i = 0; !powered && i < nb_services; i++) {
+				if (services[i].is_wifi &&
+						services[i].state[0] != 'i')
+					services[i].state = "idle";
+			}
+
+			services_changed(NULL, NULL);
+			update_connected();
+		}
+
+		return dbus_message_new_method_return(msg);
+	}
+
+	if (strcmp(member, "Scan") == 0) {
+		if (tech != 1)
+			return error_reply(msg, "NotSupported");
+
+		if (!technologies[tech].powered)
+			return error_reply(msg, "NoCarrier");
+
+		for (i = 0; i < nb_services; i++) {
+			if (services[i].is_wifi)
+				services[i].strength = 20 +
+					rand_r(&seed) % 80;
+		}
+
+		services_changed(NULL, NULL);
+
+		return dbus_message_new_method_return(msg);
+	}
+
+	return NULL;
+}
+
+static DBusMessage* service_method(DBusMessage *msg, const char *member,
+		struct mock_service *serv)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	dbus_bool_t autoconnect, favorite = FALSE;
+	const char *name;
+
+	if (strcmp(member, "GetProperties") == 0) {
+		reply = dbus_message_new_method_return(msg);
+		dbus_message_iter_init_append(reply, &iter);
+		append_service_dict(&iter, serv);
+
+		return reply;
+	}
+
+	if (strcmp(member, "Connect") == 0) {
+		if (service_is_connected(serv))
+			return error_reply(msg, "AlreadyConnected");
+
+		if (serv->connecting)
+			return error_reply(msg, "InProgress");
+
+		if (serv->is_wifi && strcmp(serv->security, "none") != 0 &&
+				!serv->favorite) {
+			if (!request_input(serv))
+				return error_reply(msg, "Failed");
+
+			// Replied once the agent answers
+			serv->connecting = dbus_message_ref(msg);
+			set_state(serv, "association");
+
+			return NULL;
+		}
+
+		connect_done(serv);
+
+		return dbus_message_new_method_return(msg);
+	}
+
+	if (strcmp(member, "Disconnect") == 0 || strcmp(member, "Remove") == 0) {
+		if (strcmp(member, "Remove") == 0 && serv->favorite) {
+			serv->favorite = false;
+			property_changed(serv->path, "net.connman.Service",
+					"Favorite", DBUS_TYPE_BOOLEAN, &favorite);
+		}
+
+		if (!service_is_connected(serv) && member[0] == 'D')
+			return error_reply(msg, "NotConnected");
+
+		if (service_is_connected(serv)) {
+			set_state(serv, "disconnect");
+			set_state(serv, "idle");
+			update_connected();
+		}
+
+		return dbus_message_new_method_return(msg);
+	}
+
+	if (strcmp(member, "SetProperty") == 0) {
+		if (get_set_property(msg, &name, DBUS_TYPE_BOOLEAN,
+					&autoconnect) &&
+				strcmp(name, "AutoConnect") == 0) {
+			serv->autoconnect = autoconnect;
+			property_changed(serv->path, "net.connman.Service",
+					"AutoConnect", DBUS_TYPE_BOOLEAN,
+					&autoconnect);
+		}
+
+		// The *.Configuration are accepted and ignored
+		return dbus_message_new_method_return(msg);
+	}
+
+	if (strcmp(member, "ClearProperty") == 0)
+		return dbus_message_new_method_return(msg);
+
+	return NULL;
+}
+
+static DBusHandlerResult message_handler(DBusConnection *connection,
+		DBusMessage *msg, void *user_data)
+{
+	DBusMessage *reply = NULL;
+	const char *interface, *path, *member;
+	bool deferred = false;
+	int i;
+
+	if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	interface = dbus_message_get_interface(msg);
+	path = dbus_message_get_path(msg);
+	member = dbus_message_get_member(msg);
+
+	if (!interface || !path || !member)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	if (strcmp(interface, "net.connman.Manager") == 0 &&
+			strcmp(path, "/") == 0)
+		reply = manager_method(msg, member);
+
+	else if (strcmp(interface, "net.connman.Technology") == 0) {
+		for (i = 0; technologies[i].path; i++) {
+			if (strcmp(path, technologies[i].path) == 0)
+				reply = technology_method(msg, member, i);
+		}
+
+	} else if (strcmp(interface, "net.connman.Service") == 0) {
+		for (i = 0; i < nb_services; i++) {
+			if (strcmp(path, services[i].path) == 0 &&
+					service_is_visible(&services[i])) {
+				reply = service_method(msg, member,
+						&services[i]);
+				deferred = !reply;
+			}
+		}
+	}
+
+	if (deferred)
+		return DBUS_HANDLER_RESULT_HANDLED;
+
+	if (!reply)
+		reply = dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_METHOD,
+				member);
+
+	send_reply(msg, reply);
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+/*
+ * Create the wired service and nb_wifi wifi services. A third of the wifi
+ * services are open, the first one is known.
+ */
+static void create_services(int nb_wifi)
+{
+	struct mock_service *serv;
+	char ssid[2 * MOCK_NAME_MAX_LEN];
+	int i, j;
+
+	serv = &services[nb_services++];
+	snprintf(serv->path, MOCK_PATH_MAX_LEN,
+			"/net/connman/service/ethernet_001122334455_cable");
+	snprintf(serv->name, MOCK_NAME_MAX_LEN, "Wired");
+	serv->security = "none";
+	serv->state = "online";
+	serv->favorite = true;
+	serv->autoconnect = TRUE;
+
+	for (i = 0; i < nb_wifi; i++) {
+		serv = &services[nb_services++];
+		serv->is_wifi = true;
+		serv->security = i % 3 == 2 ? "none" : "psk";
+		snprintf(serv->name, MOCK_NAME_MAX_LEN, "Mock%04x", i);
+
+		// The SSID is in hexadecimal in the path
+		for (j = 0; serv->name[j]; j++)
+			sprintf(ssid + 2 * j, "%02x", serv->name[j]);
+
+		snprintf(serv->path, MOCK_PATH_MAX_LEN,
+				"/net/connman/service/wifi_001122334455_%s_"
+				"managed_%s", ssid, serv->security);
+		serv->state = "idle";
+		serv->strength = 20 + rand_r(&seed) % 80;
+		serv->favorite = i == 0;
+		serv->autoconnect = serv->favorite;
+	}
+}
+
+/*
+ * Send a signal of the storm.
+ */
+static void storm_step(void)
+{
+	struct mock_service *serv;
+	enum storm_kind kind = storm_kind;
+	const char *state;
+
+	if (kind == STORM_MIXED)
+		kind = storm_sent % STORM_MIXED;
+
+	serv = &services[1 + rand_r(&seed) % (nb_services - 1)];
+	serv->strength = 20 + rand_r(&seed) % 80;
+
+	switch (kind) {
+		case STORM_SERVICES:
+			services_changed(serv, "Strength");
+			break;
+
+		case STORM_STATE:
+			state = storm_sent % 2 ? "online" : "ready";
+			property_changed("/", "net.connman.Manager", "State",
+					DBUS_TYPE_STRING, &state);
+			break;
+
+		case STORM_CHURN:
+			// A service being connected stays
+			serv->out_of_range = !serv->out_of_range &&
+				!serv->connecting && !service_is_connected(serv);
+			services_changed(serv, serv->out_of_range ? "" : NULL);
+			break;
+
+		default:
+			property_changed(serv->path, "net.connman.Service",
+					"Strength", DBUS_TYPE_BYTE,
+					&serv->strength);
+			break;
+	}
+
+	storm_sent++;
+}
+
+/*
+ * Run a method call of the client played by script_session().
+ */
+static void script_call(const char *path, const char *interface,
+		const char *member, const char *arg)
+{
+	static dbus_uint32_t serial;
+	DBusMessage *msg;
+
+	msg = dbus_message_new_method_call("net.connman", path, interface,
+			member);
+	dbus_message_set_sender(msg, MOCK_SCRIPT_CLIENT);
+	dbus_message_set_serial(msg, ++serial);
+
+	if (arg)
+		dbus_message_append_args(msg, DBUS_TYPE_OBJECT_PATH, &arg,
+				DBUS_TYPE_INVALID);
+
+	message_handler(NULL, msg, NULL);
+	dbus_message_unref(msg);
+}
+
+/*
+ * Without a bus, play what a client does at startup (get the state, the
+ * technologies and the services, register its agent), then connect to a new
+ * secured service, the agent giving the passphrase, and run the storm as fast
+ * as possible. The time in the trace follows the storm rate (-r), it doesn't
+ * move without one.
+ */
+static void script_session(void)
+{
+	struct mock_service *serv;
+	int i;
+
+	script_call("/", "net.connman.Manager", "GetProperties", NULL);
+	script_call("/", "net.connman.Manager", "GetTechnologies", NULL);
+	script_call("/", "net.connman.Manager", "GetServices", NULL);
+	script_call("/", "net.connman.Manager", "RegisterAgent",
+			MOCK_SCRIPT_AGENT);
+
+	for (i = 1; i < nb_services; i++) {
+		serv = &services[i];
+
+		if (strcmp(serv->security, "none") != 0 && !serv->favorite) {
+			script_call(serv->path, "net.connman.Service",
+					"Connect", NULL);
+			agent_input_done(serv, true);
+			break;
+		}
+	}
+
+	while (storm_sent < storm_count) {
+		if (storm_rate)
+			script_time_us = (storm_sent + 1) * 1000000 /
+				storm_rate;
+
+		storm_step();
+	}
+}
+
+static void stop(int signum)
+{
+	running = 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-a bus] [-n services] [-r rate] "
+			"[-N count] [-k kind] [-s seed] [-e] [-w trace]\n"
+			"  -a  bus to own net.connman on: session (default), "
+			"system, a dbus address or offline (no bus, play a "
+			"client session and the storm, see -w)\n"
+			"  -n  number of wifi services (default 20, at most %d)\n"
+			"  -r  storm signals per second (default 0: no storm)\n"
+			"  -N  storm signals to send (default 0: no limit)\n"
+			"  -k  storm kind: strength (default), services, state, "
+			"mixed or churn\n"
+			"  -s  seed of the random strengths\n"
+			"  -e  exit once the storm is over\n"
+			"  -w  write what is sent in a trace file\n",
+			prog, MOCK_MAX_SERVICES - 1);
+}
+
+static unsigned long parse_ulong_opt(const char *prog, const char *arg)
+{
+	char *end;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(arg, &end, 10);
+
+	if (errno || *end != '\0' || end == arg) {
+		usage(prog);
+		exit(1);
+	}
+
+	return val;
+}
+
+/*
+ * Connect to the bus and own net.connman. Return NULL on error.
+ */
+static DBusConnection* bus_connect(const char *bus)
+{
+	DBusConnection *connection;
+	DBusError err;
+
+	dbus_error_init(&err);
+
+	if (strcmp(bus, "session") == 0)
+		connection = dbus_bus_get(DBUS_BUS_SESSION, &err);
+
+	else if (strcmp(bus, "system") == 0)
+		connection = dbus_bus_get(DBUS_BUS_SYSTEM, &err);
+
+	else {
+		connection = dbus_connection_open_private(bus, &err);
+
+		if (connection && !dbus_bus_register(connection, &err)) {
+			dbus_connection_close(connection);
+			dbus_connection_unref(connection);
+			connection = NULL;
+		}
+	}
+
+	if (connection && dbus_bus_request_name(connection, "net.connman",
+				DBUS_NAME_FLAG_DO_NOT_QUEUE, &err) !=
+			DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER &&
+			!dbus_error_is_set(&err))
+		dbus_set_error(&err, DBUS_ERROR_FAILED,
+				"net.connman is already owned");
+
+	if (dbus_error_is_set(&err)) {
+		fprintf(stderr, "[-] %s: %s\n", bus, err.message);
+		dbus_error_free(&err);
+		return NULL;
+	}
+
+	return connection;
+}
+
+/*
+ * Serve the method calls and run the storm until stopped.
+ */
+static void bus_run(bool exit_after_storm)
+{
+	DBusObjectPathVTable vtable = { .message_function = message_handler };
+	uint64_t start, due;
+	int i, timeout_ms;
+
+	dbus_connection_set_exit_on_disconnect(conn, FALSE);
+	dbus_connection_register_fallback(conn, "/", &vtable, NULL);
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	start = now_us();
+
+	while (running) {
+		timeout_ms = 100;
+
+		if (storm_rate && (!storm_count || storm_sent < storm_count)) {
+			due = start + (storm_sent + 1) * 1000000 / storm_rate;
+			timeout_ms = due > now_us() ? (due - now_us()) / 1000 : 0;
+
+			if (timeout_ms > 100)
+				timeout_ms = 100;
+		}
+
+		if (!dbus_connection_read_write_dispatch(conn, timeout_ms))
+			break;
+
+		// Answer every call received, the storm doesn't starve them
+		while (dbus_connection_dispatch(conn) ==
+				DBUS_DISPATCH_DATA_REMAINS)
+			;
+
+		for (i = 0; storm_rate && i < MOCK_STORM_BATCH &&
+				(!storm_count || storm_sent < storm_count) &&
+				now_us() >= start + storm_sent * 1000000 /
+				storm_rate; i++)
+			storm_step();
+
+		// Don't queue more than the bus takes
+		dbus_connection_flush(conn);
+
+		if (exit_after_storm && storm_count && storm_sent == storm_count)
+			break;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *bus = "session", *trace_path = NULL;
+	unsigned long nb_wifi = 20;
+	bool exit_after_storm = false, offline;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "a:n:r:N:k:s:ew:h")) != -1) {
+		switch (opt) {
+			case 'a':
+				bus = optarg;
+				break;
+
+			case 'n':
+				nb_wifi = parse_ulong_opt(argv[0], optarg);
+				break;
+
+			case 'r':
+				storm_rate = parse_ulong_opt(argv[0], optarg);
+				break;
+
+			case 'N':
+				storm_count = parse_ulong_opt(argv[0], optarg);
+				break;
+
+			case 'k':
+				for (i = 0; storm_kinds[i] && strcmp(optarg,
+							storm_kinds[i]); i++)
+					;
+
+				if (!storm_kinds[i]) {
+					usage(argv[0]);
+					exit(1);
+				}
+
+				storm_kind = i;
+				break;
+
+			case 's':
+				seed = parse_ulong_opt(argv[0], optarg);
+				break;
+
+			case 'e':
+				exit_after_storm = true;
+				break;
+
+			case 'w':
+				trace_path = optarg;
+				break;
+
+			default:
+				usage(argv[0]);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	offline = strcmp(bus, "offline") == 0;
+
+	if (nb_wifi >= MOCK_MAX_SERVICES || ((storm_rate || storm_count) &&
+				nb_wifi == 0) || (offline && !trace_path)) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	create_services(nb_wifi);
+
+	if (trace_path && !(trace = trace_create(trace_path))) {
+		fprintf(stderr, "[-] %s: %s\n", trace_path, strerror(errno));
+		exit(1);
+	}
+
+	trace_start_us = now_us();
+
+	if (offline)
+		script_session();
+
+	else if ((conn = bus_connect(bus)))
+		bus_run(exit_after_storm);
+
+	else
+		exit(1);
+
+	fprintf(stderr, "[*] %lu storm signals sent\n", storm_sent);
+
+	for (i = 0; i < nb_services; i++) {
+		if (services[i].connecting)
+			dbus_message_unref(services[i].connecting);
+	}
+
+	free(agent_owner);
+	free(agent_path);
+	trace_close(trace);
+
+	if (conn && strcmp(bus, "session") != 0 && strcmp(bus, "system") != 0)
+		dbus_connection_close(conn);
+
+	if (conn)
+		dbus_connection_unref(conn);
+
+	return 0;
+}
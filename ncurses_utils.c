@@ -35,17 +35,22 @@
 /*
  * This file provide simple functions to print informations in win_footer
  * and keep footer messages.
+ * It also batches the screen updates: windows are never refreshed one by
+ * one, see screen_damage().
  */
 
 extern WINDOW *win_footer;
 
+// Windows were damaged since the last doupdate(), see screen_damage().
+static bool screen_dirty = false;
+
 static void print_in_footer(bool is_error, int line, const char *msg,
 		va_list args)
 {
 	mvwprintw(win_footer, line, 0, (is_error ? " [ERROR] " : " [INFO] "));
 	vwprintw(win_footer, msg, args);
 	wprintw(win_footer, "\n");
-	wrefresh(win_footer);
+	screen_damage(win_footer);
 }
 
 void print_info_in_footer(bool is_error, const char* msg, ...)
@@ -88,3 +93,39 @@ void refresh_service_config_msg(void)
 			"'F7' to submit settings");
 	print_info_in_footer2(false, "'Esc' to get back, 'F1' for help");
 }
+
+/*
+ * Use this instead of wrefresh(). The lines of win that changed are copied to
+ * the virtual screen now (wnoutrefresh), so windows damaged later still cover
+ * it; the terminal is updated once for all of them by screen_update().
+ * The cursor is left where win puts it.
+ */
+void screen_damage(WINDOW *win)
+{
+	wnoutrefresh(win);
+	screen_dirty = true;
+}
+
+/*
+ * Send the damaged windows to the terminal: doupdate() only writes the
+ * differences between the virtual and the physical screens.
+ */
+void screen_update(void)
+{
+	if (!screen_dirty)
+		return;
+
+	doupdate();
+	screen_dirty = false;
+}
+
+/*
+ * Loop idle function: update the screen once per loop iteration. It has to
+ * be registered after the idle functions that draw.
+ */
+int screen_idle(void)
+{
+	screen_update();
+
+	return -1;
+}
@@ -23,6 +23,7 @@
 #define __CONNMAN_NCURSES_UTILS_H
 
 #include <stdbool.h>
+#include <ncurses.h>
 
 #define NCURSES_MAX_FIELD_LEN 30
 
@@ -40,6 +41,12 @@ void refresh_services_msg(void);
 
 void refresh_service_config_msg(void);
 
+void screen_damage(WINDOW *win);
+
+void screen_update(void);
+
+int screen_idle(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,140 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <json.h>
+
+#include "engine.h"
+#include "keys.h"
+
+#include "player.h"
+
+/*
+ * This file plays the client of the programs driving the engine without the
+ * ncurses interface (connman_bench, connman_soak and connman_latency): it
+ * sends commands to the engine as the ncurses client does. The replies come
+ * to the engine_callback of the program, which calls back in here.
+ */
+
+// The generation of the last services got, see reply_query() in engine.c.
+static int64_t generation = -1;
+
+// The loop polls stdin for the ncurses client only.
+void ncurses_action(void)
+{
+}
+
+// Called after every dbus method return, see dbus_helpers.c.
+void callback_ended(void)
+{
+}
+
+/*
+ * Send a command to the engine.
+ * @param data the cmd_data, NULL if none, the ownership is transferred
+ */
+void player_send_command(const char *cmd_name, struct json_object *data)
+{
+	struct json_object *cmd;
+
+	cmd = json_object_new_object();
+	json_object_object_add(cmd, key_command,
+			json_object_new_string(cmd_name));
+
+	if (data)
+		json_object_object_add(cmd, key_command_data, data);
+
+	engine_query(cmd);
+}
+
+/*
+ * Query the services of PLAYER_TECHNOLOGY, with the generation of the last
+ * ones got: the reply is empty if nothing changed since.
+ */
+void player_query_services(void)
+{
+	struct json_object *data;
+
+	data = json_object_new_object();
+	json_object_object_add(data, key_technology,
+			json_object_new_string(PLAYER_TECHNOLOGY));
+
+	if (generation >= 0)
+		json_object_object_add(data, key_generation,
+				json_object_new_int64(generation));
+
+	player_send_command(key_engine_get_services_from_tech, data);
+}
+
+/*
+ * Watch the first services of a get_services_from_tech reply.
+ */
+void player_watch_rows(struct json_object *reply)
+{
+	struct json_object *data, *services, *list, *gen;
+	int i;
+
+	if (json_object_object_get_ex(reply, key_generation, &gen))
+		generation = json_object_get_int64(gen);
+
+	if (!json_object_object_get_ex(reply, key_command_data, &data) ||
+			!json_object_object_get_ex(data, key_services,
+				&services))
+		return;
+
+	list = json_object_new_array();
+
+	for (i = 0; i < PLAYER_WATCHED &&
+			i < json_object_array_length(services); i++)
+		json_object_array_add(list, json_object_get(
+					json_object_array_get_idx(
+						json_object_array_get_idx(
+							services, i), 0)));
+
+	data = json_object_new_object();
+	json_object_object_add(data, key_services, list);
+	player_send_command(key_engine_watch_services, data);
+}
+
+/*
+ * Answer an agent request at once, as a user typing instantly would.
+ * @param passphrase the Passphrase given
+ */
+void player_answer_agent(struct json_object *request, const char *passphrase)
+{
+	struct json_object *data, *fields, *id;
+
+	if (!json_object_object_get_ex(request, key_agent_request_id, &id))
+		return;
+
+	fields = json_object_new_object();
+	json_object_object_add(fields, "Passphrase",
+			json_object_new_string(passphrase));
+	data = json_object_new_object();
+	json_object_object_add(data, key_agent_request_id,
+			json_object_get(id));
+	json_object_object_add(data, key_agent_msg_data, fields);
+	player_send_command(key_engine_agent_response, data);
+}
@@ -0,0 +1,49 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_PLAYER_H
+#define __CONNMAN_PLAYER_H
+
+#include <json.h>
+
+// The technology queried on every change notification.
+#define PLAYER_TECHNOLOGY "/net/connman/technology/wifi"
+
+// Services watched, as many as the rows of a screen.
+#define PLAYER_WATCHED 20
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void player_send_command(const char *cmd_name, struct json_object *data);
+
+void player_query_services(void);
+
+void player_watch_rows(struct json_object *reply);
+
+void player_answer_agent(struct json_object *request, const char *passphrase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,6 +24,8 @@
 #include <assert.h>
 #include <string.h>
 
+#include "ncurses_utils.h"
+
 #include "popup.h"
 
 /*
@@ -321,7 +323,7 @@ void popup_driver(int ch)
 			pos_form_cursor(popup_form);
 	}
 
-	wrefresh(win_body);
+	screen_damage(win_body);
 }
 
 /*
@@ -330,7 +332,7 @@ void popup_driver(int ch)
 void popup_refresh(void)
 {
 	box(win_body, 0, 0);
-	wrefresh(win_body);
+	screen_damage(win_body);
 }
 
 /*
@@ -0,0 +1,402 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "keys.h"
+#include "json_utils.h"
+
+#include "ranking.h"
+
+/*
+ * This file keeps the services of the engine sorted by technology type, then
+ * connected services first, favorite services, by state, by Strength and by
+ * name. The dbus name breaks the ties, so the order is total and stable.
+ * The sort key of each service is computed once and cached as a string
+ * (compared with strcmp). When a service changes, it's only moved if its key
+ * changed: a binary search gives its old and new positions, there is never a
+ * full sort.
+ * The services of a technology are a range of the sorted array, the connected
+ * ones are at the start of the range: both are found by binary search. The
+ * json arrays given to the engine are built on the first request and kept
+ * until a service of the technology is added, removed or moved.
+ */
+
+struct ranked {
+	char *key;			// the cached sort key
+	struct json_object *serv;	// [ "service dbus name", { serv dict } ]
+};
+
+// The services in order.
+static struct ranked *ranked;
+static int nb_ranked, size_ranked;
+
+// The cached sort keys: { "service dbus name": "key" }.
+static struct json_object *keys;
+
+// The arrays given by ranking_services(): { "type": [ services ] } and
+// { "type/connected": [ services ] }.
+static struct json_object *snapshots;
+
+// Services states, in order of preference.
+static const char *states[] = { "online", "ready", "configuration",
+	"association", "disconnect", "idle", "failure", NULL };
+
+/*
+ * Return true if a change of the property can move the service.
+ */
+bool ranking_is_sort_property(const char *property)
+{
+	return strcmp(property, key_serv_favorite) == 0 ||
+		strcmp(property, key_serv_state) == 0 ||
+		strcmp(property, key_serv_strength) == 0 ||
+		strcmp(property, key_serv_name) == 0 ||
+		strcmp(property, key_serv_type) == 0;
+}
+
+static int state_rank(const char *state)
+{
+	int i;
+
+	for (i = 0; state && states[i]; i++) {
+		if (strcmp(state, states[i]) == 0)
+			return i;
+	}
+
+	return i;
+}
+
+/*
+ * Return true if a service in this state is connected.
+ */
+static bool state_is_connected(const char *state)
+{
+	return state && (strcmp(state, "online") == 0 ||
+			strcmp(state, "ready") == 0);
+}
+
+/*
+ * Build the sort key of a service:
+ * <type>\1<connected><favorite><state><strength step><name (lower case)>\1
+ * <dbus name>
+ */
+static char* build_key(struct json_object *serv)
+{
+	struct json_object *serv_dict, *tmp;
+	const char *path, *name = "", *state = NULL, *type = "";
+	bool favorite = false;
+	int strength = 0, i;
+	size_t len;
+	char *key;
+
+	path = json_object_get_string(json_object_array_get_idx(serv, 0));
+	serv_dict = json_object_array_get_idx(serv, 1);
+
+	if (json_object_object_get_ex(serv_dict, key_serv_favorite, &tmp))
+		favorite = json_object_get_boolean(tmp);
+
+	if (json_object_object_get_ex(serv_dict, key_serv_state, &tmp))
+		state = json_object_get_string(tmp);
+
+	if (json_object_object_get_ex(serv_dict, key_serv_strength, &tmp))
+		strength = json_object_get_int(tmp);
+
+	if (json_object_object_get_ex(serv_dict, key_serv_name, &tmp))
+		name = json_object_get_string(tmp);
+
+	if (json_object_object_get_ex(serv_dict, key_serv_type, &tmp))
+		type = json_object_get_string(tmp);
+
+	if (strength < 0 || strength > 100)
+		strength = 0;
+
+	len = strlen(type) + 6 + strlen(name) + 1 + strlen(path) + 1;
+	key = malloc(len);
+	assert(key != NULL);
+
+	// The best goes first: invert what is better when bigger
+	snprintf(key, len, "%s\1%c%c%c%02d%s\1%s", type,
+			state_is_connected(state) ? '0' : '1',
+			favorite ? '0' : '1', '0' + state_rank(state),
+			(100 - strength) / RANKING_STRENGTH_STEP, name, path);
+
+	for (i = strlen(type) + 6; key[i] != '\1'; i++)
+		key[i] = tolower((unsigned char) key[i]);
+
+	return key;
+}
+
+/*
+ * Drop the arrays of the technology type of key, the next
+ * ranking_services() builds them again.
+ */
+static void invalidate(const char *key)
+{
+	char type[256];
+
+	if (!snapshots)
+		return;
+
+	snprintf(type, sizeof(type), "%.*s", (int) strcspn(key, "\1"), key);
+	json_object_object_del(snapshots, type);
+	strncat(type, "/connected", sizeof(type) - strlen(type) - 1);
+	json_object_object_del(snapshots, type);
+}
+
+/*
+ * Return the position of key, or where it would be inserted.
+ */
+static int search(const char *key, bool *found)
+{
+	int low = 0, high = nb_ranked, mid, cmp;
+
+	*found = false;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		cmp = strcmp(ranked[mid].key, key);
+
+		if (cmp == 0) {
+			*found = true;
+			return mid;
+		}
+
+		if (cmp < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+/*
+ * Remove the service with the cached key at its position.
+ */
+static void remove_key(const char *key)
+{
+	bool found;
+	int pos;
+
+	pos = search(key, &found);
+
+	if (!found)
+		return;
+
+	invalidate(key);
+	free(ranked[pos].key);
+	json_object_put(ranked[pos].serv);
+	nb_ranked--;
+	memmove(&ranked[pos], &ranked[pos+1],
+			sizeof(struct ranked) * (nb_ranked - pos));
+}
+
+/*
+ * Insert or move a service, nothing is done if its sort key didn't change.
+ * @param serv [ "service dbus name", { serv dict } ], the service dict is
+ *	read again on each call, its reference count is incremented
+ */
+void ranking_update(struct json_object *serv)
+{
+	struct json_object *old_key;
+	const char *path;
+	char *key;
+	bool found;
+	int pos;
+
+	path = json_object_get_string(json_object_array_get_idx(serv, 0));
+
+	if (!path)
+		return;
+
+	if (!keys)
+		keys = json_object_new_object();
+
+	key = build_key(serv);
+
+	if (json_object_object_get_ex(keys, path, &old_key)) {
+		if (strcmp(json_object_get_string(old_key), key) == 0) {
+			pos = search(key, &found);
+
+			// Same place, the record may have been replaced
+			if (ranked[pos].serv != serv) {
+				json_object_get(serv);
+				json_object_put(ranked[pos].serv);
+				ranked[pos].serv = serv;
+				invalidate(key);
+			}
+
+			free(key);
+			return;
+		}
+
+		remove_key(json_object_get_string(old_key));
+	}
+
+	if (nb_ranked == size_ranked) {
+		size_ranked = size_ranked ? size_ranked * 2 : 32;
+		ranked = realloc(ranked, sizeof(struct ranked) * size_ranked);
+		assert(ranked != NULL);
+	}
+
+	pos = search(key, &found);
+	memmove(&ranked[pos+1], &ranked[pos],
+			sizeof(struct ranked) * (nb_ranked - pos));
+	ranked[pos].key = key;
+	ranked[pos].serv = json_object_get(serv);
+	nb_ranked++;
+	invalidate(key);
+
+	json_object_object_add(keys, path, json_object_new_string(key));
+}
+
+/*
+ * Remove a service.
+ */
+void ranking_remove(const char *serv_dbus_name)
+{
+	struct json_object *old_key;
+
+	if (!keys || !json_object_object_get_ex(keys, serv_dbus_name,
+				&old_key))
+		return;
+
+	remove_key(json_object_get_string(old_key));
+	json_object_object_del(keys, serv_dbus_name);
+}
+
+/*
+ * Return the record of a service, NULL if it isn't ranked.
+ * @param serv_dbus_name the dbus name of the service
+ */
+struct json_object* ranking_find(const char *serv_dbus_name)
+{
+	struct json_object *key;
+	bool found;
+	int pos;
+
+	if (!keys || !serv_dbus_name || !json_object_object_get_ex(keys,
+				serv_dbus_name, &key))
+		return NULL;
+
+	pos = search(json_object_get_string(key), &found);
+
+	return found ? ranked[pos].serv : NULL;
+}
+
+/*
+ * Return the services of a technology type, in order.
+ * @param type the technology type, e.g. "wifi"
+ * @param connected only return the connected services
+ * @return a json array, its reference count is incremented. It's shared with
+ *	the next callers: it must not be modified.
+ */
+struct json_object* ranking_services(const char *type, bool connected)
+{
+	char snapshot_key[256], bound[256 + 2];
+	struct json_object *res;
+	bool found;
+	int first, last, i;
+
+	snprintf(snapshot_key, sizeof(snapshot_key), "%s%s", type,
+			connected ? "/connected" : "");
+
+	if (!snapshots)
+		snapshots = json_object_new_object();
+
+	if (json_object_object_get_ex(snapshots, snapshot_key, &res))
+		return json_object_get(res);
+
+	// The keys of the type are in [ "type\1", "type\2" [, the keys of the
+	// connected ones in [ "type\1", "type\11" [
+	snprintf(bound, sizeof(bound), "%s\1", type);
+	first = search(bound, &found);
+	snprintf(bound, sizeof(bound), connected ? "%s\1" "1" : "%s\2", type);
+	last = search(bound, &found);
+
+	res = json_object_new_array();
+
+	for (i = first; i < last; i++)
+		json_object_array_add(res, json_object_get(ranked[i].serv));
+
+	json_object_object_add(snapshots, snapshot_key, res);
+
+	return json_object_get(res);
+}
+
+/*
+ * Add the memory used by the ranking to fp. The services are the ones of the
+ * engine, only the arrays sharing them are counted.
+ */
+void ranking_footprint(struct json_footprint *fp)
+{
+	int i;
+
+	fp->bytes += sizeof(struct ranked) * size_ranked;
+
+	for (i = 0; i < nb_ranked; i++)
+		fp->bytes += strlen(ranked[i].key) + 1;
+
+	__json_footprint(keys, fp);
+
+	if (!snapshots)
+		return;
+
+	fp->objects++;
+	fp->bytes += JSON_FOOTPRINT_NODE;
+
+	json_object_object_foreach(snapshots, snapshot_key, snapshot) {
+		fp->objects++;
+		fp->bytes += JSON_FOOTPRINT_ENTRY + strlen(snapshot_key) + 1 +
+			JSON_FOOTPRINT_NODE + JSON_FOOTPRINT_SLOT *
+			json_object_array_length(snapshot);
+	}
+}
+
+/*
+ * Remove every service.
+ */
+void ranking_clear(void)
+{
+	int i;
+
+	for (i = 0; i < nb_ranked; i++) {
+		free(ranked[i].key);
+		json_object_put(ranked[i].serv);
+	}
+
+	free(ranked);
+	ranked = NULL;
+	nb_ranked = 0;
+	size_ranked = 0;
+	json_object_put(keys);
+	keys = NULL;
+	json_object_put(snapshots);
+	snapshots = NULL;
+}
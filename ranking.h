@@ -0,0 +1,56 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_RANKING_H
+#define __CONNMAN_RANKING_H
+
+#include <stdbool.h>
+#include <json.h>
+
+// Services whose Strength differ by less than this are ranked by name, it
+// keeps the rows from jumping on every Strength update.
+#define RANKING_STRENGTH_STEP 10
+
+struct json_footprint;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool ranking_is_sort_property(const char *property);
+
+void ranking_update(struct json_object *serv);
+
+void ranking_remove(const char *serv_dbus_name);
+
+struct json_object* ranking_find(const char *serv_dbus_name);
+
+struct json_object* ranking_services(const char *type, bool connected);
+
+void ranking_footprint(struct json_footprint *fp);
+
+void ranking_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -33,6 +33,8 @@
 #include "json_utils.h"
 #include "string_utils.h"
 #include "keys.h"
+#include "vlist.h"
+#include "arena.h"
 
 #include "renderers.h"
 
@@ -104,6 +106,41 @@ static char *proxy_method_enum[] = { "direct", "manual", "auto", NULL };
 // Used to tag service configuration fields for repos_cursor
 static char str_field[2];
 
+// The settings of a service displayed in the service configuration view, in
+// order.
+static const char *service_config_keys[] = { key_serv_state, key_serv_error,
+	key_serv_name, key_serv_type, key_serv_security, key_serv_strength,
+	key_serv_favorite, key_serv_immutable, key_serv_roaming,
+	key_serv_autoconnect, key_serv_ethernet, key_serv_ipv4,
+	key_serv_ipv4_config, key_serv_ipv6, key_serv_ipv6_config,
+	key_serv_nameservers, key_serv_nameservers_config,
+	key_serv_timeservers, key_serv_timeservers_config, key_serv_domains,
+	key_serv_domains_config, key_serv_proxy, key_serv_proxy_config,
+	key_serv_prov, NULL };
+
+// Cursor keys of main_items or main_fields: { "dbus_name": index }, see
+// __renderers_cursor_index.
+static struct json_object *cursor_index = NULL;
+
+// Memory of the home page and of the service configuration views: the items
+// and fields arrays, descriptions and userptr_data come from there and are
+// released in one call by __renderers_free_*.
+static struct arena home_arena = ARENA_INIT(ARENA_DEFAULT_CHUNK_SIZE);
+static struct arena config_arena = ARENA_INIT(ARENA_DEFAULT_CHUNK_SIZE);
+
+// Generation of the engine data displayed (see engine.c reply_query), -1 if
+// the view was freed.
+int64_t view_generation = -1;
+
+// Services list (CONTEXT_SERVICES), NULL if not displayed.
+struct vlist *services_list = NULL;
+
+// Are the services in the list wifi ones (else ethernet) ?
+static bool services_are_wifi;
+
+// See __renderers_services_current.
+static struct userptr_data services_current;
+
 /*
  * This is useful to mark main_fields with a value for repos_cursor
  */
@@ -122,6 +159,63 @@ static char* get_str_key() {
 	return str_field;
 }
 
+/*
+ * Remember the position of a menu item or form field, by the dbus_name of its
+ * user pointer.
+ */
+static void cursor_index_add(const char *key, int pos)
+{
+	if (!cursor_index)
+		cursor_index = json_object_new_object();
+
+	json_object_object_add(cursor_index, key, json_object_new_int(pos));
+}
+
+static void cursor_index_free(void)
+{
+	json_object_put(cursor_index);
+	cursor_index = NULL;
+}
+
+/*
+ * Return the index in main_items or main_fields of the element tagged with
+ * key (see userptr_data.dbus_name), -1 if there isn't any.
+ * @param key see main.c repos_cursor
+ */
+int __renderers_cursor_index(const char *key)
+{
+	struct json_object *pos;
+
+	if (!key || !cursor_index ||
+			!json_object_object_get_ex(cursor_index, key, &pos))
+		return -1;
+
+	return json_object_get_int(pos);
+}
+
+/*
+ * Remember the current item of main_menu or field of main_form in
+ * context.cursor_id, before the view is rendered from scratch. See main.c
+ * repos_cursor.
+ */
+static void save_cursor(void)
+{
+	struct userptr_data *data = NULL;
+	ITEM *item;
+	FIELD *field;
+
+	if (context.cursor_id)
+		return;
+
+	if (main_form && (field = current_field(main_form)))
+		data = field_userptr(field);
+	else if (main_menu && (item = current_item(main_menu)))
+		data = item_userptr(item);
+
+	if (data && data->dbus_name)
+		context.cursor_id = strdup(data->dbus_name);
+}
+
 /*
  * Create a menu of technologies: a selectable list of technologies.
  * @param jobj format of the json object:
@@ -154,13 +248,14 @@ static void renderers_technologies(struct json_object *jobj)
 	char *desc_base = "%-20s Powered %-5s          Connected %-5s";
 	char desc_base_sub[30];
 	const char *k_name, *k_type, *k_powered, *k_connected;
-	char *desc, *tech_short_name;
+	const char *tech_dbus_name, *tech_short_name;
+	char *desc;
 	struct json_object *sub_array, *dbus_tech_name, *tech_dict;
 	struct userptr_data *data;
 
 	nb_items = json_object_array_length(jobj);
-	main_items = malloc(sizeof(ITEM*) * (nb_items+1));
-	assert(main_items != NULL && nb_items > 0);
+	assert(nb_items > 0);
+	main_items = arena_alloc(&home_arena, sizeof(ITEM*) * (nb_items+1));
 
 	for (i = 0; i < nb_items; i++) {
 		sub_array = json_object_array_get_idx(jobj, i);
@@ -189,20 +284,23 @@ static void renderers_technologies(struct json_object *jobj)
 		snprintf(desc_base_sub, 30, "%s (%s)", k_name, k_type);
 		desc_base_sub[29] = '\0';
 
-		desc = malloc(RENDERERS_STRING_MAX_LEN);
-		assert(desc != NULL);
+		desc = arena_alloc(&home_arena, RENDERERS_STRING_MAX_LEN);
 		snprintf(desc, RENDERERS_STRING_MAX_LEN-1, desc_base,
 				desc_base_sub, k_powered, k_connected);
 		desc[RENDERERS_STRING_MAX_LEN-1] = '\0';
-		tech_short_name =
-			extract_dbus_short_name(json_object_get_string(dbus_tech_name));
-		main_items[i] = new_item(tech_short_name, desc);
 
-		data = malloc(sizeof(struct userptr_data));
-		assert(data != NULL);
-		data->dbus_name = strdup(json_object_get_string(dbus_tech_name));
-		data->pretty_name = strdup(k_name);
+		data = arena_alloc(&home_arena, sizeof(struct userptr_data));
+		tech_dbus_name = json_object_get_string(dbus_tech_name);
+		data->dbus_name = arena_strdup(&home_arena, tech_dbus_name);
+		data->pretty_name = arena_strdup(&home_arena, k_name);
+
+		// The short name is the end of the dbus name
+		tech_short_name = strrchr(data->dbus_name, '/');
+		tech_short_name = tech_short_name ? tech_short_name + 1 :
+			data->dbus_name;
+		main_items[i] = new_item(tech_short_name, desc);
 		set_item_userptr(main_items[i], data);
+		cursor_index_add(data->dbus_name, i);
 	}
 
 	main_items[nb_items] = NULL;
@@ -214,8 +312,8 @@ static void renderers_technologies(struct json_object *jobj)
 	assert(post_menu(main_menu) == E_OK);
 
 	refresh_home_msg();
-	wrefresh(win_header);
-	wrefresh(win_body);
+	screen_damage(win_header);
+	screen_damage(win_body);
 	repos_cursor();
 }
 
@@ -241,8 +339,7 @@ void __renderers_state(struct json_object *jobj)
 	// 38 = len(string) + 1
 	mvwprintw(win_header, 0, COLS-38, "State: %-6s%-6sOfflineMode: %-5s\n",
 			state_str, "", json_object_get_string(offline_mode));
-	redrawwin(win_header);
-	wrefresh(win_header);
+	screen_damage(win_header);
 }
 
 /*
@@ -264,6 +361,12 @@ void __renderers_home_page(struct json_object *jobj)
 	if (tech == NULL || state == NULL)
 		return;
 
+	// Refreshed, see main.c exec_refresh
+	if (main_menu && context.current_context == CONTEXT_HOME) {
+		save_cursor();
+		__renderers_free_home_page();
+	}
+
 	werase(win_body);
 	box(win_body, 0, 0);
 	mvwprintw(win_body, 1, 2, "Technologies:");
@@ -280,27 +383,21 @@ void __renderers_home_page(struct json_object *jobj)
 void __renderers_free_home_page(void)
 {
 	int i;
-	struct userptr_data *data;
 
 	if (!main_menu)
 		return;
 
 	unpost_menu(main_menu);
 
-	for (i = 0; i < nb_items; i++) {
-		free((void *) main_items[i]->description.str);
-		free((void *) main_items[i]->name.str);
-
-		data = item_userptr(main_items[i]);
-		free((void *) data->dbus_name);
-		free((void *) data->pretty_name);
-		free(data);
-
+	for (i = 0; i < nb_items; i++)
 		free_item(main_items[i]);
-	}
 
+	// The derwin() of renderers_technologies
+	delwin(menu_sub(main_menu));
 	free_menu(main_menu);
-	free(main_items);
+	arena_reset(&home_arena);
+	view_generation = -1;
+	cursor_index_free();
 	nb_items = 0;
 	main_menu = NULL;
 	main_items = NULL;
@@ -463,10 +560,13 @@ static void render_fields_from_jobj(int longest_key_len, int *pos,
 			config_fields_type(*pos, is_autoconnect, obj_str, key);
 
 			field_opts_on(main_fields[*pos], O_NULLOK);
-			data = malloc(sizeof(struct userptr_data));
-			data->dbus_name = strdup(get_str_key());
+			data = arena_alloc(&config_arena,
+					sizeof(struct userptr_data));
+			data->dbus_name = arena_strdup(&config_arena,
+					get_str_key());
 			data->pretty_name = NULL;
 			set_field_userptr(main_fields[*pos], data);
+			cursor_index_add(data->dbus_name, *pos);
 
 			(*pos)++;
 		}
@@ -475,6 +575,112 @@ static void render_fields_from_jobj(int longest_key_len, int *pos,
 	}
 }
 
+/*
+ * Return true if the buffer of field holds str (the buffer is padded with
+ * spaces).
+ */
+static bool field_buffer_equals(FIELD *field, const char *str)
+{
+	const char *buf = field_buffer(field, 0);
+	size_t len = strlen(str);
+
+	if (!buf || strncmp(buf, str, len) != 0)
+		return false;
+
+	for (buf += len; *buf != '\0'; buf++) {
+		if (*buf != ' ')
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Update the fields of a key and its value, rendered by
+ * render_fields_from_jobj: the buffers of the fields whose value changed are
+ * replaced. Fields modified by the user (see field_status) are left alone.
+ * Return -EINVAL if the fields don't match the structure of val.
+ * @param pos The index of the label of key in main_fields[]
+ */
+static int update_fields(int *pos, const char *key, struct json_object *val)
+{
+	FIELD *field;
+	const char *val_str;
+
+	if (*pos >= nb_fields || !field_buffer_equals(main_fields[*pos], key))
+		return -EINVAL;
+
+	(*pos)++;
+
+	if (json_object_get_type(val) == json_type_object) {
+		json_object_object_foreach(val, sub_key, sub_val) {
+			if (update_fields(pos, sub_key, sub_val) < 0)
+				return -EINVAL;
+		}
+
+		return 0;
+	}
+
+	if (*pos >= nb_fields)
+		return -EINVAL;
+
+	field = main_fields[(*pos)++];
+
+	// A label: a field appeared or disappeared
+	if (!((unsigned) field_opts(field) & O_ACTIVE))
+		return -EINVAL;
+
+	val_str = json_object_get_string(val);
+
+	if (!field_status(field) && !field_buffer_equals(field, val_str)) {
+		set_field_buffer(field, 0, val_str);
+		set_field_status(field, FALSE);
+	}
+
+	return 0;
+}
+
+/*
+ * Update the service configuration form in place with new settings of the
+ * service it displays, the user edits in progress are kept.
+ * Return 0 on success, -EINVAL if the form has to be rendered from scratch
+ * (other service, fields appeared or disappeared).
+ * @param serv_array [ "service dbus name", { serv dict } ]
+ */
+static int renderers_service_config_update(struct json_object *serv_array)
+{
+	struct json_object *serv_dict, *tmp_val;
+	struct userptr_data *data;
+	const char *serv_dbus_name;
+	int i = 0, k;
+
+	serv_dict = json_object_array_get_idx(serv_array, 1);
+	serv_dbus_name = json_object_get_string(
+			json_object_array_get_idx(serv_array, 0));
+	data = field_userptr(main_fields[0]);
+
+	if (!serv_dbus_name || !data || strcmp(data->dbus_name,
+				serv_dbus_name) != 0)
+		return -EINVAL;
+
+	for (k = 0; service_config_keys[k] != NULL; k++) {
+		if (json_object_object_get_ex(serv_dict, service_config_keys[k],
+					&tmp_val) == FALSE)
+			continue;
+
+		if (update_fields(&i, service_config_keys[k], tmp_val) < 0)
+			return -EINVAL;
+	}
+
+	if (i != nb_fields)
+		return -EINVAL;
+
+	__renderers_services_config_paging();
+	screen_damage(win_body);
+
+	return 0;
+}
+
 /*
  * Allocate memory for every fields possible in a service, render fields and
  * print them. The result is a form (html-like) displaying every information
@@ -490,15 +696,7 @@ static void renderers_service_config(struct json_object *serv_array)
 	const int max_nb_fields = 113;
 	struct userptr_data *data;
 	const char *serv_dbus_name;
-	const char *keys[] = { key_serv_state, key_serv_error, key_serv_name,
-		key_serv_type, key_serv_security, key_serv_strength,
-		key_serv_favorite, key_serv_immutable, key_serv_roaming,
-		key_serv_autoconnect, key_serv_ethernet, key_serv_ipv4,
-		key_serv_ipv4_config, key_serv_ipv6, key_serv_ipv6_config,
-		key_serv_nameservers, key_serv_nameservers_config,
-		key_serv_timeservers, key_serv_timeservers_config,
-		key_serv_domains, key_serv_domains_config, key_serv_proxy,
-		key_serv_proxy_config, key_serv_prov, NULL };
+	const char **keys = service_config_keys;
 
 	cur_y = 1;
 	cur_x = 1;
@@ -507,7 +705,8 @@ static void renderers_service_config(struct json_object *serv_array)
 			json_object_array_get_idx(serv_array, 0));
 
 	longest_key_len = 25 + 4; // len("Nameservers.Configuration") + padding
-	main_fields = malloc(sizeof(FIELD *) * max_nb_fields); // 113 = #fields + #labels + 1
+	main_fields = arena_alloc(&config_arena, sizeof(FIELD *) *
+			max_nb_fields); // 113 = #fields + #labels + 1
 	i = 0;
 
 	str_field[0] = '\0';
@@ -523,8 +722,13 @@ static void renderers_service_config(struct json_object *serv_array)
 
 	nb_fields = i;
 
-	data = malloc(sizeof(struct userptr_data));
-	data->dbus_name = strdup(serv_dbus_name);
+	// set_field_buffer() marks the fields as changed, only user edits
+	// should
+	for (i = 0; i < nb_fields; i++)
+		set_field_status(main_fields[i], FALSE);
+
+	data = arena_alloc(&config_arena, sizeof(struct userptr_data));
+	data->dbus_name = arena_strdup(&config_arena, serv_dbus_name);
 	data->pretty_name = NULL;
 	set_field_userptr(main_fields[0], data);
 	main_fields[i] = NULL;
@@ -564,233 +768,261 @@ void __renderers_services_config_paging(void)
 }
 
 /*
- * Render the services items for ethernet technology.
- * Only the "Name" (connman term) is displayed.
- * @param jobj The services array
+ * Format the row of an ethernet service, only the "Name" (connman term) is
+ * displayed.
+ * @param serv_dict the service dict
+ * @param desc where to write the row, RENDERERS_STRING_MAX_LEN chars long
+ * @param pretty_name where to write the name of the service,
+ *	RENDERERS_STRING_MAX_LEN chars long
  */
-static void renderers_services_ethernet(struct json_object *jobj)
+static void format_service_ethernet(struct json_object *serv_dict,
+		char *desc, char *pretty_name)
 {
-	int i;
 	// Name  State
-	char *desc_base = "%c %-9s %-24s%-17s", *desc, favorite_char;
-	const char *interface_str, *name_str, *state_str, *dbus_name_str;
-	struct json_object *sub_array, *serv_name, *serv_dict, *tmp;
-	struct userptr_data *data;
+	const char *desc_base = "%c %-9s %-24s%-17s";
+	const char *interface_str, *name_str, *state_str;
+	char favorite_char;
+	struct json_object *tmp;
 
-	mvwprintw(win_body, 3, 2, "  %-9s %-24s%-17s", key_serv_eth_interface,
-			key_serv_name, key_serv_state);
+	json_object_object_get_ex(serv_dict, key_serv_ethernet, &tmp);
+	json_object_object_get_ex(tmp, key_serv_eth_interface, &tmp);
+	interface_str = json_object_get_string(tmp);
 
-	for (i = 0; i < nb_items; i++) {
-		sub_array = json_object_array_get_idx(jobj, i);
-		serv_name = json_object_array_get_idx(sub_array, 0);
-		serv_dict = json_object_array_get_idx(sub_array, 1);
-
-		json_object_object_get_ex(serv_dict, key_serv_ethernet, &tmp);
-		json_object_object_get_ex(tmp, key_serv_eth_interface, &tmp);
-		interface_str = json_object_get_string(tmp);
+	json_object_object_get_ex(serv_dict, key_serv_name, &tmp);
+	name_str = json_object_get_string(tmp);
 
-		json_object_object_get_ex(serv_dict, key_serv_name, &tmp);
-		name_str = json_object_get_string(tmp);
+	json_object_object_get_ex(serv_dict, key_serv_state, &tmp);
+	state_str = json_object_get_string(tmp);
 
-		json_object_object_get_ex(serv_dict, key_serv_state, &tmp);
-		state_str = json_object_get_string(tmp);
+	json_object_object_get_ex(serv_dict, key_serv_favorite, &tmp);
+	favorite_char = ' ';
 
-		json_object_object_get_ex(serv_dict, key_serv_favorite, &tmp);
-		favorite_char = ' ';
+	if (tmp && json_object_get_boolean(tmp) == TRUE)
+		favorite_char = 'f';
 
-		if (tmp && json_object_get_boolean(tmp) == TRUE)
-			favorite_char = 'f';
-
-		desc = malloc(RENDERERS_STRING_MAX_LEN);
-		assert(desc != NULL);
-		snprintf(desc, RENDERERS_STRING_MAX_LEN-1, desc_base,
-				favorite_char, interface_str, name_str, state_str);
-		desc[RENDERERS_STRING_MAX_LEN-1] = '\0';
-
-		dbus_name_str = json_object_get_string(serv_name);
-
-		main_items[i] = new_item(desc, "");
-
-		data = malloc(sizeof(struct userptr_data));
-		assert(data != NULL);
-		data->dbus_name = strdup(dbus_name_str);
-		data->pretty_name = strdup(name_str);
-		set_item_userptr(main_items[i], data);
-	}
+	snprintf(desc, RENDERERS_STRING_MAX_LEN, desc_base, favorite_char,
+			interface_str, name_str, state_str);
+	snprintf(pretty_name, RENDERERS_STRING_MAX_LEN, "%s",
+			name_str ? name_str : "");
 }
 
 /*
- * Render the services items for wifi technology.
- * eSSID, State, Security and Signal strengh are displayed.
- * @param jobj The services array
+ * Format the row of a wifi service: eSSID, State, Security and Signal
+ * strengh are displayed.
+ * The json strings are copied, the engine data must not be modified.
+ * @param serv_dict the service dict
+ * @param desc where to write the row, RENDERERS_STRING_MAX_LEN chars long
+ * @param pretty_name where to write the eSSID, RENDERERS_STRING_MAX_LEN
+ *	chars long
  */
-static void renderers_services_wifi(struct json_object *jobj)
+static void format_service_wifi(struct json_object *serv_dict, char *desc,
+		char *pretty_name)
 {
-	int i;
 	// (favorite) Interface eSSID  State  Security  Signal
-	char *desc_base = "%c %-9s %-29s%-17s%-13s%u%%", *desc, favorite_char,
-	     *essid_str, *security_str;
-	const char *interface_str, *state_str, *serv_name_str;
+	const char *desc_base = "%c %-9s %-29.29s%-17s%-13.13s%u%%";
+	const char *interface_str, *state_str, *name_str, *security_str;
+	char favorite_char, security[RENDERERS_STRING_MAX_LEN];
+	size_t len;
 	uint8_t signal_strength;
-	struct json_object *sub_array, *serv_name, *serv_dict, *tmp;
-	struct userptr_data *data;
+	struct json_object *tmp;
 
-	mvwprintw(win_body, 3, 2, "  %-9s %-29s%-17s%-10s%5s", key_serv_eth_interface,
-			"eSSID", key_serv_state, key_serv_security,
-			"Signal");
+	json_object_object_get_ex(serv_dict, key_serv_ethernet, &tmp);
+	json_object_object_get_ex(tmp, key_serv_eth_interface, &tmp);
+	assert(tmp != NULL);
+	interface_str = json_object_get_string(tmp);
 
-	for (i = 0; i < nb_items; i++) {
-		sub_array = json_object_array_get_idx(jobj, i);
-		serv_name = json_object_array_get_idx(sub_array, 0);
-		serv_dict = json_object_array_get_idx(sub_array, 1);
-
-		json_object_object_get_ex(serv_dict, key_serv_ethernet, &tmp);
-		json_object_object_get_ex(tmp, key_serv_eth_interface, &tmp);
-		assert(tmp != NULL);
-		interface_str = json_object_get_string(tmp);
-
-		json_object_object_get_ex(serv_dict, key_serv_name, &tmp);
-
-		// hidden wifi
-		if (tmp)
-			essid_str = (char *) json_object_get_string(tmp);
-		else
-			essid_str = "[hidden]";
-
-		if (strlen(essid_str) > 28) {
-			essid_str[25] = '.';
-			essid_str[26] = '.';
-			essid_str[27] = '.';
-			essid_str[28] = ' ';
-			essid_str[29] = '\0';
-		}
+	json_object_object_get_ex(serv_dict, key_serv_name, &tmp);
 
-		json_object_object_get_ex(serv_dict, key_serv_security, &tmp);
-		assert(tmp != NULL);
-		security_str = (char *) json_object_get_string(tmp);
-		security_str += 2; // removes the two first char '[ '
-		security_str[strlen(security_str)-2] = '\0'; // removes the two last char ' ]'
+	// hidden wifi
+	if (tmp)
+		name_str = json_object_get_string(tmp);
+	else
+		name_str = "[hidden]";
 
-		json_object_object_get_ex(serv_dict, key_serv_strength, &tmp);
-		assert(tmp != NULL);
-		signal_strength = (uint8_t) json_object_get_int(tmp);
+	if (strlen(name_str) > 28)
+		snprintf(pretty_name, RENDERERS_STRING_MAX_LEN, "%.25s... ",
+				name_str);
+	else
+		snprintf(pretty_name, RENDERERS_STRING_MAX_LEN, "%s", name_str);
+
+	// removes the two first char '[ ' and the two last char ' ]'
+	json_object_object_get_ex(serv_dict, key_serv_security, &tmp);
+	assert(tmp != NULL);
+	security_str = json_object_get_string(tmp);
+	len = strlen(security_str);
+	snprintf(security, sizeof(security), "%.*s",
+			len > 4 ? (int) len - 4 : 0,
+			len > 4 ? security_str + 2 : "");
+
+	json_object_object_get_ex(serv_dict, key_serv_strength, &tmp);
+	assert(tmp != NULL);
+	signal_strength = (uint8_t) json_object_get_int(tmp);
+
+	json_object_object_get_ex(serv_dict, key_serv_state, &tmp);
+	assert(tmp != NULL);
+	state_str = json_object_get_string(tmp);
+
+	json_object_object_get_ex(serv_dict, key_serv_favorite, &tmp);
+	favorite_char = ' ';
+
+	if (tmp && json_object_get_boolean(tmp) == TRUE)
+		favorite_char = 'f';
+
+	snprintf(desc, RENDERERS_STRING_MAX_LEN, desc_base, favorite_char,
+			interface_str, pretty_name, state_str, security,
+			signal_strength);
+}
 
-		json_object_object_get_ex(serv_dict, key_serv_state, &tmp);
-		assert(tmp != NULL);
-		state_str = json_object_get_string(tmp);
+/*
+ * Format the row of a service, see vlist_format_func.
+ * @param sub_array [ "service dbus name", { serv dict } ]
+ */
+static void format_service_row(struct json_object *sub_array, char *buf,
+		size_t len)
+{
+	char tmp[RENDERERS_STRING_MAX_LEN], pretty_name[RENDERERS_STRING_MAX_LEN];
+	struct json_object *serv_dict;
 
-		json_object_object_get_ex(serv_dict, key_serv_favorite, &tmp);
-		favorite_char = ' ';
+	serv_dict = json_object_array_get_idx(sub_array, 1);
 
-		if (tmp && json_object_get_boolean(tmp) == TRUE)
-			favorite_char = 'f';
+	if (services_are_wifi)
+		format_service_wifi(serv_dict, tmp, pretty_name);
+	else
+		format_service_ethernet(serv_dict, tmp, pretty_name);
 
-		desc = malloc(RENDERERS_STRING_MAX_LEN);
-		assert(desc != NULL);
-		snprintf(desc, RENDERERS_STRING_MAX_LEN-1, desc_base,
-				favorite_char, interface_str, essid_str,
-				state_str, security_str, signal_strength);
-		desc[RENDERERS_STRING_MAX_LEN-1] = '\0';
+	snprintf(buf, len, "%s", tmp);
+}
 
-		serv_name_str = json_object_get_string(serv_name);
+/*
+ * Return the dbus name of a service, see vlist_key_func.
+ * @param sub_array [ "service dbus name", { serv dict } ]
+ */
+static const char* service_row_key(struct json_object *sub_array)
+{
+	return json_object_get_string(json_object_array_get_idx(sub_array, 0));
+}
 
-		main_items[i] = new_item(desc, "");
+/*
+ * Return true if the services are wifi ones, see renderers_services.
+ * @param jobj The services array
+ */
+static bool services_array_is_wifi(struct json_object *jobj)
+{
+	struct json_object *array;
+	char *dbus_short_name;
+	bool res;
 
-		data = malloc(sizeof(struct userptr_data));
-		assert(data != NULL);
-		data->dbus_name = strdup(serv_name_str);
-		data->pretty_name = strdup(essid_str);
-		set_item_userptr(main_items[i], data);
-	}
+	array = json_object_array_get_idx(jobj, 0);
+	dbus_short_name = extract_dbus_short_name(json_object_get_string(
+				json_object_array_get_idx(array, 0)));
+	res = strncmp(dbus_short_name, "wifi_", 5) == 0;
+	free(dbus_short_name);
+
+	return res;
 }
 
 /*
- * Allocate memory, render the items and print them. The result is a menu of
- * compatible services the user can connect to.
+ * Render the list of compatible services the user can connect to. The list is
+ * virtualized: only the rows on screen are formatted, see vlist.c.
  * The switch between wifi and ethernet technoloy is done here.
  * @param jobj The services array
  */
 static void renderers_services(struct json_object *jobj)
 {
-	char *dbus_short_name;
-	struct json_object *array, *dbus_long_name;
-
 	main_menu = NULL;
-	nb_items = json_object_array_length(jobj);
+	nb_items = 0;
 
-	if (nb_items == 0) {
+	if (json_object_array_length(jobj) == 0) {
 		mvwprintw(win_body, 1, 2, "No suitable services found for this"
 				" technology");
-		wrefresh(win_body);
+		screen_damage(win_body);
 		return;
 	}
 
-	array = json_object_array_get_idx(jobj, 0);
-	dbus_long_name = json_object_array_get_idx(array, 0);
-
-	dbus_short_name = extract_dbus_short_name(json_object_get_string(dbus_long_name));
-	main_items = malloc(sizeof(ITEM *) * (nb_items+1));
-	assert(main_items != NULL);
+	services_are_wifi = services_array_is_wifi(jobj);
 
-	if (strncmp(dbus_short_name, "ethernet_", 9) == 0)
-		renderers_services_ethernet(jobj);
-	else if (strncmp(dbus_short_name, "wifi_", 5) == 0)
-		renderers_services_wifi(jobj);
+	if (services_are_wifi)
+		mvwprintw(win_body, 3, 2, "  %-9s %-29s%-17s%-10s%5s",
+				key_serv_eth_interface, "eSSID", key_serv_state,
+				key_serv_security, "Signal");
 	else
-		assert(true);
-
-	free(dbus_short_name);
+		mvwprintw(win_body, 3, 2, "  %-9s %-24s%-17s",
+				key_serv_eth_interface, key_serv_name,
+				key_serv_state);
 
 	mvwprintw(win_body, 1, 2, "Choose a network to connect to:");
 
-	main_items[nb_items] = NULL;
-	main_menu = new_menu(main_items);
-	set_menu_win(main_menu, win_body);
-	set_menu_sub(main_menu, derwin(win_body, win_body_lines-3, COLS-4, 4, 2));
-	menu_opts_off(main_menu, O_SHOWDESC);
-	set_menu_mark(main_menu, "");
-	set_menu_format(main_menu, win_body_lines-3, 1);
-	assert(post_menu(main_menu) == E_OK);
+	services_list = vlist_new(derwin(win_body, win_body_lines-3, COLS-4, 4,
+				2), format_service_row, service_row_key);
+	vlist_set_rows(services_list, jobj);
 
 	refresh_services_msg();
 	repos_cursor();
+	vlist_draw(services_list);
 }
 
 /*
- * Free the memory allocated for the services view by renderers_services.
+ * Update the services list with a new services array, only the lines that
+ * changed are repainted and the cursor stays on the same service.
+ * Return 0 on success, -EINVAL if the list can't be updated and has to be
+ * rendered from scratch.
+ * @param jobj The services array
  */
-void __renderers_free_services(void)
+static int renderers_services_update(struct json_object *jobj)
 {
-	int i;
-	struct userptr_data *data;
-	const char *item_name_desc = NULL;
+	if (!services_list || json_object_array_length(jobj) == 0 ||
+			services_array_is_wifi(jobj) != services_are_wifi)
+		return -EINVAL;
 
-	if (main_menu == NULL)
-		return;
+	vlist_set_rows(services_list, jobj);
+	vlist_draw(services_list);
 
-	unpost_menu(main_menu);
+	return 0;
+}
 
-	for (i = 0; i < nb_items; i++) {
-		data = item_userptr(main_items[i]);
-		free((void *) data->dbus_name);
-		free((void *) data->pretty_name);
-		free(data);
+/*
+ * Return the service selected in the services list, NULL if none. The data
+ * is valid until the next call.
+ */
+struct userptr_data* __renderers_services_current(void)
+{
+	char desc[RENDERERS_STRING_MAX_LEN], pretty_name[RENDERERS_STRING_MAX_LEN];
+	struct json_object *sub_array, *serv_dict;
 
-		item_name_desc = item_name(main_items[i]);
+	if (!services_list)
+		return NULL;
 
-		if (item_name_desc != NULL)
-			free((void *) item_name_desc);
+	sub_array = vlist_current_row(services_list);
 
-		item_name_desc = item_description(main_items[i]);
+	if (!sub_array)
+		return NULL;
 
-		if (item_name_desc != NULL)
-			free((void *) item_name_desc);
+	serv_dict = json_object_array_get_idx(sub_array, 1);
 
-		free_item(main_items[i]);
-	}
+	if (services_are_wifi)
+		format_service_wifi(serv_dict, desc, pretty_name);
+	else
+		format_service_ethernet(serv_dict, desc, pretty_name);
 
-	free_menu(main_menu);
-	free(main_items);
+	free(services_current.dbus_name);
+	free(services_current.pretty_name);
+	services_current.dbus_name = strdup(service_row_key(sub_array));
+	services_current.pretty_name = strdup(pretty_name);
+
+	return &services_current;
+}
+
+/*
+ * Free the memory allocated for the services view by renderers_services.
+ */
+void __renderers_free_services(void)
+{
+	if (services_list == NULL)
+		return;
+
+	vlist_free(services_list);
+	services_list = NULL;
+	view_generation = -1;
 	nb_items = 0;
 	main_menu = NULL;
 	main_items = NULL;
@@ -813,6 +1045,33 @@ void __renderers_services(struct json_object *jobj)
 
 	json_object_object_get_ex(jobj, key_technology, &tech_array);
 	json_object_object_get_ex(jobj, key_services, &serv_array);
+
+	// The configuration of the service is already displayed, try to update
+	// it in place
+	if ((context.current_context == CONTEXT_SERVICE_CONFIG ||
+			context.current_context ==
+			CONTEXT_SERVICE_CONFIG_STANDALONE) && main_form) {
+		if (serv_array && json_object_array_length(serv_array) > 0 &&
+				(!tech_array || tech_is_connected(
+					json_object_array_get_idx(tech_array, 1)))
+				&& renderers_service_config_update(
+					json_object_array_get_idx(serv_array, 0)) == 0)
+			return;
+
+		save_cursor();
+		__renderers_free_service_config();
+	}
+
+	// The services view is already displayed, try to update it in place
+	if (context.current_context == CONTEXT_SERVICES && services_list) {
+		if (tech_array && serv_array && !tech_is_connected(
+					json_object_array_get_idx(tech_array, 1))
+				&& renderers_services_update(serv_array) == 0)
+			return;
+
+		__renderers_free_services();
+	}
+
 	werase(win_body);
 	box(win_body, 0, 0);
 
@@ -845,7 +1104,7 @@ void __renderers_services(struct json_object *jobj)
 		context.current_context = CONTEXT_SERVICES;
 	}
 
-	wrefresh(win_body);
+	screen_damage(win_body);
 }
 
 /*
@@ -854,31 +1113,21 @@ void __renderers_services(struct json_object *jobj)
 void __renderers_free_service_config(void)
 {
 	int i;
-	struct userptr_data *tmp;
 
 	if (main_form == NULL)
 		return;
 
 	unpost_form(main_form);
 
-	for (i = 0; i < nb_fields && main_fields[i] != NULL; i++) {
-		tmp = field_userptr(main_fields[i]);
-
-		if (tmp) {
-			if (tmp->dbus_name)
-				free(tmp->dbus_name);
-
-			if (tmp->pretty_name)
-				free(tmp->pretty_name);
-
-			free(tmp);
-		}
-
+	for (i = 0; i < nb_fields && main_fields[i] != NULL; i++)
 		free_field(main_fields[i]);
-	}
 
 	free_form(main_form);
-	free(main_fields);
+	delwin(inner);
+	inner = NULL;
+	arena_reset(&config_arena);
+	view_generation = -1;
+	cursor_index_free();
 	nb_fields = 0;
 	main_fields = NULL;
 	main_form = NULL;
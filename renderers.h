@@ -22,10 +22,13 @@
 #ifndef __CONNMAN_RENDERERS_H
 #define __CONNMAN_RENDERERS_H
 
+#include <stdint.h>
 #include <ncurses.h>
 #include <form.h>
 #include <menu.h>
 
+#include "vlist.h"
+
 #define RENDERERS_STRING_MAX_LEN 100
 
 #ifdef __cplusplus
@@ -39,6 +42,8 @@ extern FIELD **main_fields;
 extern FORM *main_form;
 extern int win_body_lines;
 extern int nb_pages;
+extern struct vlist *services_list;
+extern int64_t view_generation;
 
 struct userptr_data {
 	char *dbus_name;	// e.g. /net/connman/wifi_XXXXXX_YYYY_none
@@ -71,6 +76,10 @@ void __renderers_free_service_config(void);
 
 void __renderers_free_services(void);
 
+struct userptr_data* __renderers_services_current(void);
+
+int __renderers_cursor_index(const char *key);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,265 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <json.h>
+
+#include "engine.h"
+#include "loop.h"
+#include "keys.h"
+#include "stats.h"
+#include "player.h"
+
+/*
+ * Soak test of the engine on a bus with a signal storm (see soak.sh): the
+ * client played (see player.c) queries the wifi services on every change
+ * notification, watches the first ones and answers the agent requests, as the
+ * ncurses client does. Every second, the memory is sampled with the get_stats
+ * command (see get_stats() in engine.c). Once the storm is over, the RSS and
+ * the heap must be where they were at the end of the warm up: a leak of a few
+ * bytes per signal shows after a million signals.
+ */
+
+// Time between two samples of the memory.
+#define SOAK_SAMPLE_MS 1000
+
+// The storm is over when no signal came for that long.
+#define SOAK_STALL_MS 10000
+
+// Part of the signals received before the reference sample is taken.
+#define SOAK_WARM_UP_PERCENT 10
+
+// Growth of the RSS and of the heap allowed after the warm up.
+#define SOAK_SLACK_BYTES (4 * 1024 * 1024)
+
+struct sample {
+	int64_t signals;
+	int64_t rss_bytes;
+	int64_t heap_bytes;
+	int json_objects;
+	int pending_calls;
+	int agent_requests;
+};
+
+// Signals to receive.
+static int64_t nb_signals = 1000000;
+
+// The sample taken at the end of the warm up, and the last one.
+static struct sample reference, last;
+
+static bool has_reference;
+
+static uint64_t last_sample_us, last_signal_us;
+
+static int64_t get_int64(struct json_object *jobj, const char *key)
+{
+	struct json_object *tmp;
+
+	if (!json_object_object_get_ex(jobj, key, &tmp))
+		return -1;
+
+	return json_object_get_int64(tmp);
+}
+
+/*
+ * Read a get_stats reply, stop the loop once the storm is over.
+ */
+static void read_sample(struct json_object *reply)
+{
+	struct json_object *stats, *latency, *memory;
+	struct sample sample;
+
+	json_object_object_get_ex(reply, key_command_data, &stats);
+	json_object_object_get_ex(stats, "signal_to_render", &latency);
+	json_object_object_get_ex(stats, "memory", &memory);
+
+	sample.signals = get_int64(latency, "signals");
+	sample.rss_bytes = get_int64(memory, "rss_bytes");
+	sample.heap_bytes = get_int64(memory, "heap_bytes");
+	sample.json_objects = get_int64(memory, "json_objects");
+	sample.pending_calls = get_int64(memory, "pending_calls");
+	sample.agent_requests = get_int64(memory, "agent_requests");
+
+	printf("[*] %lld signals, RSS %lld kB, heap %lld kB, %d json objects, "
+			"%d pending calls, %d agent requests\n",
+			(long long) sample.signals,
+			(long long) sample.rss_bytes / 1024,
+			(long long) sample.heap_bytes / 1024,
+			sample.json_objects, sample.pending_calls,
+			sample.agent_requests);
+	fflush(stdout);
+
+	if (sample.signals > last.signals)
+		last_signal_us = stats_now_us();
+
+	last = sample;
+
+	if (!has_reference && sample.signals >= nb_signals *
+			SOAK_WARM_UP_PERCENT / 100) {
+		reference = sample;
+		has_reference = true;
+	}
+
+	if (sample.signals >= nb_signals ||
+			stats_now_us() - last_signal_us >= SOAK_STALL_MS * 1000)
+		loop_quit();
+}
+
+static void soak_callback(int status, struct json_object *jobj)
+{
+	struct json_object *cmd;
+	const char *cmd_name = NULL;
+
+	// Serialize what the engine sent, as the headless daemon does
+	json_object_to_json_string(jobj);
+
+	if (json_object_object_get_ex(jobj, key_command, &cmd))
+		cmd_name = json_object_get_string(cmd);
+
+	if (json_object_object_get_ex(jobj, key_changes, NULL))
+		player_query_services();
+
+	else if (json_object_object_get_ex(jobj, key_agent_msg, NULL))
+		player_answer_agent(jobj, "soak");
+
+	else if (cmd_name && strcmp(cmd_name,
+				key_engine_get_services_from_tech) == 0)
+		player_watch_rows(jobj);
+
+	else if (cmd_name && strcmp(cmd_name, key_engine_get_stats) == 0)
+		read_sample(jobj);
+
+	json_object_put(jobj);
+}
+
+/*
+ * Loop idle function: sample the memory every SOAK_SAMPLE_MS.
+ * Return the time left until the next sample.
+ */
+static int soak_idle(void)
+{
+	uint64_t elapsed_ms = (stats_now_us() - last_sample_us) / 1000;
+
+	if (elapsed_ms < SOAK_SAMPLE_MS)
+		return SOAK_SAMPLE_MS - elapsed_ms;
+
+	last_sample_us = stats_now_us();
+	player_send_command(key_engine_get_stats, NULL);
+
+	return SOAK_SAMPLE_MS;
+}
+
+/*
+ * Return true if a figure grew by more than SOAK_SLACK_BYTES since the
+ * reference sample, unknown figures (-1) never do.
+ */
+static bool has_grown(const char *name, int64_t ref, int64_t now)
+{
+	if (ref < 0 || now < 0 || now - ref <= SOAK_SLACK_BYTES)
+		return false;
+
+	printf("\tFAILED: the %s grew by %lld kB\n", name,
+			(long long) (now - ref) / 1024);
+
+	return true;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-a bus] [-N signals]\n"
+			"  -a  bus connman is on: system (default), session "
+			"or a dbus address\n"
+			"  -N  signals to receive (default %lld)\n",
+			prog, (long long) nb_signals);
+}
+
+int main(int argc, char *argv[])
+{
+	char *end;
+	bool failed;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:N:h")) != -1) {
+		switch (opt) {
+			case 'a':
+				engine_set_bus(optarg);
+				break;
+
+			case 'N':
+				nb_signals = strtoll(optarg, &end, 10);
+
+				if (*end != '\0' || end == optarg ||
+						nb_signals <= 0) {
+					usage(argv[0]);
+					exit(1);
+				}
+
+				break;
+
+			default:
+				usage(argv[0]);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+
+	engine_callback = soak_callback;
+	stats_enable(true);
+
+	if (engine_init() < 0)
+		exit(1);
+
+	last_signal_us = last_sample_us = stats_now_us();
+	loop_add_idle(soak_idle);
+	player_query_services();
+	loop_run(false);
+	loop_remove_idle(soak_idle);
+	engine_terminate();
+	loop_terminate();
+
+	if (!has_reference) {
+		printf("\tFAILED: %lld signals received, the warm up needs "
+				"%lld\n", (long long) last.signals,
+				(long long) nb_signals *
+				SOAK_WARM_UP_PERCENT / 100);
+		return 1;
+	}
+
+	printf("[*] after the warm up (%lld signals): RSS %lld kB, heap %lld kB, "
+			"%d json objects\n", (long long) reference.signals,
+			(long long) reference.rss_bytes / 1024,
+			(long long) reference.heap_bytes / 1024,
+			reference.json_objects);
+
+	failed = has_grown("RSS", reference.rss_bytes, last.rss_bytes);
+	failed |= has_grown("heap", reference.heap_bytes, last.heap_bytes);
+
+	printf("\n[*] the end.\n");
+
+	return failed ? 1 : 0;
+}
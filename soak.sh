@@ -0,0 +1,14 @@
+#!/bin/bash
+
+# Soak test of the engine: connman_soak runs next to connman_mock sending a
+# storm of signals, and fails if its memory grows:
+#	./soak.sh [signals [kind]]
+# e.g. "./soak.sh 1000000 churn" (the default): a million ServicesChanged, a
+# service leaving or coming back each time. See connman_mock -k for the kinds.
+
+DIR=$(dirname "$0")
+SIGNALS=${1:-1000000}
+KIND=${2:-churn}
+
+exec "$DIR/mock-bus.sh" -n 20 -r 2000 -N "$SIGNALS" -k "$KIND" -- \
+	"$DIR/connman_soak" -a @BUS@ -N "$SIGNALS"
@@ -26,6 +26,8 @@
 #include <ncurses.h>
 #include <assert.h>
 
+#include "ncurses_utils.h"
+
 #include "special_win.h"
 
 #define WINDOW_EXIT_MSG "'Esc' to close."
@@ -94,8 +96,8 @@ bool win_exists(WINDOW *win)
 void win_refresh(WINDOW *win)
 {
 	if (win) {
-		redrawwin(win);
-		wrefresh(win);
+		touchwin(win);
+		screen_damage(win);
 	}
 }
 
@@ -0,0 +1,638 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <json.h>
+
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#include "stats.h"
+
+/*
+ * This file collects timings and counters on the main loop, the dispatch path
+ * and the processing stages of a message (see enum stats_stage). Collection
+ * is off by default: every stats_* function returns immediately until
+ * stats_enable(true) is called, so the cost when disabled is a single test.
+ */
+
+struct timing {
+	uint64_t count;
+	uint64_t total_us;
+	uint64_t max_us;
+	uint64_t begin_us;
+};
+
+// A processing stage is short: it's timed in nanoseconds.
+struct stage {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t allocations;
+	uint64_t begin_ns;
+	uint64_t begin_allocations;
+};
+
+// Return the number of memory allocations done so far, set by a client able
+// to count them (e.g. the benchmark). NULL if they aren't counted.
+uint64_t (*stats_allocations)(void) = NULL;
+
+// Is the collection running ?
+static bool enabled = false;
+
+// When the collection started (or was reset).
+static uint64_t start_us;
+
+// Number of loop iterations.
+static uint64_t iterations;
+
+// Time spent in poll().
+static struct timing poll_wait;
+
+// Time spent in dbus_connection_dispatch().
+static struct timing dispatch;
+
+// Time spent in ncurses_action().
+static struct timing action;
+
+// Messages dispatched, in total and at most on a single wakeup.
+static uint64_t dispatched_msgs, dispatched_max_per_wakeup;
+
+// Dispatch slices stopped by the budget while messages remained.
+static uint64_t cut_slices;
+
+// Messages dispatched since the first cut slice of the current backlog, and
+// the deepest backlog seen (in messages). in_backlog is true while draining.
+static uint64_t backlog_depth, backlog_depth_max, backlog_depth_last;
+static bool in_backlog;
+
+// Signals received, delivered to the engine (after coalescing) and renders
+// done.
+static uint64_t signals, signals_delivered, renders;
+
+// Refreshes requested by events and refreshes executed.
+static uint64_t redraws_requested, redraws_done;
+
+// Arrival time of the oldest signal not rendered yet, 0 if none.
+static uint64_t oldest_pending_signal_us;
+
+// Signal to render latency histogram, see STATS_LATENCY_BUCKETS.
+static uint64_t latency_histogram[STATS_LATENCY_BUCKETS];
+
+// Time and allocations of the processing stages.
+static struct stage stages[STATS_NB_STAGES];
+
+static const char *stage_names[STATS_NB_STAGES] = {
+	"decode",
+	"apply",
+	"validate",
+	"serialize",
+	"render",
+};
+
+/*
+ * Return a monotonic timestamp in microseconds.
+ */
+uint64_t stats_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Start or stop the collection. Starting it resets every counter.
+ * @param enable true to start collecting
+ */
+void stats_enable(bool enable)
+{
+	if (enable && !enabled)
+		stats_reset();
+
+	enabled = enable;
+}
+
+bool stats_enabled(void)
+{
+	return enabled;
+}
+
+/*
+ * Set every counter back to zero.
+ */
+void stats_reset(void)
+{
+	start_us = stats_now_us();
+	iterations = 0;
+	memset(&poll_wait, 0, sizeof(poll_wait));
+	memset(&dispatch, 0, sizeof(dispatch));
+	memset(&action, 0, sizeof(action));
+	dispatched_msgs = 0;
+	dispatched_max_per_wakeup = 0;
+	cut_slices = 0;
+	backlog_depth = 0;
+	backlog_depth_max = 0;
+	backlog_depth_last = 0;
+	in_backlog = false;
+	signals = 0;
+	signals_delivered = 0;
+	renders = 0;
+	redraws_requested = 0;
+	redraws_done = 0;
+	oldest_pending_signal_us = 0;
+	memset(latency_histogram, 0, sizeof(latency_histogram));
+	memset(stages, 0, sizeof(stages));
+}
+
+static void timing_begin(struct timing *t)
+{
+	t->begin_us = stats_now_us();
+}
+
+static void timing_end(struct timing *t)
+{
+	uint64_t elapsed;
+
+	if (t->begin_us == 0)
+		return;
+
+	elapsed = stats_now_us() - t->begin_us;
+	t->begin_us = 0;
+	t->count++;
+	t->total_us += elapsed;
+
+	if (elapsed > t->max_us)
+		t->max_us = elapsed;
+}
+
+/*
+ * Called around poll() in the loop. Each poll is a loop iteration.
+ */
+void stats_poll_begin(void)
+{
+	if (!enabled)
+		return;
+
+	iterations++;
+	timing_begin(&poll_wait);
+}
+
+void stats_poll_end(void)
+{
+	if (!enabled)
+		return;
+
+	timing_end(&poll_wait);
+}
+
+/*
+ * Called around the dbus_connection_dispatch() calls following a wakeup.
+ */
+void stats_dispatch_begin(void)
+{
+	if (!enabled)
+		return;
+
+	timing_begin(&dispatch);
+}
+
+/*
+ * @param nb_msgs number of messages dispatched on this wakeup
+ * @param data_remains true if the slice was cut by the dispatch budget
+ */
+void stats_dispatch_end(unsigned int nb_msgs, bool data_remains)
+{
+	if (!enabled)
+		return;
+
+	timing_end(&dispatch);
+	dispatched_msgs += nb_msgs;
+
+	if (nb_msgs > dispatched_max_per_wakeup)
+		dispatched_max_per_wakeup = nb_msgs;
+
+	if (data_remains)
+		cut_slices++;
+
+	if (data_remains || in_backlog)
+		backlog_depth += nb_msgs;
+
+	if (data_remains) {
+		in_backlog = true;
+		return;
+	}
+
+	if (in_backlog) {
+		backlog_depth_last = backlog_depth;
+
+		if (backlog_depth > backlog_depth_max)
+			backlog_depth_max = backlog_depth;
+
+		backlog_depth = 0;
+		in_backlog = false;
+	}
+}
+
+/*
+ * Called around ncurses_action().
+ */
+void stats_action_begin(void)
+{
+	if (!enabled)
+		return;
+
+	timing_begin(&action);
+}
+
+void stats_action_end(void)
+{
+	if (!enabled)
+		return;
+
+	timing_end(&action);
+}
+
+/*
+ * A connman signal just arrived. Only the oldest signal not rendered yet is
+ * remembered: the latency measured is the one of the worst signal.
+ */
+void stats_signal_received(void)
+{
+	if (!enabled)
+		return;
+
+	signals++;
+
+	if (oldest_pending_signal_us == 0)
+		oldest_pending_signal_us = stats_now_us();
+}
+
+/*
+ * A signal went through the coalescing stage and is delivered to the engine.
+ */
+void stats_signal_delivered(void)
+{
+	if (!enabled)
+		return;
+
+	signals_delivered++;
+}
+
+/*
+ * The screen has been rendered, account the latency of pending signals.
+ */
+void stats_render_done(void)
+{
+	uint64_t latency;
+	int bucket;
+
+	if (!enabled)
+		return;
+
+	renders++;
+
+	if (oldest_pending_signal_us == 0)
+		return;
+
+	latency = stats_now_us() - oldest_pending_signal_us;
+	oldest_pending_signal_us = 0;
+
+	for (bucket = 0; bucket < STATS_LATENCY_BUCKETS-1 && latency > 1; bucket++)
+		latency >>= 1;
+
+	latency_histogram[bucket]++;
+}
+
+/*
+ * The current context has been marked to be refreshed.
+ */
+void stats_redraw_requested(void)
+{
+	if (!enabled)
+		return;
+
+	redraws_requested++;
+}
+
+/*
+ * The current context is refreshed.
+ */
+void stats_redraw_done(void)
+{
+	if (!enabled)
+		return;
+
+	redraws_done++;
+}
+
+/*
+ * Called around a processing stage. Stages of different kinds can be nested,
+ * e.g. a render validating the commands it sends.
+ */
+void stats_stage_begin(enum stats_stage stage)
+{
+	if (!enabled)
+		return;
+
+	stages[stage].begin_ns = now_ns();
+
+	if (stats_allocations)
+		stages[stage].begin_allocations = stats_allocations();
+}
+
+void stats_stage_end(enum stats_stage stage)
+{
+	struct stage *s = &stages[stage];
+	uint64_t elapsed;
+
+	if (!enabled || s->begin_ns == 0)
+		return;
+
+	elapsed = now_ns() - s->begin_ns;
+	s->begin_ns = 0;
+	s->count++;
+	s->total_ns += elapsed;
+
+	if (elapsed > s->max_ns)
+		s->max_ns = elapsed;
+
+	if (stats_allocations)
+		s->allocations += stats_allocations() - s->begin_allocations;
+}
+
+static struct json_object* timing_to_json(struct timing *t)
+{
+	struct json_object *res;
+
+	res = json_object_new_object();
+	json_object_object_add(res, "count", json_object_new_int64(t->count));
+	json_object_object_add(res, "total_us",
+			json_object_new_int64(t->total_us));
+	json_object_object_add(res, "max_us", json_object_new_int64(t->max_us));
+
+	return res;
+}
+
+/*
+ * Return the resident set size of the process in bytes, -1 if unknown.
+ * This isn't gated by stats_enable().
+ */
+int64_t stats_rss_bytes(void)
+{
+	FILE *statm;
+	long pages = -1;
+
+	statm = fopen("/proc/self/statm", "r");
+
+	if (!statm)
+		return -1;
+
+	if (fscanf(statm, "%*d %ld", &pages) != 1)
+		pages = -1;
+
+	fclose(statm);
+
+	return pages < 0 ? -1 : (int64_t) pages * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Return the bytes allocated by malloc and not freed yet, -1 if unknown.
+ * This isn't gated by stats_enable().
+ */
+int64_t stats_heap_bytes(void)
+{
+#ifdef HAVE_MALLINFO2
+	struct mallinfo2 info = mallinfo2();
+
+	return info.uordblks + info.hblkhd;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * Return the collected data:
+ {
+	"enabled": true,
+	"elapsed_us": 123,
+	"loop": {
+		"iterations": 12,
+		"poll_wait": { "count": 12, "total_us": 1000, "max_us": 100 },
+		"dispatch": { ... },
+		"ncurses_action": { ... },
+		"dispatched_msgs": 42,
+		"dispatched_max_per_wakeup": 9,
+		"cut_slices": 2,
+		"backlog_depth_last": 130,
+		"backlog_depth_max": 130
+	},
+	"signal_to_render": {
+		"signals": 42,
+		"signals_delivered": 10,
+		"renders": 3,
+		"histogram_us": { "1": 0, "2": 0, "4": 1, ... }
+	},
+	"redraw": {
+		"requested": 40,
+		"done": 4
+	},
+	"stages": {
+		"decode": { "count": 42, "total_ns": 84000, "max_ns": 9000,
+			"allocations": 840 },
+		"apply": { ... },
+		"validate": { ... },
+		"serialize": { ... },
+		"render": { ... }
+	},
+	"memory": {
+		"rss_bytes": 4915200,
+		"heap_bytes": 1048576
+	}
+ }
+ * The memory figures are collected even when disabled, -1 if unknown.
+ * A backlog depth is the number of messages dispatched from the first slice
+ * cut by the budget until the dbus queue is empty again.
+ * Histogram keys are the lower bound of each bucket in microseconds.
+ */
+struct json_object* stats_to_json(void)
+{
+	struct json_object *res, *loop, *latency, *histogram, *redraw,
+			*jstages, *jstage, *memory;
+	char key[24];
+	int i;
+
+	loop = json_object_new_object();
+	json_object_object_add(loop, "iterations",
+			json_object_new_int64(iterations));
+	json_object_object_add(loop, "poll_wait", timing_to_json(&poll_wait));
+	json_object_object_add(loop, "dispatch", timing_to_json(&dispatch));
+	json_object_object_add(loop, "ncurses_action", timing_to_json(&action));
+	json_object_object_add(loop, "dispatched_msgs",
+			json_object_new_int64(dispatched_msgs));
+	json_object_object_add(loop, "dispatched_max_per_wakeup",
+			json_object_new_int64(dispatched_max_per_wakeup));
+	json_object_object_add(loop, "cut_slices",
+			json_object_new_int64(cut_slices));
+	json_object_object_add(loop, "backlog_depth_last",
+			json_object_new_int64(backlog_depth_last));
+	json_object_object_add(loop, "backlog_depth_max",
+			json_object_new_int64(backlog_depth_max));
+
+	histogram = json_object_new_object();
+
+	for (i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+		snprintf(key, sizeof(key), "%llu", 1ULL << i);
+		json_object_object_add(histogram, key,
+				json_object_new_int64(latency_histogram[i]));
+	}
+
+	latency = json_object_new_object();
+	json_object_object_add(latency, "signals", json_object_new_int64(signals));
+	json_object_object_add(latency, "signals_delivered",
+			json_object_new_int64(signals_delivered));
+	json_object_object_add(latency, "renders", json_object_new_int64(renders));
+	json_object_object_add(latency, "histogram_us", histogram);
+
+	redraw = json_object_new_object();
+	json_object_object_add(redraw, "requested",
+			json_object_new_int64(redraws_requested));
+	json_object_object_add(redraw, "done",
+			json_object_new_int64(redraws_done));
+
+	jstages = json_object_new_object();
+
+	for (i = 0; i < STATS_NB_STAGES; i++) {
+		jstage = json_object_new_object();
+		json_object_object_add(jstage, "count",
+				json_object_new_int64(stages[i].count));
+		json_object_object_add(jstage, "total_ns",
+				json_object_new_int64(stages[i].total_ns));
+		json_object_object_add(jstage, "max_ns",
+				json_object_new_int64(stages[i].max_ns));
+		json_object_object_add(jstage, "allocations",
+				json_object_new_int64(stages[i].allocations));
+		json_object_object_add(jstages, stage_names[i], jstage);
+	}
+
+	memory = json_object_new_object();
+	json_object_object_add(memory, "rss_bytes",
+			json_object_new_int64(stats_rss_bytes()));
+	json_object_object_add(memory, "heap_bytes",
+			json_object_new_int64(stats_heap_bytes()));
+
+	res = json_object_new_object();
+	json_object_object_add(res, "enabled", json_object_new_boolean(enabled));
+	json_object_object_add(res, "elapsed_us",
+			json_object_new_int64(enabled ? stats_now_us() - start_us : 0));
+	json_object_object_add(res, "loop", loop);
+	json_object_object_add(res, "signal_to_render", latency);
+	json_object_object_add(res, "redraw", redraw);
+	json_object_object_add(res, "stages", jstages);
+	json_object_object_add(res, "memory", memory);
+
+	return res;
+}
+
+/*
+ * Return where the F8 key dumps the instrumentation data: STATS_DUMP_NAME in
+ * $XDG_RUNTIME_DIR, private to the user, or in /tmp without it.
+ */
+const char* stats_dump_path(void)
+{
+	static char path[PATH_MAX];
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+
+	if (!dir || dir[0] != '/')
+		dir = "/tmp";
+
+	snprintf(path, sizeof(path), "%s/%s", dir, STATS_DUMP_NAME);
+
+	return path;
+}
+
+/*
+ * Write stats_to_json() in a file.
+ * @param path the file to (over)write, it must be a regular file of the user
+ */
+int stats_dump(const char *path)
+{
+	struct json_object *jobj;
+	struct stat st;
+	FILE *f;
+	int fd, res = 0;
+
+	// The file can be in a directory other users write to: don't follow a
+	// link they planted, block on their fifo, nor write in their file
+	fd = open(path, O_WRONLY | O_CREAT | O_NOFOLLOW | O_NONBLOCK, 0600);
+
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0 || st.st_uid != geteuid() ||
+			!S_ISREG(st.st_mode) || ftruncate(fd, 0) < 0) {
+		close(fd);
+		return -EPERM;
+	}
+
+	f = fdopen(fd, "w");
+
+	if (!f) {
+		res = -errno;
+		close(fd);
+		return res;
+	}
+
+	jobj = stats_to_json();
+
+	if (fprintf(f, "%s\n", json_object_to_json_string(jobj)) < 0)
+		res = -EIO;
+
+	json_object_put(jobj);
+
+	if (fclose(f) != 0 && res == 0)
+		res = -EIO;
+
+	return res;
+}
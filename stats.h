@@ -0,0 +1,100 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_STATS_H
+#define __CONNMAN_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <json.h>
+
+// The file the F8 key dumps the instrumentation data in, see
+// stats_dump_path().
+#define STATS_DUMP_NAME "connman-ncurses-stats.json"
+
+// Latency buckets are powers of two in microseconds: [2^i, 2^(i+1)).
+#define STATS_LATENCY_BUCKETS 25
+
+// Processing stages timed by stats_stage_begin() and stats_stage_end().
+enum stats_stage {
+	STATS_STAGE_DECODE,	// dbus message to json, dbus_to_json()
+	STATS_STAGE_APPLY,	// signal applied to the engine records
+	STATS_STAGE_VALIDATE,	// data of a command checked, engine_query()
+	STATS_STAGE_SERIALIZE,	// json string sent to a client of the daemon
+	STATS_STAGE_RENDER,	// ncurses client showing what it got
+	STATS_NB_STAGES,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern uint64_t (*stats_allocations)(void);
+
+uint64_t stats_now_us(void);
+
+void stats_enable(bool enable);
+
+bool stats_enabled(void);
+
+void stats_reset(void);
+
+void stats_poll_begin(void);
+
+void stats_poll_end(void);
+
+void stats_dispatch_begin(void);
+
+void stats_dispatch_end(unsigned int nb_msgs, bool data_remains);
+
+void stats_action_begin(void);
+
+void stats_action_end(void);
+
+void stats_signal_received(void);
+
+void stats_signal_delivered(void);
+
+void stats_render_done(void);
+
+void stats_redraw_requested(void);
+
+void stats_redraw_done(void);
+
+void stats_stage_begin(enum stats_stage stage);
+
+void stats_stage_end(enum stats_stage stage);
+
+int64_t stats_rss_bytes(void);
+
+int64_t stats_heap_bytes(void);
+
+struct json_object* stats_to_json(void);
+
+const char* stats_dump_path(void);
+
+int stats_dump(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,233 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <ncurses.h>
+#include <json.h>
+
+#include "keys.h"
+#include "renderers.h"
+
+/*
+ * Rebuild the home page and the service configuration views with the real
+ * renderers (renderers.c) on a terminal writing to /dev/null, and count the
+ * malloc done by the connman-ncurses objects on each refresh: once the
+ * per-view arenas (arena.c) have their chunk, a refresh must not malloc.
+ * Link with -Wl,--wrap=malloc, see compile_tests.sh.
+ */
+
+#define NB_REFRESH 10000
+
+extern struct context_info context;
+
+static unsigned int nb_mallocs;
+
+void* __real_malloc(size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+	nb_mallocs++;
+	return __real_malloc(size);
+}
+
+// main.c puts the cursor back on context.cursor_id
+void repos_cursor(void)
+{
+	free(context.cursor_id);
+	context.cursor_id = NULL;
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static struct json_object* home_page(int nb_techs)
+{
+	struct json_object *res, *techs, *tech, *dict, *state;
+	char dbus_name[64];
+	int i;
+
+	techs = json_object_new_array();
+
+	for (i = 0; i < nb_techs; i++) {
+		snprintf(dbus_name, sizeof(dbus_name),
+				"/net/connman/technology/wifi%d", i);
+		dict = json_object_new_object();
+		json_object_object_add(dict, key_serv_name,
+				json_object_new_string("WiFi"));
+		json_object_object_add(dict, "Type",
+				json_object_new_string("wifi"));
+		json_object_object_add(dict, "Powered",
+				json_object_new_boolean(1));
+		json_object_object_add(dict, "Connected",
+				json_object_new_boolean(0));
+		tech = json_object_new_array();
+		json_object_array_add(tech, json_object_new_string(dbus_name));
+		json_object_array_add(tech, dict);
+		json_object_array_add(techs, tech);
+	}
+
+	state = json_object_new_object();
+	json_object_object_add(state, key_serv_state,
+			json_object_new_string("idle"));
+	json_object_object_add(state, "OfflineMode",
+			json_object_new_boolean(0));
+
+	res = json_object_new_object();
+	json_object_object_add(res, key_technologies, techs);
+	json_object_object_add(res, key_state, state);
+
+	return res;
+}
+
+static struct json_object* service_config(void)
+{
+	struct json_object *res, *serv, *servs, *dict, *ipv4, *ns;
+
+	ipv4 = json_object_new_object();
+	json_object_object_add(ipv4, "Method", json_object_new_string("dhcp"));
+	json_object_object_add(ipv4, "Address",
+			json_object_new_string("192.168.1.12"));
+	json_object_object_add(ipv4, "Netmask",
+			json_object_new_string("255.255.255.0"));
+	json_object_object_add(ipv4, "Gateway",
+			json_object_new_string("192.168.1.1"));
+
+	ns = json_object_new_array();
+	json_object_array_add(ns, json_object_new_string("192.168.1.1"));
+	json_object_array_add(ns, json_object_new_string("8.8.8.8"));
+
+	dict = json_object_new_object();
+	json_object_object_add(dict, key_serv_state,
+			json_object_new_string("online"));
+	json_object_object_add(dict, key_serv_name,
+			json_object_new_string("MyWifi"));
+	json_object_object_add(dict, key_serv_type,
+			json_object_new_string("wifi"));
+	json_object_object_add(dict, key_serv_strength,
+			json_object_new_int(72));
+	json_object_object_add(dict, key_serv_favorite,
+			json_object_new_boolean(1));
+	json_object_object_add(dict, key_serv_autoconnect,
+			json_object_new_boolean(1));
+	json_object_object_add(dict, key_serv_ipv4, ipv4);
+	json_object_object_add(dict, key_serv_nameservers, ns);
+
+	serv = json_object_new_array();
+	json_object_array_add(serv,
+			json_object_new_string("/net/connman/service/wifi_1_none"));
+	json_object_array_add(serv, dict);
+	servs = json_object_new_array();
+	json_object_array_add(servs, serv);
+
+	// No technology: the standalone service configuration
+	res = json_object_new_object();
+	json_object_object_add(res, key_services, servs);
+
+	return res;
+}
+
+/*
+ * Render jobj NB_REFRESH times, each refresh frees the previous view.
+ * Return the number of malloc of the last refreshes, the first ones fill the
+ * arena.
+ */
+static unsigned int bench(const char *name,
+		void (*render)(struct json_object *), void (*free_view)(void),
+		struct json_object *jobj)
+{
+	unsigned int steady;
+	uint64_t begin, us;
+	int i;
+
+	// A view which needed several chunks gets a bigger one on the next
+	// refresh
+	render(jobj);
+	free_view();
+	render(jobj);
+
+	nb_mallocs = 0;
+	begin = now_us();
+
+	for (i = 0; i < NB_REFRESH; i++) {
+		free_view();
+		render(jobj);
+	}
+
+	us = now_us() - begin;
+	steady = nb_mallocs;
+	free_view();
+
+	printf("[*] %s: %u malloc in %d refreshes, %.3f us per refresh\n",
+			name, steady, NB_REFRESH, (double) us / NB_REFRESH);
+
+	return steady;
+}
+
+int main()
+{
+	struct json_object *jobj;
+	SCREEN *scr;
+	FILE *devnull;
+	int ret = 0;
+
+	devnull = fopen("/dev/null", "w+");
+
+	if (!devnull || !(scr = newterm("vt100", devnull, devnull))) {
+		printf("[-] can't create a terminal on /dev/null\n");
+		return 1;
+	}
+
+	set_term(scr);
+	resizeterm(50, 120);
+	// Same windows as main.c create_win
+	win_body_lines = LINES - 5;
+	win_body = newwin(win_body_lines + 2, COLS, 1, 0);
+	win_header = newwin(1, COLS, 0, 0);
+	win_footer = newwin(2, COLS, LINES-2, 0);
+
+	jobj = home_page(4);
+
+	if (bench("home page", __renderers_home_page,
+				__renderers_free_home_page, jobj) != 0) {
+		printf("\tFAILED: the home page arena should reuse its chunk\n");
+		ret = 1;
+	}
+
+	json_object_put(jobj);
+	jobj = home_page(200);
+
+	if (bench("big home page", __renderers_home_page,
+				__renderers_free_home_page, jobj) != 0) {
+		printf("\tFAILED: the home page arena should reuse its chunk\n");
+		ret = 1;
+	}
+
+	json_object_put(jobj);
+	jobj = service_config();
+
+	if (bench("service configuration", __renderers_services,
+				__renderers_free_service_config, jobj) != 0) {
+		printf("\tFAILED: the configuration arena should reuse its"
+				" chunk\n");
+		ret = 1;
+	}
+
+	json_object_put(jobj);
+	endwin();
+	delscreen(scr);
+	fclose(devnull);
+
+	printf("\n[*] the end.\n");
+
+	return ret;
+}
@@ -0,0 +1,220 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "trace.h"
+
+/*
+ * This file reads and writes traces of dbus messages, e.g. what connman sent
+ * to a client. A trace is TRACE_MAGIC followed by records:
+ *	- the time of the message in microseconds since the start of the trace,
+ *	  64 bits
+ *	- the length of the message in bytes, 32 bits
+ *	- the message in the dbus wire format (dbus_message_marshal())
+ * The integers are in the byte order of the host which wrote the trace, dbus
+ * messages carry their own.
+ * A method return or error tells which call it answers with the path, the
+ * interface and the member of the call copied in its header: a trace is
+ * replayed without the calls, the replies are given to the calls waiting for
+ * them by path and member (see dbus_offline_reply()).
+ */
+
+struct trace {
+	FILE *file;
+	dbus_uint32_t serial;	// of the last message written
+};
+
+static struct trace* trace_new(const char *path, const char *mode)
+{
+	struct trace *trace;
+	FILE *file;
+
+	file = fopen(path, mode);
+
+	if (!file)
+		return NULL;
+
+	trace = calloc(1, sizeof(struct trace));
+
+	if (!trace) {
+		fclose(file);
+		return NULL;
+	}
+
+	trace->file = file;
+
+	return trace;
+}
+
+/*
+ * Create (or truncate) a trace file to write messages in.
+ * Return NULL on error (errno is set).
+ */
+struct trace* trace_create(const char *path)
+{
+	struct trace *trace = trace_new(path, "wb");
+
+	if (trace && fwrite(TRACE_MAGIC, TRACE_MAGIC_LEN, 1, trace->file) != 1) {
+		trace_close(trace);
+		return NULL;
+	}
+
+	return trace;
+}
+
+/*
+ * Open a trace file to read its messages.
+ * Return NULL on error (errno is set, EBADMSG if it isn't a trace).
+ */
+struct trace* trace_open(const char *path)
+{
+	struct trace *trace = trace_new(path, "rb");
+	char magic[TRACE_MAGIC_LEN];
+
+	if (!trace)
+		return NULL;
+
+	if (fread(magic, TRACE_MAGIC_LEN, 1, trace->file) != 1 ||
+			memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0) {
+		trace_close(trace);
+		errno = EBADMSG;
+		return NULL;
+	}
+
+	return trace;
+}
+
+/*
+ * Append a message to a trace.
+ * Return 0 on success, -ENOMEM or -EIO.
+ * @param time_us the time of the message since the start of the trace
+ * @param message the message, it isn't modified (a copy is written)
+ * @param call the call answered if message is a method return or an error,
+ *	NULL if unknown
+ */
+int trace_write(struct trace *trace, uint64_t time_us, DBusMessage *message,
+		DBusMessage *call)
+{
+	DBusMessage *copy;
+	char *buf;
+	int len, res = 0;
+	uint32_t len32;
+
+	copy = dbus_message_copy(message);
+
+	if (!copy)
+		return -ENOMEM;
+
+	// A message is valid with a serial only, a copy has none
+	dbus_message_set_serial(copy, ++trace->serial);
+
+	if (call) {
+		dbus_message_set_path(copy, dbus_message_get_path(call));
+		dbus_message_set_interface(copy,
+				dbus_message_get_interface(call));
+		dbus_message_set_member(copy, dbus_message_get_member(call));
+	}
+
+	if (!dbus_message_marshal(copy, &buf, &len)) {
+		dbus_message_unref(copy);
+		return -ENOMEM;
+	}
+
+	len32 = len;
+
+	if (fwrite(&time_us, sizeof(time_us), 1, trace->file) != 1 ||
+			fwrite(&len32, sizeof(len32), 1, trace->file) != 1 ||
+			fwrite(buf, len, 1, trace->file) != 1)
+		res = -EIO;
+
+	dbus_free(buf);
+	dbus_message_unref(copy);
+
+	return res;
+}
+
+/*
+ * Read the next message of a trace.
+ * Return 1 if a message was read, 0 at the end of the trace, -EBADMSG if the
+ * record is truncated or invalid, -ENOMEM.
+ * @param time_us set to the time of the message since the start of the trace
+ * @param message set to the message read, to unref
+ */
+int trace_read(struct trace *trace, uint64_t *time_us, DBusMessage **message)
+{
+	DBusError err;
+	uint32_t len;
+	char *buf;
+
+	if (fread(time_us, sizeof(*time_us), 1, trace->file) != 1)
+		return feof(trace->file) ? 0 : -EBADMSG;
+
+	if (fread(&len, sizeof(len), 1, trace->file) != 1 ||
+			len > DBUS_MAXIMUM_MESSAGE_LENGTH)
+		return -EBADMSG;
+
+	buf = malloc(len);
+
+	if (!buf)
+		return -ENOMEM;
+
+	if (fread(buf, len, 1, trace->file) != 1) {
+		free(buf);
+		return -EBADMSG;
+	}
+
+	dbus_error_init(&err);
+	*message = dbus_message_demarshal(buf, len, &err);
+	free(buf);
+
+	if (!*message) {
+		dbus_error_free(&err);
+		return -EBADMSG;
+	}
+
+	return 1;
+}
+
+/*
+ * Close a trace, the messages written are flushed.
+ * Return 0 on success, -EIO if they couldn't be.
+ */
+int trace_close(struct trace *trace)
+{
+	int res;
+
+	if (!trace)
+		return 0;
+
+	res = fclose(trace->file) == 0 ? 0 : -EIO;
+	free(trace);
+
+	return res;
+}
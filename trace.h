@@ -0,0 +1,54 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_TRACE_H
+#define __CONNMAN_TRACE_H
+
+#include <stdint.h>
+#include <dbus/dbus.h>
+
+// The first bytes of a trace file, the version is the last character.
+#define TRACE_MAGIC "CMTRACE1"
+
+#define TRACE_MAGIC_LEN 8
+
+struct trace;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct trace* trace_create(const char *path);
+
+struct trace* trace_open(const char *path);
+
+int trace_write(struct trace *trace, uint64_t time_us, DBusMessage *message,
+		DBusMessage *call);
+
+int trace_read(struct trace *trace, uint64_t *time_us, DBusMessage **message);
+
+int trace_close(struct trace *trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
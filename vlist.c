@@ -0,0 +1,388 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ncurses_utils.h"
+
+#include "vlist.h"
+
+/*
+ * This file implements a virtualized list: a selectable list of rows backed by
+ * a json array (the model). Only the rows in the viewport, plus VLIST_MARGIN
+ * rows above and below, are formatted; the memory used by the rendering
+ * depends on the height of the window, not on the number of rows. Rows are
+ * indexed by key to keep or restore the selection in constant time.
+ * The lines painted are remembered, a draw only repaints the lines that
+ * changed, and only damages the window if one was repainted.
+ */
+
+// A formatted row, slots are direct-mapped: row idx lives in idx % nb_slots.
+struct vlist_slot {
+	int idx;
+	char text[VLIST_LINE_MAX_LEN];
+};
+
+// A line of the window as it was painted.
+struct vlist_line {
+	bool valid;
+	bool selected;
+	char text[VLIST_LINE_MAX_LEN];
+};
+
+struct vlist {
+	WINDOW *win;
+	vlist_format_func format;
+	vlist_key_func key;
+	struct json_object *rows;	// the model, a json array
+	struct json_object *index;	// { "row key": row index }
+	int nb_rows;
+	int height, width;		// of the viewport
+	int top;			// first row displayed
+	int cur;			// selected row
+	struct vlist_slot *slots;
+	int nb_slots;
+	struct vlist_line *lines;	// height lines
+};
+
+/*
+ * Create an empty list.
+ * @param win the window to draw in, the list takes its ownership: it's
+ *	deleted by vlist_free()
+ * @param format the row formatter
+ * @param key returns the unique key of a row, used to keep the selection
+ *	across model changes
+ */
+struct vlist* vlist_new(WINDOW *win, vlist_format_func format,
+		vlist_key_func key)
+{
+	struct vlist *list;
+	int i;
+
+	list = calloc(1, sizeof(struct vlist));
+	assert(list != NULL);
+	list->win = win;
+	list->format = format;
+	list->key = key;
+	getmaxyx(win, list->height, list->width);
+
+	list->nb_slots = list->height + 2 * VLIST_MARGIN;
+	list->slots = malloc(sizeof(struct vlist_slot) * list->nb_slots);
+	list->lines = calloc(list->height, sizeof(struct vlist_line));
+	assert(list->slots != NULL && list->lines != NULL);
+
+	for (i = 0; i < list->nb_slots; i++)
+		list->slots[i].idx = -1;
+
+	return list;
+}
+
+void vlist_free(struct vlist *list)
+{
+	if (!list)
+		return;
+
+	json_object_put(list->rows);
+	json_object_put(list->index);
+	delwin(list->win);
+	free(list->slots);
+	free(list->lines);
+	free(list);
+}
+
+/*
+ * Keep the selected row in the viewport.
+ */
+static void clamp(struct vlist *list)
+{
+	int max_top;
+
+	if (list->cur >= list->nb_rows)
+		list->cur = list->nb_rows - 1;
+
+	if (list->cur < 0)
+		list->cur = 0;
+
+	max_top = list->nb_rows - list->height;
+
+	if (list->top > max_top)
+		list->top = max_top;
+
+	if (list->cur < list->top)
+		list->top = list->cur;
+
+	if (list->cur >= list->top + list->height)
+		list->top = list->cur - list->height + 1;
+
+	if (list->top < 0)
+		list->top = 0;
+}
+
+/*
+ * Index the rows of the model by key.
+ */
+static void index_rows(struct vlist *list)
+{
+	const char *row_key;
+	int i;
+
+	json_object_put(list->index);
+	list->index = json_object_new_object();
+
+	for (i = 0; i < list->nb_rows; i++) {
+		row_key = list->key(json_object_array_get_idx(list->rows, i));
+
+		if (row_key)
+			json_object_object_add(list->index, row_key,
+					json_object_new_int(i));
+	}
+}
+
+/*
+ * Return the index of the row with the key, -1 if none.
+ */
+static int find_key(struct vlist *list, const char *key)
+{
+	struct json_object *idx;
+
+	if (!key || !list->index ||
+			!json_object_object_get_ex(list->index, key, &idx))
+		return -1;
+
+	return json_object_get_int(idx);
+}
+
+/*
+ * Replace the model. The selection stays on the same key if it's still in the
+ * model. Call vlist_draw() to repaint the lines that changed.
+ * @param rows json array, its reference count is incremented
+ */
+void vlist_set_rows(struct vlist *list, struct json_object *rows)
+{
+	struct json_object *old_rows;
+	char *cur_key = NULL;
+	const char *tmp;
+	int i, idx;
+
+	old_rows = list->rows;
+
+	if (old_rows && list->nb_rows > 0) {
+		tmp = list->key(json_object_array_get_idx(old_rows, list->cur));
+		cur_key = tmp ? strdup(tmp) : NULL;
+	}
+
+	list->rows = json_object_get(rows);
+	list->nb_rows = rows ? json_object_array_length(rows) : 0;
+	json_object_put(old_rows);
+	index_rows(list);
+
+	// The content of every row may have changed
+	for (i = 0; i < list->nb_slots; i++)
+		list->slots[i].idx = -1;
+
+	idx = find_key(list, cur_key);
+
+	if (idx >= 0) {
+		// Keep the selected line where it was on the screen
+		list->top += idx - list->cur;
+		list->cur = idx;
+	}
+
+	free(cur_key);
+	clamp(list);
+}
+
+int vlist_count(struct vlist *list)
+{
+	return list->nb_rows;
+}
+
+/*
+ * Move the selection.
+ */
+void vlist_driver(struct vlist *list, enum vlist_req req)
+{
+	if (list->nb_rows == 0)
+		return;
+
+	switch (req) {
+		case VLIST_REQ_UP:
+			list->cur--;
+			break;
+
+		case VLIST_REQ_DOWN:
+			list->cur++;
+			break;
+
+		case VLIST_REQ_PAGE_UP:
+			list->cur -= list->height;
+			list->top -= list->height;
+			break;
+
+		case VLIST_REQ_PAGE_DOWN:
+			list->cur += list->height;
+			list->top += list->height;
+			break;
+
+		case VLIST_REQ_FIRST:
+			list->cur = 0;
+			break;
+
+		case VLIST_REQ_LAST:
+			list->cur = list->nb_rows - 1;
+			break;
+	}
+
+	clamp(list);
+	vlist_draw(list);
+}
+
+/*
+ * Return the row at idx in the model, NULL if out of bounds.
+ */
+struct json_object* vlist_row(struct vlist *list, int idx)
+{
+	if (idx < 0 || idx >= list->nb_rows)
+		return NULL;
+
+	return json_object_array_get_idx(list->rows, idx);
+}
+
+/*
+ * Return the selected row, NULL if the list is empty.
+ */
+struct json_object* vlist_current_row(struct vlist *list)
+{
+	return vlist_row(list, list->cur);
+}
+
+/*
+ * Select the row with the key.
+ * Return false if it isn't in the model.
+ */
+bool vlist_set_current_key(struct vlist *list, const char *key)
+{
+	int idx = find_key(list, key);
+
+	if (idx < 0)
+		return false;
+
+	list->cur = idx;
+	clamp(list);
+
+	return true;
+}
+
+/*
+ * Get the rows in the viewport.
+ * @param first the index of the first row displayed
+ * @param count the number of rows displayed
+ */
+void vlist_visible(struct vlist *list, int *first, int *count)
+{
+	*first = list->top;
+	*count = list->nb_rows - list->top;
+
+	if (*count > list->height)
+		*count = list->height;
+}
+
+/*
+ * Return the formatted text of a row, formatting it if it isn't cached.
+ */
+static const char* row_text(struct vlist *list, int idx)
+{
+	struct vlist_slot *slot = &list->slots[idx % list->nb_slots];
+
+	if (slot->idx != idx) {
+		list->format(json_object_array_get_idx(list->rows, idx),
+				slot->text, VLIST_LINE_MAX_LEN);
+		slot->text[VLIST_LINE_MAX_LEN-1] = '\0';
+		slot->idx = idx;
+	}
+
+	return slot->text;
+}
+
+/*
+ * Paint a line if it differs from what is on the screen.
+ * Return true if the line was painted.
+ */
+static bool paint_line(struct vlist *list, int y, const char *text,
+		bool selected)
+{
+	struct vlist_line *line = &list->lines[y];
+
+	if (line->valid && line->selected == selected &&
+			strcmp(line->text, text) == 0)
+		return false;
+
+	wattrset(list->win, selected ? A_REVERSE : A_NORMAL);
+	mvwprintw(list->win, y, 0, "%-*.*s", list->width, list->width, text);
+	wattrset(list->win, A_NORMAL);
+
+	line->valid = true;
+	line->selected = selected;
+	strncpy(line->text, text, VLIST_LINE_MAX_LEN-1);
+	line->text[VLIST_LINE_MAX_LEN-1] = '\0';
+
+	return true;
+}
+
+/*
+ * Format the rows around the viewport and repaint the lines that changed.
+ */
+void vlist_draw(struct vlist *list)
+{
+	int i, idx;
+	bool painted = false;
+
+	// Rows likely to scroll in next
+	for (i = 1; i <= VLIST_MARGIN; i++) {
+		if (list->top - i >= 0)
+			row_text(list, list->top - i);
+
+		if (list->top + list->height - 1 + i < list->nb_rows)
+			row_text(list, list->top + list->height - 1 + i);
+	}
+
+	for (i = 0; i < list->height; i++) {
+		idx = list->top + i;
+
+		if (idx < list->nb_rows)
+			painted |= paint_line(list, i, row_text(list, idx),
+					idx == list->cur);
+		else
+			painted |= paint_line(list, i, "", false);
+	}
+
+	if (list->nb_rows > 0)
+		wmove(list->win, list->cur - list->top, 0);
+
+	if (painted)
+		screen_damage(list->win);
+}
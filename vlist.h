@@ -0,0 +1,83 @@
+/*
+ *  connman-ncurses
+ *
+ *  Copyright (C) 2014 Eurogiciel. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CONNMAN_VLIST_H
+#define __CONNMAN_VLIST_H
+
+#include <stdbool.h>
+#include <ncurses.h>
+#include <json.h>
+
+// Maximum length of a formatted row.
+#define VLIST_LINE_MAX_LEN 256
+
+// Rows formatted ahead above and below the viewport.
+#define VLIST_MARGIN 4
+
+// Requests for vlist_driver().
+enum vlist_req {
+	VLIST_REQ_UP,
+	VLIST_REQ_DOWN,
+	VLIST_REQ_PAGE_UP,
+	VLIST_REQ_PAGE_DOWN,
+	VLIST_REQ_FIRST,
+	VLIST_REQ_LAST,
+};
+
+// Format a row of the model in buf (len bytes).
+typedef void (*vlist_format_func)(struct json_object *row, char *buf,
+		size_t len);
+
+// Return the unique key of a row of the model.
+typedef const char* (*vlist_key_func)(struct json_object *row);
+
+struct vlist;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct vlist* vlist_new(WINDOW *win, vlist_format_func format,
+		vlist_key_func key);
+
+void vlist_free(struct vlist *list);
+
+void vlist_set_rows(struct vlist *list, struct json_object *rows);
+
+int vlist_count(struct vlist *list);
+
+void vlist_driver(struct vlist *list, enum vlist_req req);
+
+struct json_object* vlist_current_row(struct vlist *list);
+
+struct json_object* vlist_row(struct vlist *list, int idx);
+
+bool vlist_set_current_key(struct vlist *list, const char *key);
+
+void vlist_visible(struct vlist *list, int *first, int *count);
+
+void vlist_draw(struct vlist *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif